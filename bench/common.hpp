@@ -0,0 +1,47 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_BENCH_COMMON_HPP
+#define BOOST_HTTP_BENCH_COMMON_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Keeps the optimizer from discarding the benchmarked computation
+template<class T>
+void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+    static_cast<void>(sink);
+#endif
+}
+
+// Runs f iterations times and returns the mean time per call in nanoseconds
+template<class F>
+double measure(std::size_t iterations, F &&f)
+{
+    using namespace std::chrono;
+
+    auto start = steady_clock::now();
+    for (std::size_t i = 0;i != iterations;++i)
+        f(i);
+    auto elapsed = steady_clock::now() - start;
+
+    return duration_cast<duration<double, std::nano>>(elapsed).count()
+        / iterations;
+}
+
+inline void report(const std::string &name, double ns)
+{
+    std::cout << name << ": " << ns << " ns/op" << std::endl;
+}
+
+#endif // BOOST_HTTP_BENCH_COMMON_HPP
@@ -0,0 +1,147 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+/* Parsing and formatting of HTTP-dates, as done by the file server for every
+   conditional request and response. The std::regex based parser is the one
+   header_to_ptime used before, kept here as reference. */
+
+#include <cassert>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+#include <boost/http/algorithm/header.hpp>
+
+#include "common.hpp"
+
+using namespace boost;
+
+/* Verbatim copy of the previous detail::rfc1123 (and its month helper), so
+   the comparison is against the implementation that was replaced. */
+namespace baseline {
+
+template<class Target, class BidirIt>
+Target from_decimal_submatch(const std::sub_match<BidirIt> &match)
+{
+    return http::detail::from_decimal_string<Target>(match.first,
+                                                     match.second);
+}
+
+template<class Target, class BidirIt>
+Target from_submatch_to_month(std::sub_match<BidirIt> m)
+{
+    switch (*m.first) {
+    case 'A': // "Apr" or "Aug"
+        ++m.first;
+        return (*m.first == 'p') ? 4 : 8;
+    case 'D': // "Dec"
+        return 12;
+    case 'F': // "Feb"
+        return 2;
+    case 'J': // "Jan" or "Jun" or "Jul"
+        ++m.first;
+        if (*m.first == 'a')
+            return 1;
+        ++m.first;
+        return (*m.first == 'n') ? 6 : 7;
+    case 'M': // "Mar" or "May"
+        ++m.first; ++m.first;
+        return (*m.first == 'r') ? 3 : 5;
+    case 'N': // "Nov"
+        return 11;
+    case 'O': // "Oct"
+        return 10;
+    case 'S': // "Sep"
+        return 9;
+    default:
+        assert(false);
+    }
+}
+
+template<class StringRef>
+bool rfc1123(const StringRef &value, posix_time::ptime &datetime)
+{
+    using namespace gregorian;
+    using namespace posix_time;
+
+    typedef date::year_type::value_type year_type;
+    typedef date::month_type::value_type month_type;
+    typedef date::day_type::value_type day_type;
+    typedef time_duration::hour_type hour_type;
+    typedef time_duration::min_type min_type;
+    typedef time_duration::sec_type sec_type;
+
+    static const std::basic_regex<typename StringRef::value_type>
+        regex("(?:Mon|Tue|Wed|Thu|Fri|Sat|Sun), " // day
+              "(\\d{2}) " // day-1
+              "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) " // month-2
+              "(\\d{4}) " // year-3
+              "(\\d{2}):" // hour-4
+              "(\\d{2}):" // minutes-5
+              "(\\d{2}) " // seconds-6
+              "GMT");
+
+    std::match_results<typename StringRef::const_iterator> matches;
+    if (!std::regex_match(value.begin(), value.end(), matches, regex))
+        return false;
+
+    hour_type hour = from_decimal_submatch<hour_type>(matches[4]);
+    min_type min = from_decimal_submatch<min_type>(matches[5]);
+    sec_type sec = from_decimal_submatch<sec_type>(matches[6]);
+
+    if (hour > 23 || min > 59 || sec > 60)
+        return false;
+
+    try {
+        datetime = ptime(date(from_decimal_submatch<year_type>(matches[3]),
+                              from_submatch_to_month<month_type>(matches[2]),
+                              from_decimal_submatch<day_type>(matches[1])),
+                         time_duration(hour, min, sec));
+    } catch(std::out_of_range&) {
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace baseline
+
+int main()
+{
+    const std::size_t iterations = 1000000;
+    const std::vector<std::string> inputs{
+        "Sun, 06 Nov 1994 08:49:37 GMT",
+        "Sunday, 06-Nov-94 08:49:37 GMT",
+        "Sun Nov  6 08:49:37 1994"
+    };
+    const string_ref fixdate(inputs[0]);
+
+    auto regex_ns = measure(iterations, [&](std::size_t) {
+        posix_time::ptime datetime;
+        baseline::rfc1123(fixdate, datetime);
+        do_not_optimize(datetime);
+    });
+    report("std::regex IMF-fixdate", regex_ns);
+
+    auto fixdate_ns = measure(iterations, [&](std::size_t) {
+        do_not_optimize(http::header_to_ptime(fixdate));
+    });
+    report("header_to_ptime IMF-fixdate", fixdate_ns);
+
+    auto mixed_ns = measure(iterations, [&](std::size_t i) {
+        do_not_optimize(http::header_to_ptime(string_ref(inputs[i % 3])));
+    });
+    report("header_to_ptime mixed formats", mixed_ns);
+
+    std::cout << "IMF-fixdate speedup: " << regex_ns / fixdate_ns << 'x'
+              << std::endl;
+
+    const auto now = posix_time::second_clock::universal_time();
+    report("to_http_date", measure(iterations, [&](std::size_t) {
+        do_not_optimize(http::to_http_date<std::string>(now));
+    }));
+}
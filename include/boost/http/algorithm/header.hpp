@@ -7,12 +7,16 @@
 #define BOOST_HTTP_ALGORITHM_HEADER_HPP
 
 #include <algorithm>
-#include <regex>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
 #include <type_traits>
 #include <limits>
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
+#include <boost/http/detail/http_date.hpp>
+
 namespace boost {
 namespace http {
 
@@ -34,7 +38,7 @@ namespace detail {
  * input.
  *
  * Don't freak out about the lack of valid inputs. This is checked by the
- * regex layer.
+ * parsing layer.
  *
  * It's just a workaround to not throw away all the efforts spent in the other
  * layers.*/
@@ -74,45 +78,80 @@ Target from_decimal_string(BidirIt begin, BidirIt end)
     return ret;
 }
 
-template<class Target, class BidirIt>
-Target from_decimal_submatch(const std::sub_match<BidirIt> &match)
+/* The HTTP-date parsers below match a fixed layout, so they just walk the
+   input once instead of going through std::regex (they accept exactly the same
+   inputs as the regexes in the comments). */
+
+// Parses exactly N ASCII digits
+template<std::size_t N, class Target, class RandomIt>
+bool parse_fixed_decimal(RandomIt first, Target &value)
 {
-    return from_decimal_string<Target>(match.first, match.second);
+    Target ret = 0;
+    for (std::size_t i = 0;i != N;++i) {
+        char c = first[i];
+        if (c < '0' || c > '9')
+            return false;
+        ret = ret * 10 + (c - '0');
+    }
+    value = ret;
+    return true;
 }
 
-template<class Target, class BidirIt>
-Target from_submatch_to_month(std::sub_match<BidirIt> m)
+template<std::size_t N, class RandomIt>
+bool match_literal(RandomIt first, const char (&literal)[N])
 {
-    switch (*m.first) {
-    case 'A': // "Apr" or "Aug"
-        ++m.first;
-        return (*m.first == 'p') ? 4 : 8;
-    case 'D': // "Dec"
-        return 12;
-    case 'F': // "Feb"
-        return 2;
-    case 'J': // "Jan" or "Jun" or "Jul"
-        ++m.first;
-        if (*m.first == 'a')
-            return 1;
-        ++m.first;
-        return (*m.first == 'n') ? 6 : 7;
-    case 'M': // "Mar" or "May"
-        ++m.first; ++m.first;
-        return (*m.first == 'r') ? 3 : 5;
-    case 'N': // "Nov"
-        return 11;
-    case 'O': // "Oct"
-        return 10;
-    case 'S': // "Sep"
-        return 9;
-    default:
-        assert(false);
+    for (std::size_t i = 0;i != N - 1;++i) {
+        if (first[i] != literal[i])
+            return false;
     }
+    return true;
 }
 
-template<class StringRef>
-bool rfc1123(const StringRef &value, posix_time::ptime &datetime)
+// "Jan" -> 1, ..., "Dec" -> 12 and 0 for anything else
+template<class RandomIt>
+int parse_month(RandomIt first)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    for (int i = 0;i != 12;++i) {
+        const char *m = months + 3 * i;
+        if (first[0] == m[0] && first[1] == m[1] && first[2] == m[2])
+            return i + 1;
+    }
+    return 0;
+}
+
+// "Mon" to "Sun"
+template<class RandomIt>
+bool match_short_weekday(RandomIt first)
+{
+    static const char days[] = "MonTueWedThuFriSatSun";
+    for (int i = 0;i != 7;++i) {
+        const char *d = days + 3 * i;
+        if (first[0] == d[0] && first[1] == d[1] && first[2] == d[2])
+            return true;
+    }
+    return false;
+}
+
+/* "Monday" to "Sunday" followed by ", ". Returns the size of the match or
+   zero. */
+template<class RandomIt>
+std::size_t match_long_weekday(RandomIt first, std::size_t size)
+{
+    static const char *const days[] = {
+        "Monday, ", "Tuesday, ", "Wednesday, ", "Thursday, ", "Friday, ",
+        "Saturday, ", "Sunday, "
+    };
+    for (const char *d: days) {
+        std::size_t n = std::strlen(d);
+        if (n <= size && std::equal(d, d + n, first))
+            return n;
+    }
+    return 0;
+}
+
+inline bool make_ptime(int year, int month, int day, int hour, int min,
+                       int sec, posix_time::ptime &datetime)
 {
     using namespace gregorian;
     using namespace posix_time;
@@ -120,35 +159,14 @@ bool rfc1123(const StringRef &value, posix_time::ptime &datetime)
     typedef date::year_type::value_type year_type;
     typedef date::month_type::value_type month_type;
     typedef date::day_type::value_type day_type;
-    typedef time_duration::hour_type hour_type;
-    typedef time_duration::min_type min_type;
-    typedef time_duration::sec_type sec_type;
-
-    static const std::basic_regex<typename StringRef::value_type>
-        regex("(?:Mon|Tue|Wed|Thu|Fri|Sat|Sun), " // day
-              "(\\d{2}) " // day-1
-              "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) " // month-2
-              "(\\d{4}) " // year-3
-              "(\\d{2}):" // hour-4
-              "(\\d{2}):" // minutes-5
-              "(\\d{2}) " // seconds-6
-              "GMT");
-
-    std::match_results<typename StringRef::const_iterator> matches;
-    if (!std::regex_match(value.begin(), value.end(), matches, regex))
-        return false;
-
-    hour_type hour = from_decimal_submatch<hour_type>(matches[4]);
-    min_type min = from_decimal_submatch<min_type>(matches[5]);
-    sec_type sec = from_decimal_submatch<sec_type>(matches[6]);
 
     if (hour > 23 || min > 59 || sec > 60)
         return false;
 
     try {
-        datetime = ptime(date(from_decimal_submatch<year_type>(matches[3]),
-                              from_submatch_to_month<month_type>(matches[2]),
-                              from_decimal_submatch<day_type>(matches[1])),
+        datetime = ptime(date(static_cast<year_type>(year),
+                              static_cast<month_type>(month),
+                              static_cast<day_type>(day)),
                          time_duration(hour, min, sec));
     } catch(std::out_of_range&) {
         return false;
@@ -157,102 +175,83 @@ bool rfc1123(const StringRef &value, posix_time::ptime &datetime)
     return true;
 }
 
+/* (?:Mon|Tue|Wed|Thu|Fri|Sat|Sun), (\d{2}) (Jan|...|Dec) (\d{4})
+   (\d{2}):(\d{2}):(\d{2}) GMT */
 template<class StringRef>
-bool rfc1036(const StringRef &value, posix_time::ptime &datetime)
+bool rfc1123(const StringRef &value, posix_time::ptime &datetime)
 {
-    using namespace gregorian;
-    using namespace posix_time;
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    if (value.size() != 29)
+        return false;
 
-    typedef date::year_type::value_type year_type;
-    typedef date::month_type::value_type month_type;
-    typedef date::day_type::value_type day_type;
-    typedef time_duration::hour_type hour_type;
-    typedef time_duration::min_type min_type;
-    typedef time_duration::sec_type sec_type;
-
-    static const std::basic_regex<typename StringRef::value_type>
-        regex("(?:Monday|Tuesday|Wednesday|Thursday|Friday|Saturday|Sunday), " // day
-              "(\\d{2})-" // day-1
-              "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec)-" // month-2
-              "(\\d{2}) " // year-3
-              "(\\d{2}):" // hour-4
-              "(\\d{2}):" // minutes-5
-              "(\\d{2}) " // seconds-6
-              "GMT");
-
-    std::match_results<typename StringRef::const_iterator> matches;
-    if (!std::regex_match(value.begin(), value.end(), matches, regex))
+    auto it = value.begin();
+    int day, month, year, hour, min, sec;
+
+    if (!match_short_weekday(it) || !match_literal(it + 3, ", ")
+        || !parse_fixed_decimal<2>(it + 5, day) || it[7] != ' '
+        || (month = parse_month(it + 8)) == 0 || it[11] != ' '
+        || !parse_fixed_decimal<4>(it + 12, year) || it[16] != ' '
+        || !parse_fixed_decimal<2>(it + 17, hour) || it[19] != ':'
+        || !parse_fixed_decimal<2>(it + 20, min) || it[22] != ':'
+        || !parse_fixed_decimal<2>(it + 23, sec)
+        || !match_literal(it + 25, " GMT")) {
         return false;
+    }
 
-    hour_type hour = from_decimal_submatch<hour_type>(matches[4]);
-    min_type min = from_decimal_submatch<min_type>(matches[5]);
-    sec_type sec = from_decimal_submatch<sec_type>(matches[6]);
+    return make_ptime(year, month, day, hour, min, sec, datetime);
+}
 
-    if (hour > 23 || min > 59 || sec > 60)
+/* (?:Monday|...|Sunday), (\d{2})-(Jan|...|Dec)-(\d{2}) (\d{2}):(\d{2}):(\d{2})
+   GMT */
+template<class StringRef>
+bool rfc1036(const StringRef &value, posix_time::ptime &datetime)
+{
+    // "Sunday, " + "06-Nov-94 08:49:37 GMT"
+    auto n = match_long_weekday(value.begin(), value.size());
+    if (n == 0 || value.size() - n != 22)
         return false;
 
-    try {
-        datetime = ptime(date(from_decimal_submatch<year_type>(matches[3])
-                              + 1900,
-                              from_submatch_to_month<month_type>(matches[2]),
-                              from_decimal_submatch<day_type>(matches[1])),
-                         time_duration(hour, min, sec));
-    } catch(std::out_of_range&) {
+    auto it = value.begin() + n;
+    int day, month, year, hour, min, sec;
+
+    if (!parse_fixed_decimal<2>(it, day) || it[2] != '-'
+        || (month = parse_month(it + 3)) == 0 || it[6] != '-'
+        || !parse_fixed_decimal<2>(it + 7, year) || it[9] != ' '
+        || !parse_fixed_decimal<2>(it + 10, hour) || it[12] != ':'
+        || !parse_fixed_decimal<2>(it + 13, min) || it[15] != ':'
+        || !parse_fixed_decimal<2>(it + 16, sec)
+        || !match_literal(it + 18, " GMT")) {
         return false;
     }
 
-    return true;
+    return make_ptime(year + 1900, month, day, hour, min, sec, datetime);
 }
 
+/* (?:Mon|Tue|Wed|Thu|Fri|Sat|Sun) (Jan|...|Dec) ((?:\d| )\d)
+   (\d{2}):(\d{2}):(\d{2}) (\d{4}) */
 template<class StringRef>
 bool asctime(const StringRef &value, posix_time::ptime &datetime)
 {
-    using namespace gregorian;
-    using namespace posix_time;
-
-    typedef date::year_type::value_type year_type;
-    typedef date::month_type::value_type month_type;
-    typedef date::day_type::value_type day_type;
-    typedef time_duration::hour_type hour_type;
-    typedef time_duration::min_type min_type;
-    typedef time_duration::sec_type sec_type;
-
-    static const std::basic_regex<typename StringRef::value_type>
-        regex("(?:Mon|Tue|Wed|Thu|Fri|Sat|Sun) " // day
-              "(Jan|Feb|Mar|Apr|May|Jun|Jul|Aug|Sep|Oct|Nov|Dec) " // month-1
-              "((?:\\d| )\\d) " // day-2
-              "(\\d{2}):" // hour-3
-              "(\\d{2}):" // minutes-4
-              "(\\d{2}) " // seconds-5
-              "(\\d{4})" // year-6
-              );
-
-    std::match_results<typename StringRef::const_iterator> matches;
-    if (!std::regex_match(value.begin(), value.end(), matches, regex))
-        return false;
-
-    hour_type hour = from_decimal_submatch<hour_type>(matches[3]);
-    min_type min = from_decimal_submatch<min_type>(matches[4]);
-    sec_type sec = from_decimal_submatch<sec_type>(matches[5]);
-
-    if (hour > 23 || min > 59 || sec > 60)
+    // "Sun Nov  6 08:49:37 1994"
+    if (value.size() != 24)
         return false;
 
-    try {
-        datetime = ptime(date(from_decimal_submatch<year_type>(matches[6]),
-                              from_submatch_to_month<month_type>(matches[1]),
-                              [&matches]() {
-                                  auto m = matches[2];
-                                  if (*m.first == ' ')
-                                      ++m.first;
-                                  return from_decimal_submatch<day_type>(m);
-                              }()),
-                         time_duration(hour, min, sec));
-    } catch(std::out_of_range&) {
+    auto it = value.begin();
+    int day, month, year, hour, min, sec;
+
+    if (!match_short_weekday(it) || it[3] != ' '
+        || (month = parse_month(it + 4)) == 0 || it[7] != ' '
+        || !(it[8] == ' ' ? parse_fixed_decimal<1>(it + 9, day)
+             : parse_fixed_decimal<2>(it + 8, day))
+        || it[10] != ' '
+        || !parse_fixed_decimal<2>(it + 11, hour) || it[13] != ':'
+        || !parse_fixed_decimal<2>(it + 14, min) || it[16] != ':'
+        || !parse_fixed_decimal<2>(it + 17, sec) || it[19] != ' '
+        || !parse_fixed_decimal<4>(it + 20, year)) {
         return false;
     }
 
-    return true;
+    return make_ptime(year, month, day, hour, min, sec, datetime);
 }
 
 template<class String, unsigned N, class Unsigned>
@@ -284,63 +283,18 @@ posix_time::ptime header_to_ptime(const StringRef &value)
 template<class String>
 String to_http_date(const posix_time::ptime &datetime)
 {
-    using detail::append_number;
+    if (datetime.is_special())
+        throw std::out_of_range("bad date");
 
-    typedef gregorian::date::ymd_type::year_type::value_type year_type;
-    typedef gregorian::date::ymd_type::day_type::value_type day_type;
+    std::int_least64_t days
+        = (datetime.date() - gregorian::date(1970, 1, 1)).days();
+    char buffer[detail::http_date_size];
+    detail::format_http_date(days * 86400
+                             + datetime.time_of_day().total_seconds(),
+                             buffer);
 
     String ret;
-    ret.reserve(29);
-    ret.append([&datetime]() {
-            using namespace gregorian;
-            switch(datetime.date().day_of_week()) {
-            case Monday: return "Mon, ";
-            case Tuesday: return "Tue, ";
-            case Wednesday: return "Wed, ";
-            case Thursday: return "Thu, ";
-            case Friday: return "Fri, ";
-            case Saturday: return "Sat, ";
-            case Sunday: return "Sun, ";
-            default:
-                throw std::out_of_range("bad day of week");
-            }
-        }(), 5);
-
-    {
-        gregorian::date::ymd_type ymd = datetime.date().year_month_day();
-
-        append_number<String, 2, day_type>(ret, ymd.day);
-        ret.push_back(' ');
-
-        switch (ymd.month) {
-        case 1: ret.append("Jan ", 4); break;
-        case 2: ret.append("Feb ", 4); break;
-        case 3: ret.append("Mar ", 4); break;
-        case 4: ret.append("Apr ", 4); break;
-        case 5: ret.append("May ", 4); break;
-        case 6: ret.append("Jun ", 4); break;
-        case 7: ret.append("Jul ", 4); break;
-        case 8: ret.append("Aug ", 4); break;
-        case 9: ret.append("Sep ", 4); break;
-        case 10: ret.append("Oct ", 4); break;
-        case 11: ret.append("Nov ", 4); break;
-        case 12: ret.append("Dec ", 4); break;
-        default:
-            throw std::out_of_range("bad month");
-        }
-
-        append_number<String, 4, year_type>(ret, ymd.year);
-    }
-    {
-        auto time = datetime.time_of_day();
-        ret.push_back(' ');
-        append_number<String, 2>(ret, time.hours());
-        ret.push_back(':');
-        append_number<String, 2>(ret, time.minutes());
-        ret.push_back(':');
-        append_number<String, 2>(ret, time.seconds());
-    }
-    ret.append(" GMT", 4);
+    ret.append(buffer, detail::http_date_size);
     return ret;
 }
 
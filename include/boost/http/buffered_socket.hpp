@@ -40,6 +40,7 @@ public:
     using Parent::write_response_native_stream;
     using Parent::get_io_service;
     using Parent::async_read_request;
+    using Parent::async_read_requests;
     using Parent::async_read_some;
     using Parent::async_read_trailers;
     using Parent::async_write_response;
@@ -48,6 +49,12 @@ public:
     using Parent::async_write;
     using Parent::async_write_trailers;
     using Parent::async_write_end_of_message;
+    using Parent::pipelined_flush_threshold;
+    using Parent::set_pipelined_flush_threshold;
+    using Parent::date_header;
+    using Parent::set_date_header;
+    using Parent::limits;
+    using Parent::set_limits;
 
     basic_buffered_socket(boost::asio::io_service &io_service)
         : Parent(io_service, boost::asio::buffer(BufferParent::buffer))
@@ -63,6 +70,17 @@ public:
 
 private:
     typedef detail::buffered_socket_wrapping_buffer<N> BufferParent;
+
+    /* The operations using the private hooks of basic_socket reach them
+       through the private base */
+    template<class, class>
+    friend struct detail::on_async_response_sendfile;
+
+    template<class, class>
+    friend struct detail::on_async_response_sendfile_multi;
+
+    template<class, class, class>
+    friend struct detail::on_async_receive_body_to_file;
 };
 
 typedef basic_buffered_socket<boost::asio::ip::tcp::socket> buffered_socket;
@@ -0,0 +1,529 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+namespace boost {
+namespace http {
+
+template<class Socket>
+bool basic_compressing_socket<Socket>::is_open() const
+{
+    return channel.is_open();
+}
+
+template<class Socket>
+read_state basic_compressing_socket<Socket>::read_state() const
+{
+    return channel.read_state();
+}
+
+template<class Socket>
+write_state basic_compressing_socket<Socket>::write_state() const
+{
+    return channel.write_state();
+}
+
+template<class Socket>
+bool basic_compressing_socket<Socket>::write_response_native_stream() const
+{
+    return channel.write_response_native_stream();
+}
+
+template<class Socket>
+asio::io_service &basic_compressing_socket<Socket>::get_io_service()
+{
+    return channel.get_io_service();
+}
+
+template<class Socket>
+template<class String, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::async_read_request(String &method, String &path, Message &message,
+                     CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+
+    asio::async_result<Handler> result(handler);
+
+    accepted = coding::identity;
+    head_request = false;
+
+    channel.async_read_request(method, path, message,
+                               [this,handler,&method,&message]
+                               (const system::error_code &ec) mutable {
+        if (!ec) {
+            typedef detail::accept_encoding_qvalues qvalues;
+
+            auto q = detail::accept_encoding(message.headers());
+            auto gzip = qvalues::of(q.gzip, q.any);
+            auto deflate = qvalues::of(q.deflate, q.any);
+
+            // gzip is preferred because "deflate" was often sent unwrapped
+            if (gzip > 0 && gzip >= deflate)
+                accepted = coding::gzip;
+            else if (deflate > 0)
+                accepted = coding::deflate;
+
+            head_request = method == "HEAD";
+        }
+        handler(ec);
+    });
+
+    return result.get();
+}
+
+template<class Socket>
+template<class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>::async_read_some(Message &message,
+                                                  CompletionToken &&token)
+{
+    return channel.async_read_some(message,
+                                   std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>::async_read_trailers(Message &message,
+                                                      CompletionToken &&token)
+{
+    return channel.async_read_trailers(message,
+                                       std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class StringRef, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::async_write_response(std::uint_fast16_t status_code,
+                       const StringRef &reason_phrase, const Message &message,
+                       CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    /* The usual answer to a HEAD request carries the "content-length" of the
+       body instead of the body itself. compressible() checks that length. */
+    const bool length_only = head_request && message.body().size() == 0
+        && message.headers().find("content-length") != message.headers().end();
+
+    if (!compressible(status_code, message)
+        || (message.body().size() < options_.min_size && !length_only)) {
+        return channel.async_write_response(status_code, reason_phrase,
+                                            message,
+                                            std::forward<CompletionToken>
+                                            (token));
+    }
+
+    /* The compressed length can't be known without the body, so such
+       responses only get "vary" */
+    const auto chosen = length_only ? coding::identity : accepted;
+    prepare_metadata(message, chosen);
+
+    if (length_only) {
+        return channel.async_write_response(status_code, reason_phrase,
+                                            metadata,
+                                            std::forward<CompletionToken>
+                                            (token));
+    }
+
+    auto &body = metadata.body();
+    body.clear();
+    if (chosen != coding::identity) {
+        acquire_deflater();
+        deflater->compress(message.body().data(), message.body().size(),
+                           /*finish=*/true, body);
+        release_deflater();
+    }
+
+    metadata.headers().erase("content-length");
+
+    if (head_request) {
+        /* The body isn't written, but it gives the "content-length" that a GET
+           request would get */
+        auto size = (chosen == coding::identity) ? message.body().size()
+            : body.size();
+        metadata.headers().emplace("content-length", std::to_string(size));
+        return channel.async_write_response(status_code, reason_phrase,
+                                            metadata,
+                                            std::forward<CompletionToken>
+                                            (token));
+    }
+
+    // The next layer computes the "content-length" of the (compressed) body
+
+    if (chosen == coding::identity) {
+        // Only "vary" was added, so the body doesn't need to be copied
+        return write_response_headers(status_code, reason_phrase, message,
+                                      std::forward<CompletionToken>(token),
+                                      detail::is_basic_socket<Socket>{});
+    }
+
+    return channel.async_write_response(status_code, reason_phrase, metadata,
+                                        std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::async_write_response_continue(CompletionToken &&token)
+{
+    return channel.async_write_response_continue(std::forward<CompletionToken>
+                                                 (token));
+}
+
+template<class Socket>
+template<class StringRef, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::async_write_response_metadata(std::uint_fast16_t status_code,
+                                const StringRef &reason_phrase,
+                                const Message &message, CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    /* Without native stream (or out of order), the next layer fails the
+       operation and the state machine is left untouched */
+    auto state = channel.write_state();
+    if (!channel.write_response_native_stream()
+        || (state != http::write_state::empty
+            && state != http::write_state::continue_issued)
+        || !compressible(status_code, message)) {
+        return channel.async_write_response_metadata(status_code,
+                                                     reason_phrase, message,
+                                                     std::forward
+                                                     <CompletionToken>(token));
+    }
+
+    Handler handler(std::forward<CompletionToken>(token));
+
+    asio::async_result<Handler> result(handler);
+
+    /* The response to a HEAD request has no body to frame, so it keeps the
+       "content-length" and only gets "vary" */
+    const auto chosen = head_request ? coding::identity : accepted;
+    prepare_metadata(message, chosen);
+
+    if (chosen != coding::identity) {
+        // The length of the compressed body is unknown, so chunked is used
+        metadata.headers().erase("content-length");
+        acquire_deflater();
+    }
+
+    channel.async_write_response_metadata(status_code, reason_phrase, metadata,
+                                          [this,handler]
+                                          (const system::error_code &ec)
+                                          mutable {
+        if (ec)
+            release_deflater();
+        handler(ec);
+    });
+
+    return result.get();
+}
+
+template<class Socket>
+template<class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>::async_write(const Message &message,
+                                              CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    if (!deflater
+        || channel.write_state() != http::write_state::metadata_issued
+        || message.body().size() == 0) {
+        return channel.async_write(message,
+                                   std::forward<CompletionToken>(token));
+    }
+
+    auto &body = metadata.body();
+    body.clear();
+    deflater->compress(message.body().data(), message.body().size(),
+                       /*finish=*/false, body);
+
+    return channel.async_write(metadata, std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>::async_write_trailers(const Message &message,
+                                                       CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    if (!deflater
+        || channel.write_state() != http::write_state::metadata_issued) {
+        return channel.async_write_trailers(message,
+                                            std::forward<CompletionToken>
+                                            (token));
+    }
+
+    Handler handler(std::forward<CompletionToken>(token));
+
+    asio::async_result<Handler> result(handler);
+
+    auto &body = metadata.body();
+    body.clear();
+    deflater->compress(nullptr, 0, /*finish=*/true, body);
+    release_deflater();
+
+    channel.async_write(metadata, [this,handler,&message]
+                        (const system::error_code &ec) mutable {
+        if (ec) {
+            handler(ec);
+            return;
+        }
+
+        channel.async_write_trailers(message, handler);
+    });
+
+    return result.get();
+}
+
+template<class Socket>
+template<class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::async_write_end_of_message(CompletionToken &&token)
+{
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    if (!deflater
+        || channel.write_state() != http::write_state::metadata_issued) {
+        return channel.async_write_end_of_message(std::forward<CompletionToken>
+                                                  (token));
+    }
+
+    Handler handler(std::forward<CompletionToken>(token));
+
+    asio::async_result<Handler> result(handler);
+
+    auto &body = metadata.body();
+    body.clear();
+    deflater->compress(nullptr, 0, /*finish=*/true, body);
+    release_deflater();
+
+    channel.async_write(metadata, [this,handler]
+                        (const system::error_code &ec) mutable {
+        if (ec) {
+            handler(ec);
+            return;
+        }
+
+        channel.async_write_end_of_message(handler);
+    });
+
+    return result.get();
+}
+
+template<class Socket>
+template<class... Args>
+basic_compressing_socket<Socket>::basic_compressing_socket(Args&&... args)
+    : channel(std::forward<Args>(args)...)
+{}
+
+template<class Socket>
+Socket &basic_compressing_socket<Socket>::next_layer()
+{
+    return channel;
+}
+
+template<class Socket>
+const Socket &basic_compressing_socket<Socket>::next_layer() const
+{
+    return channel;
+}
+
+template<class Socket>
+const compression_options &basic_compressing_socket<Socket>::options() const
+{
+    return options_;
+}
+
+template<class Socket>
+void basic_compressing_socket<Socket>::set_options(compression_options options)
+{
+    options_ = std::move(options);
+}
+
+template<class Socket>
+template<class Message>
+bool basic_compressing_socket<Socket>
+::compressible(std::uint_fast16_t status_code, const Message &message) const
+{
+    typedef basic_string_ref<
+        typename Message::headers_type::mapped_type::value_type>
+        string_ref_type;
+
+    if (status_code / 100 == 1 || status_code == 204
+        || status_code == 206 || status_code == 304) {
+        return false;
+    }
+
+    const auto &headers = message.headers();
+
+    if (headers.find("content-encoding") != headers.end()
+        || headers.find("content-range") != headers.end()) {
+        return false;
+    }
+
+    auto cache_control = headers.equal_range("cache-control");
+    for (; cache_control.first != cache_control.second
+         ; ++cache_control.first) {
+        bool no_transform = false;
+        header_value_for_each((*cache_control.first).second,
+                              [&no_transform](const string_ref_type &v) {
+                                  if (iequals(v, "no-transform"))
+                                      no_transform = true;
+                              });
+        if (no_transform)
+            return false;
+    }
+
+    auto content_type = headers.find("content-type");
+    if (content_type == headers.end() || !options_.content_type_filter
+        || !options_.content_type_filter(string_ref(content_type->second.data(),
+                                                    content_type->second
+                                                    .size()))) {
+        return false;
+    }
+
+    auto content_length = headers.find("content-length");
+    if (content_length != headers.end()) {
+        std::size_t length = 0;
+        for (auto c: content_length->second) {
+            if (c < '0' || c > '9')
+                return false;
+            length = length * 10 + (c - '0');
+            if (length >= options_.min_size)
+                break;
+        }
+        if (length < options_.min_size)
+            return false;
+    }
+
+    return true;
+}
+
+template<class Socket>
+template<class StringRef, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::write_response_headers(std::uint_fast16_t status_code,
+                         const StringRef &reason_phrase,
+                         const Message &message, CompletionToken &&token,
+                         std::true_type)
+{
+    return channel.async_write_response(status_code, reason_phrase, metadata,
+                                        asio::buffer(message.body()),
+                                        std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class StringRef, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_compressing_socket<Socket>
+::write_response_headers(std::uint_fast16_t status_code,
+                         const StringRef &reason_phrase,
+                         const Message &message, CompletionToken &&token,
+                         std::false_type)
+{
+    metadata.body().assign(message.body().begin(), message.body().end());
+    return channel.async_write_response(status_code, reason_phrase, metadata,
+                                        std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class Message>
+void basic_compressing_socket<Socket>::prepare_metadata(const Message &message,
+                                                        coding chosen)
+{
+    auto &headers = metadata.headers();
+    headers.clear();
+    for (const auto &header: message.headers()) {
+        headers.emplace(std::string(header.first.data(), header.first.size()),
+                        std::string(header.second.data(),
+                                    header.second.size()));
+    }
+
+    headers.emplace("vary", "accept-encoding");
+
+    if (chosen == coding::identity)
+        return;
+
+    headers.emplace("content-encoding",
+                    (chosen == coding::gzip) ? "gzip" : "deflate");
+
+    // The compressed representation isn't byte-for-byte the same
+    auto etag = headers.find("etag");
+    if (etag != headers.end() && !etag->second.empty()
+        && etag->second.front() == '"') {
+        etag->second.insert(0, "W/");
+    }
+}
+
+template<class Socket>
+void basic_compressing_socket<Socket>::acquire_deflater()
+{
+    deflater = asio::use_service<detail::deflater_pool>(get_io_service())
+        .acquire(options_.level);
+    deflater->reset((accepted == coding::gzip) ? detail::deflater::gzip
+                    : detail::deflater::zlib);
+}
+
+template<class Socket>
+void basic_compressing_socket<Socket>::release_deflater()
+{
+    if (!deflater)
+        return;
+
+    asio::use_service<detail::deflater_pool>(get_io_service())
+        .release(std::move(deflater));
+}
+
+} // namespace http
+} // namespace boost
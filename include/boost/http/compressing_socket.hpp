@@ -0,0 +1,238 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_COMPRESSING_SOCKET_HPP
+#define BOOST_HTTP_COMPRESSING_SOCKET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <boost/utility/string_ref.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/asio/async_result.hpp>
+
+#include <boost/http/traits.hpp>
+#include <boost/http/read_state.hpp>
+#include <boost/http/write_state.hpp>
+#include <boost/http/message.hpp>
+#include <boost/http/buffered_socket.hpp>
+#include <boost/http/detail/deflater.hpp>
+#include <boost/http/detail/accept_encoding.hpp>
+#include <boost/http/detail/is_basic_socket.hpp>
+
+namespace boost {
+namespace http {
+
+/* Textual media types, plus the JSON, XML and JavaScript ones. Images, video
+   and archives are usually compressed already. */
+inline bool is_compressible_content_type(string_ref content_type)
+{
+    content_type = content_type.substr(0, content_type.find(';'));
+    while (content_type.size()
+           && (content_type.back() == ' ' || content_type.back() == '\t')) {
+        content_type.remove_suffix(1);
+    }
+
+    return istarts_with(content_type, "text/")
+        || iends_with(content_type, "+json") || iends_with(content_type, "+xml")
+        || iequals(content_type, "application/json")
+        || iequals(content_type, "application/javascript")
+        || iequals(content_type, "application/xml");
+}
+
+struct compression_options
+{
+    // zlib compression level (-1 is zlib's default)
+    int level = -1;
+
+    // Responses announcing a smaller "content-length" are sent as is
+    std::size_t min_size = 1024;
+
+    // Responses whose "content-type" is rejected are sent as is
+    std::function<bool(string_ref)> content_type_filter
+        = is_compressible_content_type;
+};
+
+/* ServerSocket layer applying the "gzip" (or "deflate") content-coding to the
+   responses whose request accepts it. Streamed bodies are compressed chunk by
+   chunk with the deflate state being flushed after each async_write, so the
+   peer can decode everything it has received. */
+template<class Socket>
+class basic_compressing_socket
+{
+public:
+    static_assert(is_server_socket<Socket>::value,
+                  "Socket must fulfill the ServerSocket concept");
+
+    typedef Socket next_layer_type;
+
+    // ### QUERY FUNCTIONS ###
+
+    bool is_open() const;
+    http::read_state read_state() const;
+    http::write_state write_state() const;
+    bool write_response_native_stream() const;
+
+    asio::io_service &get_io_service();
+
+    // ### END OF QUERY FUNCTIONS ###
+
+    // ### READ FUNCTIONS ###
+
+    template<class String, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_read_request(String &method, String &path, Message &message,
+                       CompletionToken &&token);
+
+    template<class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_read_some(Message &message, CompletionToken &&token);
+
+    template<class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_read_trailers(Message &message, CompletionToken &&token);
+
+    // ### END OF READ FUNCTIONS ###
+
+    // ### WRITE FUNCTIONS ###
+
+    template<class StringRef, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_response(std::uint_fast16_t status_code,
+                         const StringRef &reason_phrase, const Message &message,
+                         CompletionToken &&token);
+
+    template<class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_response_continue(CompletionToken &&token);
+
+    template<class StringRef, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_response_metadata(std::uint_fast16_t status_code,
+                                  const StringRef &reason_phrase,
+                                  const Message &message,
+                                  CompletionToken &&token);
+
+    template<class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write(const Message &message, CompletionToken &&token);
+
+    template<class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_trailers(const Message &message, CompletionToken &&token);
+
+    template<class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_end_of_message(CompletionToken &&token);
+
+    // ### END OF WRITE FUNCTIONS ###
+
+    // ### START OF basic_compressing_socket SPECIFIC FUNCTIONS ###
+
+    template<class... Args>
+    basic_compressing_socket(Args&&... args);
+
+    next_layer_type &next_layer();
+
+    const next_layer_type &next_layer() const;
+
+    const compression_options &options() const;
+
+    void set_options(compression_options options);
+
+private:
+    enum class coding
+    {
+        identity,
+        gzip,
+        deflate
+    };
+
+    /* Whether a response with these properties is worth compressing, whatever
+       the request accepts */
+    template<class Message>
+    bool compressible(std::uint_fast16_t status_code,
+                      const Message &message) const;
+
+    /* Copies the headers of message to metadata, adding "vary" and, unless
+       chosen is the identity, the content-coding. */
+    template<class Message>
+    void prepare_metadata(const Message &message, coding chosen);
+
+    /* Writes message with the headers from metadata. The body of message is
+       handed to the next layer as is when it takes a separate body buffer. */
+    template<class StringRef, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    write_response_headers(std::uint_fast16_t status_code,
+                           const StringRef &reason_phrase,
+                           const Message &message, CompletionToken &&token,
+                           std::true_type);
+
+    template<class StringRef, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    write_response_headers(std::uint_fast16_t status_code,
+                           const StringRef &reason_phrase,
+                           const Message &message, CompletionToken &&token,
+                           std::false_type);
+
+    // Starts a new compressed body with a deflater from the pool
+    void acquire_deflater();
+
+    void release_deflater();
+
+    Socket channel;
+    compression_options options_;
+
+    // Chosen by the last request read
+    coding accepted = coding::identity;
+    bool head_request = false;
+
+    // Non-null while a streamed response is being compressed
+    std::unique_ptr<detail::deflater> deflater;
+
+    /* The headers and the compressed body handed to the next layer. Kept
+       across responses, so the buffers are reused. */
+    message metadata;
+};
+
+typedef basic_compressing_socket<buffered_socket> compressing_socket;
+
+template<class Socket>
+struct is_server_socket<basic_compressing_socket<Socket>>
+    : public std::true_type
+{};
+
+} // namespace http
+} // namespace boost
+
+#include "compressing_socket-inl.hpp"
+
+#endif // BOOST_HTTP_COMPRESSING_SOCKET_HPP
@@ -0,0 +1,64 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DATE_CACHE_HPP
+#define BOOST_HTTP_DATE_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+
+#include <boost/asio/io_service.hpp>
+
+#include <boost/http/detail/config.hpp>
+#include <boost/http/detail/http_date.hpp>
+
+namespace boost {
+namespace http {
+
+/* io_service service holding the current date formatted as an HTTP-date. The
+   text is reformatted at most once per second, no matter how many responses
+   need it. Thread-safe, and readers never take a lock. */
+class BOOST_HTTP_DECL date_cache: public asio::io_service::service
+{
+public:
+    static asio::io_service::id id;
+
+    // Size of the formatted date (e.g. "Sun, 06 Nov 1994 08:49:37 GMT")
+    static const std::size_t size = detail::http_date_size;
+
+    explicit date_cache(asio::io_service &io_service);
+
+    /* Copies the current date into out (size bytes, no terminator) and returns
+       the second it represents */
+    std::time_t now(char *out);
+
+private:
+    void shutdown_service() override;
+
+    static const std::size_t words = (size + 7) / 8;
+
+    /* The text of a second is published in slots[second % 2], so the previous
+       second stays readable while the next one is written. Readers check
+       second before and after copying the words (like a seqlock) and format
+       the date themselves if the slot doesn't match. */
+    struct slot
+    {
+        // -1 while the words are written
+        std::atomic<std::time_t> second;
+        std::atomic<std::uint64_t> text[words];
+    };
+
+    slot slots[2];
+
+    // Taken (with try_lock) by the thread that publishes a new second
+    std::mutex mutex;
+};
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DATE_CACHE_HPP
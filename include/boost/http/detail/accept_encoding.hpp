@@ -0,0 +1,126 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_ACCEPT_ENCODING_HPP
+#define BOOST_HTTP_DETAIL_ACCEPT_ENCODING_HPP
+
+#include <boost/utility/string_ref.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <boost/http/algorithm/header.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+/* Quality values, in thousandths, that "accept-encoding" assigns to the codings
+   known by the library. -1 means the coding isn't mentioned. */
+struct accept_encoding_qvalues
+{
+    int br = -1;
+    int gzip = -1;
+    int deflate = -1;
+    int any = -1;
+
+    /* Effective quality value of a coding whose own quality value is qvalue
+       (the "*" element applies to the codings not mentioned) */
+    static int of(int qvalue, int any)
+    {
+        if (qvalue != -1)
+            return qvalue;
+
+        return (any != -1) ? any : 0;
+    }
+};
+
+/* Parses the weight of an "accept-encoding" element (e.g. ";q=0.5", the part
+   after the coding). Returns -1 if the weight is malformed. */
+template<class StringRef>
+int parse_qvalue(StringRef params)
+{
+    auto isspace = [](char c) { return c == ' ' || c == '\t'; };
+
+    while (params.size() && isspace(params.front()))
+        params.remove_prefix(1);
+    while (params.size() && isspace(params.back()))
+        params.remove_suffix(1);
+
+    if (params.empty())
+        return 1000;
+
+    if (params.front() != ';')
+        return -1;
+    params.remove_prefix(1);
+    while (params.size() && isspace(params.front()))
+        params.remove_prefix(1);
+
+    if (params.size() < 3 || (params[0] != 'q' && params[0] != 'Q')
+        || params[1] != '=') {
+        return -1;
+    }
+    params.remove_prefix(2);
+
+    // qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+    if (params[0] != '0' && params[0] != '1')
+        return -1;
+
+    int ret = (params[0] - '0') * 1000;
+    if (params.size() == 1)
+        return ret;
+
+    if (params[1] != '.' || params.size() > 5)
+        return -1;
+
+    int scale = 100;
+    for (std::size_t i = 2 ; i != params.size() ; ++i, scale /= 10) {
+        if (params[i] < '0' || params[i] > '9')
+            return -1;
+        ret += (params[i] - '0') * scale;
+    }
+
+    return (ret > 1000) ? -1 : ret;
+}
+
+template<class Headers>
+accept_encoding_qvalues accept_encoding(const Headers &headers)
+{
+    typedef basic_string_ref<typename Headers::mapped_type::value_type>
+        string_ref_type;
+
+    accept_encoding_qvalues ret;
+
+    auto range = headers.equal_range("accept-encoding");
+    for (; range.first != range.second ; ++range.first) {
+        header_value_for_each((*range.first).second,
+                              [&ret](const string_ref_type &v) {
+            auto coding = v.substr(0, v.find(';'));
+            while (coding.size()
+                   && (coding.back() == ' ' || coding.back() == '\t')) {
+                coding.remove_suffix(1);
+            }
+
+            auto qvalue = parse_qvalue(v.substr(coding.size()));
+            if (qvalue == -1)
+                return;
+
+            if (iequals(coding, "br"))
+                ret.br = qvalue;
+            else if (iequals(coding, "gzip") || iequals(coding, "x-gzip"))
+                ret.gzip = qvalue;
+            else if (iequals(coding, "deflate"))
+                ret.deflate = qvalue;
+            else if (coding == "*")
+                ret.any = qvalue;
+        });
+    }
+
+    return ret;
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_ACCEPT_ENCODING_HPP
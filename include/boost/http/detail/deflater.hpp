@@ -0,0 +1,103 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_DEFLATER_HPP
+#define BOOST_HTTP_DETAIL_DEFLATER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+#include <boost/http/detail/config.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+/* zlib deflate stream producing the "gzip" or the "deflate" content-coding. The
+   (expensive) zlib state is reused by all the bodies compressed with it. */
+class BOOST_HTTP_DECL deflater
+{
+public:
+    enum format_type
+    {
+        gzip,
+        // RFC 7230 "deflate" is the zlib format
+        zlib
+    };
+
+    explicit deflater(int level);
+    ~deflater();
+
+    deflater(const deflater &) = delete;
+    deflater &operator=(const deflater &) = delete;
+
+    int level() const;
+
+    // Starts a new body
+    void reset(format_type format);
+
+    /* Appends the compressed data to out. Unless finish is true, the output is
+       flushed so it can be decoded as soon as it's delivered. */
+    template<class Body>
+    void compress(const void *data, std::size_t size, bool finish, Body &out)
+    {
+        input(data, size);
+
+        bool more;
+        do {
+            auto offset = out.size();
+            auto capacity = bound(size);
+            out.resize(offset + capacity);
+            auto produced = output(&out[offset], capacity, finish, more);
+            out.resize(offset + produced);
+            size = 0;
+        } while (more);
+    }
+
+private:
+    // Worst-case output for size bytes of input plus the flush markers
+    std::size_t bound(std::size_t size);
+
+    void input(const void *data, std::size_t size);
+
+    /* Returns the number of bytes written into out. more is set if out was too
+       small for all the pending output. */
+    std::size_t output(void *out, std::size_t size, bool finish, bool &more);
+
+    struct impl;
+    std::unique_ptr<impl> pimpl;
+    int level_;
+    format_type format = gzip;
+};
+
+/* io_service service keeping the idle deflaters, so the connections only hold
+   one while they're compressing a body. Thread-safe. */
+class BOOST_HTTP_DECL deflater_pool: public asio::io_service::service
+{
+public:
+    static asio::io_service::id id;
+
+    explicit deflater_pool(asio::io_service &io_service);
+
+    std::unique_ptr<deflater> acquire(int level);
+
+    void release(std::unique_ptr<deflater> d);
+
+private:
+    void shutdown_service() override;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<deflater>> idle;
+};
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_DEFLATER_HPP
@@ -0,0 +1,41 @@
+/* Copyright (c) 2014 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_HAS_CONNECTION_CLOSE_HPP
+#define BOOST_HTTP_DETAIL_HAS_CONNECTION_CLOSE_HPP
+
+#include <boost/utility/string_ref.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <boost/http/algorithm/header.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+template <class Headers>
+bool has_connection_close(const Headers &headers)
+{
+    typedef basic_string_ref<typename Headers::mapped_type::value_type>
+        string_ref_type;
+
+    auto range = headers.equal_range("connection");
+    for (; range.first != range.second ; ++range.first) {
+        if (header_value_any_of((*range.first).second,
+                                [](const string_ref_type &v) {
+                                    return iequals(v, "close");
+                                })) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_HAS_CONNECTION_CLOSE_HPP
@@ -0,0 +1,87 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_HTTP_DATE_HPP
+#define BOOST_HTTP_DETAIL_HTTP_DATE_HPP
+
+#include <cstdint>
+#include <cstring>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+// Size of "Sun, 06 Nov 1994 08:49:37 GMT"
+static const std::size_t http_date_size = 29;
+
+inline void write_two_digits(char *out, unsigned value)
+{
+    static const char digits[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    std::memcpy(out, digits + 2 * value, 2);
+}
+
+/* Writes the IMF-fixdate for the given number of seconds since the Unix epoch
+   into out (http_date_size bytes, no terminator). Only the proleptic Gregorian
+   years from 0 to 9999 are supported.
+
+   The civil date is computed with Howard Hinnant's days_from_civil inverse,
+   then the whole formatting is just arithmetic and table lookups. */
+inline void format_http_date(std::int_least64_t seconds, char *out)
+{
+    static const char weekdays[] = "Sun, Mon, Tue, Wed, Thu, Fri, Sat, ";
+    static const char months[] = "Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov"
+        " Dec ";
+
+    std::int_least64_t days = seconds / 86400;
+    std::int_least64_t secs = seconds % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        --days;
+    }
+
+    // 1970-01-01 was a Thursday
+    int weekday = static_cast<int>((days % 7 + 11) % 7);
+
+    std::int_least64_t z = days + 719468;
+    std::int_least64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    unsigned year = static_cast<unsigned>(yoe + era * 400 + (month <= 2));
+
+    std::memcpy(out, weekdays + 5 * weekday, 5);
+    write_two_digits(out + 5, day);
+    out[7] = ' ';
+    std::memcpy(out + 8, months + 4 * (month - 1), 4);
+    write_two_digits(out + 12, year / 100 % 100);
+    write_two_digits(out + 14, year % 100);
+    out[16] = ' ';
+    write_two_digits(out + 17, static_cast<unsigned>(secs / 3600));
+    out[19] = ':';
+    write_two_digits(out + 20, static_cast<unsigned>(secs / 60 % 60));
+    out[22] = ':';
+    write_two_digits(out + 23, static_cast<unsigned>(secs % 60));
+    std::memcpy(out + 25, " GMT", 4);
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_HTTP_DATE_HPP
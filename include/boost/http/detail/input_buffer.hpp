@@ -0,0 +1,298 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_INPUT_BUFFER_HPP
+#define BOOST_HTTP_DETAIL_INPUT_BUFFER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/asio/buffer.hpp>
+
+#include <boost/http/input_buffer_policy.hpp>
+#include <boost/http/detail/config.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+/* Process-wide pool of slabs whose sizes are powers of two (see slab_size).
+   Thread-safe. */
+BOOST_HTTP_DECL void *acquire_slab(std::size_t size);
+BOOST_HTTP_DECL void release_slab(void *slab, std::size_t size);
+
+/* Rounds n up to the size class of the slab pool. Sizes above the largest
+   power of two are clamped to it. */
+inline std::size_t slab_size(std::size_t n)
+{
+    const std::size_t largest = ~(std::size_t(-1) >> 1);
+    if (n >= largest)
+        return largest;
+
+    std::size_t size = 64;
+    while (size < n)
+        size *= 2;
+    return size;
+}
+
+/* Staging area for the bytes received from the underlying stream that the
+   parser didn't consume yet.
+
+   The unparsed bytes live in [begin, end) and new bytes are appended at end,
+   then consuming bytes is just a cursor update. Unparsed bytes are only moved
+   back to the front of the storage when there is no room left at the tail (and
+   there is room at the head), so a connection receiving pipelined messages
+   doesn't pay a memmove per parse step.
+
+   A position can be pinned to keep the bytes from there onwards around even
+   after they're consumed (e.g. a header section referenced by string_refs). A
+   compaction still moves pinned bytes, but offsets relative to pinned_data()
+   stay valid.
+
+   The storage is either provided by the user (and never changes) or taken from
+   the slab pool according to an input_buffer_policy. A pooled storage is
+   acquired lazily, doubled (up to max_size) when there is no room left even
+   after compaction and can be returned back to the pool with shrink() (and
+   with release() while no byte is buffered). */
+class input_buffer
+{
+public:
+    explicit input_buffer(asio::mutable_buffer storage);
+    explicit input_buffer(input_buffer_policy policy);
+
+    input_buffer(const input_buffer &) = delete;
+    input_buffer(input_buffer &&o);
+
+    ~input_buffer();
+
+    // Number of unparsed bytes
+    std::size_t size() const;
+
+    std::size_t capacity() const;
+
+    /* True if there is no room to receive more bytes, even after compaction
+       and growth */
+    bool full() const;
+
+    // The unparsed bytes. Invalidated by prepare()
+    std::uint8_t *data() const;
+
+    /* Returns the free region where the next read should land. Compacts the
+       unparsed bytes if the tail is exhausted and grows the storage if that is
+       not enough. */
+    asio::mutable_buffers_1 prepare();
+
+    void commit(std::size_t n);
+    void consume(std::size_t n);
+    void clear();
+
+    /* Gives a grown storage back to the pool if there are no bytes to
+       preserve. The next prepare() starts over from the initial size. */
+    void shrink();
+
+    /* Gives any pooled storage back to the pool if there are no bytes to
+       preserve. The next prepare() acquires the initial size again. */
+    void release_idle();
+
+    // p must point into the unparsed bytes or into already pinned bytes
+    void pin(const void *p);
+    void unpin();
+    bool pinned() const;
+    std::uint8_t *pinned_data() const;
+
+private:
+    static const std::size_t npos = std::size_t(-1);
+
+    std::uint8_t *storage() const;
+
+    // Start of the bytes that must be preserved
+    std::size_t retained() const;
+
+    bool pooled() const;
+    void grow();
+    void release();
+
+    asio::mutable_buffer storage_;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    std::size_t pin_ = npos;
+
+    // Zero for user provided storage
+    std::size_t initial_size = 0;
+    std::size_t max_size;
+};
+
+inline input_buffer::input_buffer(asio::mutable_buffer storage)
+    : storage_(storage)
+    , max_size(asio::buffer_size(storage))
+{}
+
+inline input_buffer::input_buffer(input_buffer_policy policy)
+    : initial_size(slab_size(policy.initial_size))
+    , max_size(std::max(initial_size, slab_size(policy.max_size)))
+{}
+
+inline input_buffer::input_buffer(input_buffer &&o)
+    : storage_(o.storage_)
+    , begin(o.begin)
+    , end(o.end)
+    , pin_(o.pin_)
+    , initial_size(o.initial_size)
+    , max_size(o.max_size)
+{
+    if (o.pooled())
+        o.storage_ = asio::mutable_buffer();
+}
+
+inline input_buffer::~input_buffer()
+{
+    release();
+}
+
+inline std::size_t input_buffer::size() const
+{
+    return end - begin;
+}
+
+inline std::size_t input_buffer::capacity() const
+{
+    return asio::buffer_size(storage_);
+}
+
+inline bool input_buffer::full() const
+{
+    return end - retained() == capacity() && capacity() >= max_size;
+}
+
+inline std::uint8_t *input_buffer::data() const
+{
+    return storage() + begin;
+}
+
+inline asio::mutable_buffers_1 input_buffer::prepare()
+{
+    if (capacity() == 0) {
+        storage_ = asio::buffer(acquire_slab(initial_size), initial_size);
+        return asio::buffer(storage_);
+    }
+
+    auto first = retained();
+    if (end == capacity() && first != 0) {
+        std::memmove(storage(), storage() + first, end - first);
+        end -= first;
+        begin -= first;
+        if (pin_ != npos)
+            pin_ = 0;
+    }
+
+    if (end == capacity() && capacity() < max_size)
+        grow();
+
+    return asio::buffer(storage_ + end);
+}
+
+inline void input_buffer::commit(std::size_t n)
+{
+    end += n;
+}
+
+inline void input_buffer::consume(std::size_t n)
+{
+    begin += n;
+
+    // Rewinding an empty buffer is free and delays the next compaction
+    if (begin == end && pin_ == npos)
+        begin = end = 0;
+}
+
+inline void input_buffer::clear()
+{
+    begin = end = 0;
+    pin_ = npos;
+}
+
+inline void input_buffer::shrink()
+{
+    if (!pooled() || capacity() <= initial_size || size() || pinned())
+        return;
+
+    release();
+    begin = end = 0;
+}
+
+inline void input_buffer::release_idle()
+{
+    if (!pooled() || size() || pinned())
+        return;
+
+    release();
+    begin = end = 0;
+}
+
+inline void input_buffer::pin(const void *p)
+{
+    pin_ = reinterpret_cast<const std::uint8_t*>(p) - storage();
+}
+
+inline void input_buffer::unpin()
+{
+    pin_ = npos;
+}
+
+inline bool input_buffer::pinned() const
+{
+    return pin_ != npos;
+}
+
+inline std::uint8_t *input_buffer::pinned_data() const
+{
+    return storage() + pin_;
+}
+
+inline std::uint8_t *input_buffer::storage() const
+{
+    return asio::buffer_cast<std::uint8_t*>(storage_);
+}
+
+inline std::size_t input_buffer::retained() const
+{
+    return pin_ == npos ? begin : pin_;
+}
+
+inline bool input_buffer::pooled() const
+{
+    return initial_size != 0;
+}
+
+inline void input_buffer::grow()
+{
+    auto size = std::min(capacity() * 2, max_size);
+    auto slab = reinterpret_cast<std::uint8_t*>(acquire_slab(size));
+    auto first = retained();
+
+    std::memcpy(slab, storage() + first, end - first);
+    release();
+    storage_ = asio::buffer(slab, size);
+    end -= first;
+    begin -= first;
+    if (pin_ != npos)
+        pin_ = 0;
+}
+
+inline void input_buffer::release()
+{
+    if (!pooled() || capacity() == 0)
+        return;
+
+    release_slab(storage(), capacity());
+    storage_ = asio::mutable_buffer();
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_INPUT_BUFFER_HPP
@@ -0,0 +1,38 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_IS_BASIC_SOCKET_HPP
+#define BOOST_HTTP_DETAIL_IS_BASIC_SOCKET_HPP
+
+#include <type_traits>
+
+namespace boost {
+namespace http {
+
+template<class Socket>
+class basic_socket;
+
+namespace detail {
+
+/* Whether ServerSocket offers the async_write_response overload taking the
+   body as a separate buffer. Also true for basic_buffered_socket, which
+   privately inherits basic_socket. */
+template<class ServerSocket, class = void>
+struct is_basic_socket: public std::false_type {};
+
+template<class ServerSocket>
+struct is_basic_socket<
+    ServerSocket,
+    typename std::enable_if<std::is_base_of<
+        basic_socket<typename ServerSocket::next_layer_type>,
+        ServerSocket>::value>::type>
+    : public std::true_type
+{};
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_IS_BASIC_SOCKET_HPP
@@ -0,0 +1,104 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_NATIVE_FILE_HPP
+#define BOOST_HTTP_DETAIL_NATIVE_FILE_HPP
+
+#include <cstdint>
+
+#include <boost/system/api_config.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <boost/http/detail/config.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+/* Read-only file handle supporting positional reads. It's also the source of
+   sendfile(2), which is only available on Linux. */
+class BOOST_HTTP_DECL native_file
+{
+public:
+    // Check is_open() for errors
+    explicit native_file(const filesystem::path &file);
+    native_file(native_file &&o);
+    native_file(const native_file &) = delete;
+    native_file &operator=(const native_file &) = delete;
+    ~native_file();
+
+    bool is_open() const;
+
+#ifndef BOOST_WINDOWS_API
+    int native_handle() const
+    {
+        return fd;
+    }
+#endif
+
+    /* Reads up to size bytes of the file, starting at offset, into data and
+       returns the number of bytes read (0 at the end of the file).
+
+       It doesn't change the file offset, so the same object can be used by
+       concurrent reads and transfers. */
+    std::size_t read_at(std::uintmax_t offset, void *data, std::size_t size,
+                        system::error_code &ec) const;
+
+    /* Copies up to count bytes of the file, starting at offset, into the
+       socket out. offset is advanced by the number of bytes copied, which is
+       returned. If out is a non-blocking socket whose send buffer is full, ec
+       is set to asio::error::would_block. */
+    std::size_t sendfile(int out, std::uintmax_t &offset, std::uintmax_t count,
+                         system::error_code &ec) const;
+
+private:
+#ifdef BOOST_WINDOWS_API
+    void *handle;
+#else
+    int fd;
+#endif
+};
+
+/* Write-only file handle supporting positional writes. It's also the target of
+   splice(2), which is only available on Linux. */
+class BOOST_HTTP_DECL native_output_file
+{
+public:
+    // Creates the file (or truncates it)
+    native_output_file(const filesystem::path &file, system::error_code &ec);
+    native_output_file(native_output_file &&o);
+    native_output_file(const native_output_file &) = delete;
+    native_output_file &operator=(const native_output_file &) = delete;
+    ~native_output_file();
+
+    // Writes the size bytes of data at offset
+    void write_at(std::uintmax_t offset, const void *data, std::size_t size,
+                  system::error_code &ec) const;
+
+    /* Moves up to count bytes from the socket in into the file, starting at
+       offset, through a pipe owned by this object. offset is advanced by the
+       number of bytes moved, which is returned (0 if the peer closed the
+       connection). If in is a non-blocking socket with no data available, ec
+       is set to asio::error::would_block. */
+    std::size_t splice(int in, std::uintmax_t &offset, std::uintmax_t count,
+                       system::error_code &ec);
+
+private:
+#ifdef BOOST_WINDOWS_API
+    void *handle;
+#else
+    int fd;
+
+    // Created by the first splice
+    int pipe_fds[2];
+#endif
+};
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_NATIVE_FILE_HPP
@@ -0,0 +1,183 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_OUTPUT_BUFFERS_HPP
+#define BOOST_HTTP_DETAIL_OUTPUT_BUFFERS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/asio/buffer.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+// Lightweight ConstBufferSequence over a contiguous array of buffers
+struct const_buffer_range
+{
+    typedef asio::const_buffer value_type;
+    typedef const asio::const_buffer *const_iterator;
+
+    const_iterator begin() const
+    {
+        return first;
+    }
+
+    const_iterator end() const
+    {
+        return last;
+    }
+
+    const_iterator first;
+    const_iterator last;
+};
+
+/* Reusable scatter/gather list used to serialize the outgoing messages of a
+   socket without touching the heap.
+
+   Up to inline_capacity pieces are stored inline, which covers the status line
+   and a handful of headers (each header takes four pieces) while keeping idle
+   sockets small. Larger lists spill into a vector whose capacity is kept for
+   the next messages. Numbers (status codes, content-length, chunk
+   sizes) and dates are formatted into a small inline scratch area.
+
+   The sequence refers to this storage, so it MUST NOT be reused while a write
+   still reads it. Such a write is bracketed by begin_write() and end_write(),
+   and the storage can't be refilled in between. */
+class output_buffers
+{
+public:
+    static const std::size_t inline_capacity = 24;
+
+    output_buffers() = default;
+    output_buffers(const output_buffers &) = delete;
+    output_buffers &operator=(const output_buffers &) = delete;
+
+    output_buffers(output_buffers &&o)
+        : overflow(std::move(o.overflow))
+    {
+        BOOST_ASSERT(!o.writing);
+    }
+
+    void clear()
+    {
+        BOOST_ASSERT(!writing);
+        size_ = 0;
+        scratch_size = 0;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    void push_back(const asio::const_buffer &piece)
+    {
+        BOOST_ASSERT(!writing);
+        if (overflow.empty()) {
+            if (size_ != inline_capacity) {
+                pieces[size_++] = piece;
+                return;
+            }
+
+            overflow.assign(pieces, pieces + size_);
+        }
+
+        if (size_ == overflow.size())
+            overflow.push_back(piece);
+        else
+            overflow[size_] = piece;
+        ++size_;
+    }
+
+    // Appends a copy of [first, first + size) (see scratch_capacity)
+    void push_copy(const char *first, std::size_t size)
+    {
+        BOOST_ASSERT(scratch_size + size <= scratch_capacity);
+        char *dest = scratch + scratch_size;
+        std::memcpy(dest, first, size);
+        scratch_size += size;
+        push_back(asio::const_buffer(dest, size));
+    }
+
+    void push_decimal(std::uintmax_t n)
+    {
+        char digits[max_digits];
+        char *first = digits + max_digits;
+        do {
+            *--first = '0' + n % 10;
+            n /= 10;
+        } while (n);
+        push_copy(first, digits + max_digits - first);
+    }
+
+    void push_hex(std::uintmax_t n)
+    {
+        char digits[max_digits];
+        char *first = digits + max_digits;
+        do {
+            *--first = "0123456789abcdef"[n % 16];
+            n /= 16;
+        } while (n);
+        push_copy(first, digits + max_digits - first);
+    }
+
+    // Valid until the next call to a non-const member function
+    const_buffer_range sequence() const
+    {
+        const asio::const_buffer *first = data();
+        return const_buffer_range{first, first + size_};
+    }
+
+    // Marks the sequence as read by a write in progress
+    void begin_write()
+    {
+        writing = true;
+    }
+
+    // The write started by begin_write() is complete
+    void end_write()
+    {
+        writing = false;
+    }
+
+    // True if piece refers to bytes copied by push_copy
+    bool owns(const asio::const_buffer &piece) const
+    {
+        auto first = asio::buffer_cast<const char*>(piece);
+        return first >= scratch && first < scratch + scratch_size;
+    }
+
+private:
+    // Enough for a 64-bit number in any base used here
+    static const std::size_t max_digits = 20;
+
+    /* A message copies at most two numbers (status code and body size) and a
+       date header line */
+    static const std::size_t scratch_capacity = 2 * max_digits + 64;
+
+    const asio::const_buffer *data() const
+    {
+        return overflow.empty() ? pieces : overflow.data();
+    }
+
+    asio::const_buffer pieces[inline_capacity];
+    std::vector<asio::const_buffer> overflow;
+    std::size_t size_ = 0;
+
+    char scratch[scratch_capacity];
+    std::size_t scratch_size = 0;
+
+    bool writing = false;
+};
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_OUTPUT_BUFFERS_HPP
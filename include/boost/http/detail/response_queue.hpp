@@ -0,0 +1,118 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_RESPONSE_QUEUE_HPP
+#define BOOST_HTTP_DETAIL_RESPONSE_QUEUE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <boost/http/detail/output_buffers.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+/* Serialized messages waiting to go out in a single gathered write, together
+   with the handlers to be called once the write is done.
+
+   The pieces keep referring to the memory of the caller (e.g. the message or a
+   prepared_response kept alive by the handler). Only the bytes that the
+   output_buffers formatted into its own scratch area are copied. */
+class response_queue
+{
+public:
+    typedef std::function<void(const system::error_code&)> handler_type;
+
+    bool empty() const
+    {
+        return handlers.empty();
+    }
+
+    // Number of queued bytes
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    template<class Handler>
+    void push(const output_buffers &output, Handler &&handler)
+    {
+        for (const auto &buf: output.sequence()) {
+            auto data = asio::buffer_cast<const char*>(buf);
+            auto n = asio::buffer_size(buf);
+
+            if (output.owns(buf)) {
+                pieces.push_back(piece{nullptr, copies.size(), n});
+                copies.insert(copies.end(), data, data + n);
+            } else {
+                pieces.push_back(piece{data, 0, n});
+            }
+
+            size_ += n;
+        }
+
+        handlers.emplace_back(std::forward<Handler>(handler));
+    }
+
+    /* The queued bytes. Valid until the next call to a non-const member
+       function. */
+    const_buffer_range sequence()
+    {
+        buffers.clear();
+        for (const auto &p: pieces) {
+            buffers.emplace_back(p.data ? p.data : copies.data() + p.offset,
+                                 p.size);
+        }
+
+        return const_buffer_range{buffers.data(),
+                                  buffers.data() + buffers.size()};
+    }
+
+    /* Moves the queued handlers into out and empties the queue (the storage is
+       kept for the next messages) */
+    void release(std::vector<handler_type> &out)
+    {
+        out.swap(handlers);
+        handlers.clear();
+        pieces.clear();
+        copies.clear();
+        size_ = 0;
+    }
+
+    void swap(response_queue &o)
+    {
+        pieces.swap(o.pieces);
+        copies.swap(o.copies);
+        handlers.swap(o.handlers);
+        std::swap(size_, o.size_);
+    }
+
+private:
+    // data is null for the pieces that were copied into copies
+    struct piece
+    {
+        const char *data;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::vector<piece> pieces;
+    std::vector<char> copies;
+    std::vector<handler_type> handlers;
+    std::vector<asio::const_buffer> buffers;
+    std::size_t size_ = 0;
+};
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_RESPONSE_QUEUE_HPP
@@ -0,0 +1,170 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_DETAIL_STATUS_LINE_HPP
+#define BOOST_HTTP_DETAIL_STATUS_LINE_HPP
+
+#include <cstdint>
+
+#include <boost/asio/buffer.hpp>
+
+#include <boost/http/detail/constchar_helper.hpp>
+#include <boost/http/detail/output_buffers.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+/* Returns the precomputed "HTTP/1.1 NNN " prefix for the codes listed in
+   status_code.hpp or an empty buffer for any other code. The "NNN " part starts
+   at offset 9. */
+inline asio::const_buffer status_line_prefix(std::uint_fast16_t status_code)
+{
+    switch (status_code) {
+    case 100:
+        return string_literal_buffer("HTTP/1.1 100 ");
+    case 101:
+        return string_literal_buffer("HTTP/1.1 101 ");
+    case 102:
+        return string_literal_buffer("HTTP/1.1 102 ");
+    case 200:
+        return string_literal_buffer("HTTP/1.1 200 ");
+    case 201:
+        return string_literal_buffer("HTTP/1.1 201 ");
+    case 202:
+        return string_literal_buffer("HTTP/1.1 202 ");
+    case 203:
+        return string_literal_buffer("HTTP/1.1 203 ");
+    case 204:
+        return string_literal_buffer("HTTP/1.1 204 ");
+    case 205:
+        return string_literal_buffer("HTTP/1.1 205 ");
+    case 206:
+        return string_literal_buffer("HTTP/1.1 206 ");
+    case 207:
+        return string_literal_buffer("HTTP/1.1 207 ");
+    case 208:
+        return string_literal_buffer("HTTP/1.1 208 ");
+    case 226:
+        return string_literal_buffer("HTTP/1.1 226 ");
+    case 300:
+        return string_literal_buffer("HTTP/1.1 300 ");
+    case 301:
+        return string_literal_buffer("HTTP/1.1 301 ");
+    case 302:
+        return string_literal_buffer("HTTP/1.1 302 ");
+    case 303:
+        return string_literal_buffer("HTTP/1.1 303 ");
+    case 304:
+        return string_literal_buffer("HTTP/1.1 304 ");
+    case 305:
+        return string_literal_buffer("HTTP/1.1 305 ");
+    case 306:
+        return string_literal_buffer("HTTP/1.1 306 ");
+    case 307:
+        return string_literal_buffer("HTTP/1.1 307 ");
+    case 308:
+        return string_literal_buffer("HTTP/1.1 308 ");
+    case 400:
+        return string_literal_buffer("HTTP/1.1 400 ");
+    case 401:
+        return string_literal_buffer("HTTP/1.1 401 ");
+    case 402:
+        return string_literal_buffer("HTTP/1.1 402 ");
+    case 403:
+        return string_literal_buffer("HTTP/1.1 403 ");
+    case 404:
+        return string_literal_buffer("HTTP/1.1 404 ");
+    case 405:
+        return string_literal_buffer("HTTP/1.1 405 ");
+    case 406:
+        return string_literal_buffer("HTTP/1.1 406 ");
+    case 407:
+        return string_literal_buffer("HTTP/1.1 407 ");
+    case 408:
+        return string_literal_buffer("HTTP/1.1 408 ");
+    case 409:
+        return string_literal_buffer("HTTP/1.1 409 ");
+    case 410:
+        return string_literal_buffer("HTTP/1.1 410 ");
+    case 411:
+        return string_literal_buffer("HTTP/1.1 411 ");
+    case 412:
+        return string_literal_buffer("HTTP/1.1 412 ");
+    case 413:
+        return string_literal_buffer("HTTP/1.1 413 ");
+    case 414:
+        return string_literal_buffer("HTTP/1.1 414 ");
+    case 415:
+        return string_literal_buffer("HTTP/1.1 415 ");
+    case 416:
+        return string_literal_buffer("HTTP/1.1 416 ");
+    case 417:
+        return string_literal_buffer("HTTP/1.1 417 ");
+    case 422:
+        return string_literal_buffer("HTTP/1.1 422 ");
+    case 423:
+        return string_literal_buffer("HTTP/1.1 423 ");
+    case 424:
+        return string_literal_buffer("HTTP/1.1 424 ");
+    case 426:
+        return string_literal_buffer("HTTP/1.1 426 ");
+    case 428:
+        return string_literal_buffer("HTTP/1.1 428 ");
+    case 429:
+        return string_literal_buffer("HTTP/1.1 429 ");
+    case 431:
+        return string_literal_buffer("HTTP/1.1 431 ");
+    case 500:
+        return string_literal_buffer("HTTP/1.1 500 ");
+    case 501:
+        return string_literal_buffer("HTTP/1.1 501 ");
+    case 502:
+        return string_literal_buffer("HTTP/1.1 502 ");
+    case 503:
+        return string_literal_buffer("HTTP/1.1 503 ");
+    case 504:
+        return string_literal_buffer("HTTP/1.1 504 ");
+    case 505:
+        return string_literal_buffer("HTTP/1.1 505 ");
+    case 506:
+        return string_literal_buffer("HTTP/1.1 506 ");
+    case 507:
+        return string_literal_buffer("HTTP/1.1 507 ");
+    case 508:
+        return string_literal_buffer("HTTP/1.1 508 ");
+    case 510:
+        return string_literal_buffer("HTTP/1.1 510 ");
+    case 511:
+        return string_literal_buffer("HTTP/1.1 511 ");
+    default:
+        return asio::const_buffer();
+    }
+}
+
+// Appends "HTTP/1.x NNN " to output
+inline void push_status_line_prefix(output_buffers &output, bool http_1_1,
+                                    std::uint_fast16_t status_code)
+{
+    asio::const_buffer prefix = status_line_prefix(status_code);
+
+    if (asio::buffer_size(prefix) == 0) {
+        output.push_back(http_1_1 ? string_literal_buffer("HTTP/1.1 ")
+                         : string_literal_buffer("HTTP/1.0 "));
+        output.push_decimal(status_code);
+        output.push_back(string_literal_buffer(" "));
+    } else if (http_1_1) {
+        output.push_back(prefix);
+    } else {
+        output.push_back(string_literal_buffer("HTTP/1.0 "));
+        output.push_back(prefix + 9);
+    }
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_DETAIL_STATUS_LINE_HPP
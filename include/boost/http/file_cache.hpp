@@ -0,0 +1,100 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_FILE_CACHE_HPP
+#define BOOST_HTTP_FILE_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/http/detail/config.hpp>
+#include <boost/http/stat_cache.hpp>
+
+namespace boost {
+namespace http {
+
+/* Bounded in-memory cache of the contents of small files, keyed by canonical
+   path. An entry is only valid for the revision (entity-tag and size) of the
+   file it was read from. The least recently used entries are evicted
+   once the cached contents would exceed the size limit. Thread-safe. */
+class BOOST_HTTP_DECL file_cache
+{
+public:
+    struct entry
+    {
+        std::time_t last_write_time;
+        std::string etag;
+        std::vector<char> contents;
+
+        // "last-modified" value, formatted once
+        std::string last_modified;
+    };
+
+    struct statistics
+    {
+        std::uintmax_t hits;
+        std::uintmax_t misses;
+        std::uintmax_t evictions;
+    };
+
+    explicit file_cache(std::size_t max_size = 32 * 1024 * 1024,
+                        std::size_t max_file_size = 256 * 1024);
+
+    file_cache(const file_cache &) = delete;
+    file_cache &operator=(const file_cache &) = delete;
+
+    std::size_t max_size() const;
+    std::size_t max_file_size() const;
+
+    /* Returns the contents of file if they're cached for its current revision.
+       Outdated contents are dropped. */
+    std::shared_ptr<const entry> find(const stat_cache::entry &file);
+
+    /* Returns contents, read from file, as an entry. The entry is only kept if
+       it fits in the cache. */
+    std::shared_ptr<const entry> insert(const stat_cache::entry &file,
+                                        std::vector<char> contents);
+
+    // Forgets every entry
+    void clear();
+
+    statistics stats() const;
+
+private:
+    struct node
+    {
+        std::shared_ptr<const entry> value;
+        std::list<std::string>::iterator lru;
+    };
+
+    // Requires the mutex
+    void erase(std::unordered_map<std::string, node>::iterator it);
+
+    const std::size_t max_size_;
+    const std::size_t max_file_size_;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, node> entries;
+    // Most recently used first
+    std::list<std::string> lru;
+    // Bytes held by entries
+    std::size_t size = 0;
+
+    std::atomic<std::uintmax_t> hits{0};
+    std::atomic<std::uintmax_t> misses{0};
+    std::atomic<std::uintmax_t> evictions{0};
+};
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_FILE_CACHE_HPP
@@ -0,0 +1,166 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_FILE_READ_SERVICE_HPP
+#define BOOST_HTTP_FILE_READ_SERVICE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <boost/http/detail/config.hpp>
+#include <boost/http/detail/native_file.hpp>
+
+namespace boost {
+namespace http {
+
+/* Backend used by file_read_service to perform the reads. Implementations may
+   call the handler from any thread, but only once per read. */
+class BOOST_HTTP_DECL file_read_engine
+{
+public:
+    typedef std::function<void(const system::error_code&, std::size_t)>
+        handler_type;
+
+    virtual ~file_read_engine();
+
+    /* Reads asio::buffer_size(buffer) bytes of file, starting at offset. Fewer
+       bytes are only reported together with an error (asio::error::eof if the
+       file is shorter). file and the buffer stay alive until handler is
+       called. */
+    virtual void async_read_at(std::shared_ptr<const detail::native_file> file,
+                               std::uintmax_t offset,
+                               asio::mutable_buffer buffer,
+                               handler_type handler) = 0;
+};
+
+/* Performs the reads with blocking positional reads on a fixed set of worker
+   threads. Queued reads are finished before the destructor returns. */
+class BOOST_HTTP_DECL thread_pool_file_read_engine: public file_read_engine
+{
+public:
+    explicit thread_pool_file_read_engine(std::size_t threads = 4);
+    ~thread_pool_file_read_engine();
+
+    void async_read_at(std::shared_ptr<const detail::native_file> file,
+                       std::uintmax_t offset, asio::mutable_buffer buffer,
+                       handler_type handler) override;
+
+private:
+    struct operation
+    {
+        std::shared_ptr<const detail::native_file> file;
+        std::uintmax_t offset;
+        asio::mutable_buffer buffer;
+        handler_type handler;
+    };
+
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<operation> queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+namespace detail {
+
+#ifdef BOOST_HTTP_USE_IO_URING
+/* Only defined if the library is built with the USE_IO_URING CMake option.
+   Returns an empty pointer if the kernel lacks io_uring. */
+BOOST_HTTP_DECL std::shared_ptr<file_read_engine>
+make_io_uring_file_read_engine();
+#endif // BOOST_HTTP_USE_IO_URING
+
+} // namespace detail
+
+/* io_service service reading files without blocking the threads running the
+   io_service. The reads are delegated to a file_read_engine (a
+   thread_pool_file_read_engine by default) and the handlers are posted back to
+   the io_service. */
+class BOOST_HTTP_DECL file_read_service: public asio::io_service::service
+{
+public:
+    static asio::io_service::id id;
+
+    explicit file_read_service(asio::io_service &io_service);
+
+    /* Replaces the engine used by the next reads. Reads already started are
+       finished by the previous engine. */
+    void engine(std::shared_ptr<file_read_engine> engine);
+
+    std::shared_ptr<file_read_engine> engine();
+
+    /* Fills buffer with the bytes of file starting at offset. The handler
+       signature is void(system::error_code). */
+    template<class Handler>
+    void async_read_at(std::shared_ptr<const detail::native_file> file,
+                       std::uintmax_t offset, asio::mutable_buffer buffer,
+                       Handler &&handler);
+
+private:
+    void shutdown_service() override;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::shared_ptr<file_read_engine> engine_;
+    // reads whose handler wasn't posted yet
+    std::size_t pending = 0;
+};
+
+template<class Handler>
+void file_read_service::async_read_at(std::shared_ptr<const detail::native_file>
+                                      file,
+                                      std::uintmax_t offset,
+                                      asio::mutable_buffer buffer,
+                                      Handler &&handler)
+{
+    std::shared_ptr<file_read_engine> engine;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        engine = engine_;
+        ++pending;
+    }
+
+    typedef typename std::decay<Handler>::type handler_type;
+
+    auto op = std::make_shared<handler_type>(std::forward<Handler>(handler));
+    // Keeps io_service::run() from returning while the read is in progress
+    auto work = std::make_shared<asio::io_service::work>(get_io_service());
+
+    auto on_read = [this,op,work](const system::error_code &ec,
+                                  std::size_t) mutable {
+        get_io_service().post([op,work,ec]() {
+                (*op)(ec);
+            });
+
+        /* The io_service may be gone as soon as pending reaches zero, so
+           nothing referring to it may outlive this block */
+        op.reset();
+        work.reset();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            cv.notify_all();
+    };
+
+    engine->async_read_at(std::move(file), offset, buffer, std::move(on_read));
+}
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_FILE_READ_SERVICE_HPP
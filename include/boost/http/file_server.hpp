@@ -8,11 +8,16 @@
 
 // TODO (Boost 1.5X): replace by AFIO?
 #include <boost/filesystem/fstream.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <vector>
 #include <array>
 
 #include <boost/system/error_code.hpp>
 #include <boost/asio/async_result.hpp>
+#include <boost/asio/ip/tcp.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/utility/string_ref.hpp>
@@ -22,8 +27,15 @@
 
 #include <boost/http/detail/config.hpp>
 #include <boost/http/algorithm/header.hpp>
+#include <boost/http/date_cache.hpp>
+#include <boost/http/file_cache.hpp>
+#include <boost/http/file_read_service.hpp>
+#include <boost/http/stat_cache.hpp>
 #include <boost/http/write_state.hpp>
+#include <boost/http/detail/accept_encoding.hpp>
 #include <boost/http/detail/constchar_helper.hpp>
+#include <boost/http/detail/is_basic_socket.hpp>
+#include <boost/http/detail/native_file.hpp>
 #include <boost/http/traits.hpp>
 
 #ifndef BOOST_HTTP_FILE_SERVER_BOUNDARY
@@ -42,9 +54,30 @@
 #define BOOST_HTTP_FILE_SERVER_BOUNDARY "-"
 #endif // BOOST_HTTP_FILE_SERVER_BOUNDARY
 
+/* Files served through a basic_socket over a plain TCP socket are transmitted
+   with sendfile(2), so their contents never cross userspace. Define
+   BOOST_HTTP_FILE_SERVER_NO_SENDFILE to always read the files into the message
+   body instead. */
+#if defined(__linux__) && !defined(BOOST_HTTP_FILE_SERVER_NO_SENDFILE)
+#define BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
+#endif
+
+/* Bounds for the chunks of streamed files when the user didn't reserve the
+   body of the response message */
+#ifndef BOOST_HTTP_FILE_SERVER_MIN_CHUNK_SIZE
+#define BOOST_HTTP_FILE_SERVER_MIN_CHUNK_SIZE (64 * 1024)
+#endif // BOOST_HTTP_FILE_SERVER_MIN_CHUNK_SIZE
+
+#ifndef BOOST_HTTP_FILE_SERVER_MAX_CHUNK_SIZE
+#define BOOST_HTTP_FILE_SERVER_MAX_CHUNK_SIZE (1024 * 1024)
+#endif // BOOST_HTTP_FILE_SERVER_MAX_CHUNK_SIZE
+
 namespace boost {
 namespace http {
 
+template<class Socket>
+class basic_socket;
+
 enum class file_server_errc {
     io_error = 1,
     irrecoverable_io_error,
@@ -83,33 +116,106 @@ inline system::error_condition make_error_condition(file_server_errc e)
 
 namespace detail {
 
-// HTTP-date precision goes until seconds. discard any extra precision.
-inline
-posix_time::ptime last_modified_http_date(const filesystem::path &file)
+/* Lower bound on the bytes spent on the headers of each part of a
+   multipart/byteranges response for a file of the given size. Sending a gap
+   shorter than that is cheaper than starting a new part. */
+inline std::uintmax_t multipart_part_overhead(std::uintmax_t file_size)
 {
-    auto last_modified = posix_time::from_time_t(last_write_time(file));
-    auto d = last_modified.time_of_day();
-    return posix_time::ptime(last_modified.date(),
-                             posix_time::time_duration(d.hours(), d.minutes(),
-                                                       d.seconds()));
+    std::uintmax_t file_size_digits = 1;
+    while (file_size /= 10)
+        ++file_size_digits;
+
+    // "\r\n--" boundary "\r\n" "content-range: bytes " "0-0/" size "\r\n\r\n"
+    return constchar_helper("\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY "\r\n")
+        .size
+        + constchar_helper("content-range: bytes 0-0/").size
+        + file_size_digits + constchar_helper("\r\n\r\n").size;
 }
 
-inline
-void insert_new_range(std::vector<std::pair<std::uintmax_t, std::uintmax_t>>
-                      &range_set,
-                      std::pair<std::uintmax_t, std::uintmax_t> range)
+/* The parts of a multipart/byteranges response. The headers of every part are
+   serialized once, up front, so each part is sent as its head followed by the
+   range of the file. */
+class BOOST_HTTP_DECL multipart_ranges
 {
-    /* TODO (improvement):
+public:
+    typedef std::pair<std::uintmax_t, std::uintmax_t> range_type;
+
+    /* range_set holds validated ranges in the HTTP form (first and last byte).
+       An empty content_type omits the "content-type" header of the parts. */
+    multipart_ranges(std::vector<range_type> range_set,
+                     string_ref content_type, std::uintmax_t file_size);
+
+    std::size_t size() const;
 
-       Coalesce any of the ranges that overlap, or that are separated by a gap
-       that is smaller than the overhead of sending multiple parts.
+    // e.g. "\r\n--" boundary "\r\ncontent-range: bytes 0-9/100\r\n\r\n"
+    asio::const_buffer head(std::size_t part) const;
+
+    // The range of the file (offset and size) sent after head(part)
+    const range_type &range(std::size_t part) const;
+
+    // "\r\n--" boundary "--\r\n"
+    asio::const_buffer final_boundary() const;
+
+    // Size of the whole multipart body
+    std::uintmax_t body_size() const;
+
+private:
+    std::vector<range_type> ranges;
+    std::string heads;
+    // Where each head starts within heads (the final boundary comes last)
+    std::vector<std::size_t> offsets;
+    std::uintmax_t body_size_;
+};
+
+/* Coalesces the ranges that overlap or that are separated by a gap smaller
+   than min_gap.
+
+   The existing order is preserved: a set of merged ranges takes the position
+   of the first of its ranges in the request. */
+inline
+void coalesce_ranges(std::vector<std::pair<std::uintmax_t, std::uintmax_t>>
+                     &range_set, std::uintmax_t min_gap)
+{
+    if (range_set.size() < 2)
+        return;
+
+    std::vector<std::size_t> order(range_set.size());
+    for (std::size_t i = 0;i != order.size();++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&range_set](std::size_t a, std::size_t b) {
+                         return range_set[a].first < range_set[b].first;
+                     });
+
+    std::vector<bool> keep(range_set.size(), false);
+    auto merged = range_set[order[0]];
+    std::size_t position = order[0];
+    for (std::size_t i = 1;i != order.size();++i) {
+        const auto &range = range_set[order[i]];
+
+        /* The order in which all the operations are processed were very
+           carefully crafted to avoid integer overflow. */
+        if (range.first <= merged.second
+            || range.first - merged.second - 1 < min_gap) {
+            merged.second = std::max(merged.second, range.second);
+            position = std::min(position, order[i]);
+            continue;
+        }
 
-       Prefer to keep the already existing order rather than bringing a previous
-       chunk to the soon-to-be-inserted new chunk
+        range_set[position] = merged;
+        keep[position] = true;
+        merged = range;
+        position = order[i];
+    }
+    range_set[position] = merged;
+    keep[position] = true;
 
-       If the new range is merged with a previous chunk, it won't be
-       (re)inserted (again). */
-    range_set.push_back(range);
+    std::size_t size = 0;
+    for (std::size_t i = 0;i != range_set.size();++i) {
+        if (keep[i])
+            range_set[size++] = range_set[i];
+    }
+    range_set.resize(size);
 }
 
 /**
@@ -124,7 +230,6 @@ bool is_valid_range(const String &value, std::uintmax_t file_size,
 {
     typedef typename String::value_type CharT;
     typedef basic_string_ref<CharT> string_ref_type;
-    typedef std::basic_regex<typename string_ref_type::value_type> regex_type;
 
     assert(file_size);
 
@@ -144,26 +249,30 @@ bool is_valid_range(const String &value, std::uintmax_t file_size,
 
        returns true if range is invalid */
     auto fail = [&range_set,file_size](const string_ref_type &value) {
-        typedef std::match_results<typename string_ref_type::const_iterator>
-        match_results_type;
-        typedef typename match_results_type::value_type sub_match_type;
+        typedef typename string_ref_type::const_iterator iterator;
 
-        static const regex_type regex("(\\d*)-(\\d*)");
-        match_results_type matches;
+        auto isdigit = [](CharT c) { return c >= '0' && c <= '9'; };
 
-        if (!std::regex_match(value.begin(), value.end(), matches, regex))
+        // (\d*)-(\d*)
+        iterator first_byte_pos = value.begin();
+        iterator dash = std::find_if_not(first_byte_pos, value.end(),
+                                         isdigit);
+        if (dash == value.end() || *dash != '-')
             return true;
 
-        auto first_byte_pos = matches[1];
-        auto last_byte_pos = matches[2];
+        iterator last_byte_pos = dash + 1;
+        if (std::find_if_not(last_byte_pos, value.end(), isdigit)
+            != value.end()) {
+            return true;
+        }
 
-        if (first_byte_pos.length() == 0 && last_byte_pos.length() == 0)
+        if (first_byte_pos == dash && last_byte_pos == value.end())
             return true;
 
-        auto from_decimal = [](const sub_match_type &submatch) {
-            /* note: detail::from_decimal_submatch is defined in
+        auto from_decimal = [](iterator first, iterator last) {
+            /* note: detail::from_decimal_string is defined in
                algorithm/header.hpp */
-            return detail::from_decimal_submatch<std::uintmax_t>(submatch);
+            return detail::from_decimal_string<std::uintmax_t>(first, last);
         };
 
         std::pair<std::uintmax_t, std::uintmax_t> range;
@@ -173,16 +282,17 @@ bool is_valid_range(const String &value, std::uintmax_t file_size,
                carefully crafted to avoid integer overflow. Don't screw it!
                Although all the tests should be implemented already, this is UB
                land and errors cannot always be detected automatically. */
-            if (first_byte_pos.length()) {
+            if (first_byte_pos != dash) {
                 // byte-range-spec
-                range.first = from_decimal(first_byte_pos);
+                range.first = from_decimal(first_byte_pos, dash);
 
                 if (range.first >= file_size)
                     return false;
 
-                if (last_byte_pos.length()) {
+                if (last_byte_pos != value.end()) {
                     try {
-                        range.second = from_decimal(last_byte_pos);
+                        range.second = from_decimal(last_byte_pos,
+                                                    value.end());
 
                         if (range.second < range.first)
                             return false;
@@ -195,12 +305,12 @@ bool is_valid_range(const String &value, std::uintmax_t file_size,
                 } else {
                     range.second = file_size - 1;
                 }
-                insert_new_range(range_set, range);
+                range_set.push_back(range);
             } else {
                 // suffix-byte-range-spec
                 try {
                     // range.second initially means size
-                    range.second = from_decimal(last_byte_pos);
+                    range.second = from_decimal(last_byte_pos, value.end());
 
                     if (range.second == 0)
                         return false;
@@ -212,7 +322,7 @@ bool is_valid_range(const String &value, std::uintmax_t file_size,
                     range.first = 0;
                 }
                 range.second = file_size - 1;
-                insert_new_range(range_set, range);
+                range_set.push_back(range);
             }
 
             return false;
@@ -231,6 +341,7 @@ bool is_valid_range(const String &value, std::uintmax_t file_size,
     if (header_value_any_of(range_set_value, fail))
         return false;
 
+    coalesce_ranges(range_set, multipart_part_overhead(file_size));
     return range_set.size();
 }
 
@@ -263,6 +374,115 @@ auto safe_add(const A &a, const B &b) -> decltype(a+b)
     return a + b;
 }
 
+// Returns an empty pointer if the file cannot be opened
+inline std::shared_ptr<const native_file>
+open_native_file(const stat_cache::entry &entry)
+{
+    if (entry.file)
+        return entry.file;
+
+    auto ret = std::make_shared<const native_file>(entry.path);
+    if (!ret->is_open())
+        return nullptr;
+
+    return ret;
+}
+
+// Idle chunk buffers of the calling thread
+template<class Body>
+std::vector<Body> &transmit_chunk_pool()
+{
+    static thread_local std::vector<Body> pool;
+    return pool;
+}
+
+/* Buffer the chunks of a streamed file are read into. If the user reserved the
+   body of omessage, it's used and its capacity is the chunk size. Otherwise,
+   the buffer comes from a per-thread pool and the chunk size follows how fast
+   the socket drains the chunks (it doubles while a chunk is written almost
+   immediately and halves while a chunk takes long). */
+template<class Message>
+class transmit_chunks
+{
+public:
+    explicit transmit_chunks(Message &omessage)
+        : target(&omessage)
+        , size_(omessage.body().capacity())
+    {
+        if (size_ == 0) {
+            target = &pooled;
+            size_ = BOOST_HTTP_FILE_SERVER_MIN_CHUNK_SIZE;
+
+            auto &pool = transmit_chunk_pool<typename Message::body_type>();
+            if (pool.size()) {
+                pooled.body() = std::move(pool.back());
+                pool.pop_back();
+            }
+        }
+
+        target->body().resize(size_);
+    }
+
+    ~transmit_chunks()
+    {
+        if (target != &pooled)
+            return;
+
+        auto &pool = transmit_chunk_pool<typename Message::body_type>();
+        if (pool.size() < max_pooled) {
+            pooled.body().clear();
+            pool.push_back(std::move(pooled.body()));
+        }
+    }
+
+    transmit_chunks(const transmit_chunks &) = delete;
+    transmit_chunks &operator=(const transmit_chunks &) = delete;
+
+    // The message given to async_write
+    Message &message()
+    {
+        return *target;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    void write_started()
+    {
+        started = clock_type::now();
+    }
+
+    // nwritten is the size of the chunk just written
+    void write_finished(std::size_t nwritten)
+    {
+        // the last chunk of a file says nothing about the peer
+        if (target != &pooled || nwritten < size_)
+            return;
+
+        auto elapsed = clock_type::now() - started;
+        if (elapsed < std::chrono::milliseconds(10)
+            && size_ < BOOST_HTTP_FILE_SERVER_MAX_CHUNK_SIZE) {
+            size_ *= 2;
+        } else if (elapsed > std::chrono::milliseconds(200)
+                   && size_ > BOOST_HTTP_FILE_SERVER_MIN_CHUNK_SIZE) {
+            size_ /= 2;
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock clock_type;
+
+    // Per thread
+    static const std::size_t max_pooled = 4;
+
+    Message *target;
+    Message pooled;
+    std::size_t size_;
+    clock_type::time_point started;
+};
+
 template<class Socket, class Message, class Handler>
 struct on_async_response_transmit_file
     : public std::enable_shared_from_this<
@@ -270,18 +490,17 @@ struct on_async_response_transmit_file
 {
     on_async_response_transmit_file(Socket &socket, Message &omessage,
                                     Handler &&handler,
-                                    const filesystem::path &file,
+                                    std::shared_ptr<const native_file> file,
+                                    std::uintmax_t offset,
                                     std::uintmax_t remaining)
         : socket(socket)
-        , message(omessage)
+        , chunks(omessage)
+        , message(chunks.message())
         , handler(handler)
-        , stream(file)
+        , file(std::move(file))
+        , offset(offset)
         , remaining(remaining)
-    {
-        stream.exceptions(filesystem::ifstream::badbit
-                          | filesystem::ifstream::failbit
-                          | filesystem::ifstream::eofbit);
-    }
+    {}
 
     void process(const system::error_code &ec)
     {
@@ -299,487 +518,689 @@ struct on_async_response_transmit_file
             return;
         }
 
-        try {
-            auto next_read
-                = std::min<std::uintmax_t>(remaining, message.body().size());
-            stream.read(reinterpret_cast<filesystem::ifstream::char_type*>
-                        (message.body().data()),
-                        next_read);
-            remaining -= next_read;
-
-            if (!remaining)
-                message.body().resize(next_read);
+        message.body().resize(chunks.size());
+
+        auto next_read
+            = std::min<std::uintmax_t>(remaining, message.body().size());
+        auto self = this->shared_from_this();
+        asio::use_service<file_read_service>(socket.get_io_service())
+            .async_read_at(file, offset,
+                           asio::buffer(message.body().data(), next_read),
+                           [self,next_read](const system::error_code &ec) {
+                               self->on_read(ec, next_read);
+                           });
+    }
 
-            auto self = this->shared_from_this();
-            socket.async_write(message, [self](const system::error_code &ec) {
-                    self->process(ec);
-                });
-        } catch(std::ios_base::failure&) {
+    void on_read(const system::error_code &ec, std::uintmax_t nread)
+    {
+        if (ec) {
             handler(file_server_errc::irrecoverable_io_error);
+            return;
         }
+
+        offset += nread;
+        remaining -= nread;
+
+        if (!remaining)
+            message.body().resize(nread);
+
+        auto self = this->shared_from_this();
+        chunks.write_started();
+        socket.async_write(message,
+                           [self,nread](const system::error_code &ec) {
+                               self->chunks.write_finished(nread);
+                               self->process(ec);
+                           });
     }
 
     Socket &socket;
+    transmit_chunks<Message> chunks;
     Message &message;
     Handler handler;
-    filesystem::ifstream stream;
+    std::shared_ptr<const native_file> file;
+    std::uintmax_t offset;
     std::uintmax_t remaining;
 };
 
-template<class Socket, class Message, class String, class Handler>
-struct on_async_response_transmit_file_multi
-    : public std::enable_shared_from_this<
-        on_async_response_transmit_file_multi<Socket, Message, String, Handler>>
+template<class StringRef, class ServerSocket, class Message, class Handler>
+void async_response_cached_file(ServerSocket &socket,
+                                std::uint_fast16_t status,
+                                const StringRef &reason_phrase,
+                                Message &omessage, Handler &handler,
+                                std::shared_ptr<const file_cache::entry>
+                                contents,
+                                std::uintmax_t offset, std::uintmax_t size,
+                                std::false_type)
 {
-    enum State
-    {
-        STATE_BOUNDARY_LINE,
-        STATE_CONTENT_TYPE_KEY,
-        STATE_CONTENT_TYPE_VALUE,
-        STATE_CONTENT_TYPE_CRLF,
-        STATE_CONTENT_RANGE_KEY,
-        STATE_CONTENT_RANGE_VALUE_FIRST,
-        STATE_CONTENT_RANGE_VALUE_DASH,
-        STATE_CONTENT_RANGE_VALUE_SECOND,
-        STATE_CONTENT_RANGE_VALUE_SLASH,
-        STATE_CONTENT_RANGE_VALUE_SIZE,
-        STATE_CONTENT_RANGE_CRLF,
-        STATE_BODY,
-        STATE_FINAL_BOUNDARY
+    omessage.body().resize(size);
+    std::memcpy(omessage.body().data(), contents->contents.data() + offset,
+                size);
+    socket.async_write_response(status, reason_phrase, omessage, handler);
+}
+
+/* Writes a response whose body is the range [offset, offset + size) of the
+   cached contents, together with the metadata in a single gathered write */
+template<class StringRef, class ServerSocket, class Message, class Handler>
+void async_response_cached_file(ServerSocket &socket,
+                                std::uint_fast16_t status,
+                                const StringRef &reason_phrase,
+                                Message &omessage, Handler &handler,
+                                std::shared_ptr<const file_cache::entry>
+                                contents,
+                                std::uintmax_t offset, std::uintmax_t size,
+                                std::true_type)
+{
+    auto body = asio::buffer(contents->contents.data() + offset, size);
+
+    // the contents must outlive the write operation
+    socket.async_write_response(status, reason_phrase, omessage, body,
+                                [handler,contents](const system::error_code
+                                                   &ec) mutable {
+                                    handler(ec);
+                                });
+}
+
+/* Reads the whole file into cache and then writes a response whose body is the
+   range [offset, offset + size) of the cached contents */
+template<class StringRef, class ServerSocket, class Message, class Handler>
+void async_response_fill_cache(ServerSocket &socket, std::uint_fast16_t status,
+                               const StringRef &reason_phrase,
+                               Message &omessage, Handler &handler,
+                               const stat_cache::entry &file,
+                               file_cache &cache, std::uintmax_t offset,
+                               std::uintmax_t size)
+{
+    auto source = open_native_file(file);
+    if (!source) {
+        socket.get_io_service().post([handler]() mutable {
+                handler(system::error_code{file_server_errc::io_error});
+            });
+        return;
+    }
+
+    auto buffer = std::make_shared<std::vector<char>>(file.size);
+
+    auto on_read = [&socket,&omessage,&cache,status,reason_phrase,file,buffer,
+                    offset,size,handler]
+        (const system::error_code &ec) mutable {
+        if (ec) {
+            handler(system::error_code{file_server_errc::io_error});
+            return;
+        }
+
+        auto contents = cache.insert(file, std::move(*buffer));
+        async_response_cached_file(socket, status, reason_phrase, omessage,
+                                   handler, std::move(contents), offset, size,
+                                   is_basic_socket<ServerSocket>{});
     };
 
-    on_async_response_transmit_file_multi
-        (Socket &socket, Message &omessage, String &&content_type,
-         Handler &&handler, const filesystem::path &file,
-         std::vector<std::pair<std::uintmax_t, std::uintmax_t>> &&remaining,
-         const uintmax_t &file_size)
+    asio::use_service<file_read_service>(socket.get_io_service())
+        .async_read_at(std::move(source), 0, asio::buffer(*buffer),
+                       std::move(on_read));
+}
+
+#ifdef BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
+template<class ServerSocket>
+struct use_sendfile
+    : public std::is_base_of<basic_socket<asio::ip::tcp::socket>, ServerSocket>
+{};
+#else
+template<class ServerSocket>
+struct use_sendfile: public std::false_type {};
+#endif // BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
+
+template<class StringRef, class ServerSocket, class Message, class Handler>
+bool async_response_sendfile(ServerSocket &, std::uint_fast16_t,
+                             const StringRef &, Message &, Handler &,
+                             const stat_cache::entry &, std::uintmax_t,
+                             std::uintmax_t, std::false_type)
+{
+    return false;
+}
+
+#ifdef BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
+/* Sends the file range once the response metadata is written. The socket is
+   in non-blocking mode meanwhile, so sendfile(2) is retried whenever it
+   becomes writable again. */
+template<class Socket, class Handler>
+struct on_async_response_sendfile
+    : public std::enable_shared_from_this<
+        on_async_response_sendfile<Socket, Handler>>
+{
+    on_async_response_sendfile(Socket &socket, Handler &&handler,
+                               std::shared_ptr<const native_file> file,
+                               std::uintmax_t offset, std::uintmax_t remaining,
+                               bool non_blocking)
         : socket(socket)
-        , message(omessage)
-        , content_type(std::move(content_type))
         , handler(handler)
-        , stream(file)
-        , range_set(remaining)
-        , file_size(std::to_string(file_size))
-    {
-        stream.exceptions(filesystem::ifstream::badbit
-                          | filesystem::ifstream::failbit
-                          | filesystem::ifstream::eofbit);
-        this->remaining
-            = constchar_helper("\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY "\r\n")
-            .size;
-    }
+        , file(std::move(file))
+        , offset(offset)
+        , remaining(remaining)
+        , non_blocking(non_blocking)
+    {}
 
     void process(const system::error_code &ec)
     {
         if (ec) {
-            handler(ec);
+            complete(ec);
             return;
         }
 
-        if (index == range_set.size()) {
-            auto self = this->shared_from_this();
-            socket.async_write_end_of_message([self](const system::error_code
-                                                     &ec) {
-                                                  self->handler(ec);
-                                              });
-            return;
+        auto &channel = socket.next_layer();
+
+        while (remaining) {
+            system::error_code sendfile_ec;
+            auto sent = file->sendfile(channel.native_handle(), offset,
+                                       remaining, sendfile_ec);
+
+            if (sendfile_ec == asio::error::would_block) {
+                auto self = this->shared_from_this();
+                channel.async_write_some(asio::null_buffers(),
+                                         [self](const system::error_code &ec,
+                                                std::size_t) {
+                                             self->process(ec);
+                                         });
+                return;
+            }
+
+            if (sendfile_ec) {
+                complete(sendfile_ec);
+                return;
+            }
+
+            // the file was truncated after the headers were sent
+            if (sent == 0) {
+                complete(file_server_errc::irrecoverable_io_error);
+                return;
+            }
+
+            remaining -= sent;
+            socket.consume_content_length(sent);
         }
 
-        using std::uintmax_t;
-        using std::min;
-        using std::copy;
-        using std::back_inserter;
-        using std::to_string;
+        auto self = this->shared_from_this();
+        socket.async_write_end_of_message([self](const system::error_code
+                                                 &ec) {
+                                              self->complete(ec);
+                                          });
+    }
+
+    void complete(const system::error_code &ec)
+    {
+        system::error_code ignored;
+        socket.next_layer().native_non_blocking(non_blocking, ignored);
+        handler(ec);
+    }
 
-        typedef typename Message::body_type::value_type body_value_type;
+    Socket &socket;
+    Handler handler;
+    std::shared_ptr<const native_file> file;
+    std::uintmax_t offset;
+    std::uintmax_t remaining;
+    bool non_blocking;
+};
 
-        constchar_helper crlf("\r\n");
-        constchar_helper double_crlf("\r\n\r\n");
-        constchar_helper
-            boundary_line{"\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY "\r\n"};
-        constchar_helper
-            final_boundary{"\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY "--\r\n"};
-        constchar_helper content_type_key("content-type: ");
-        constchar_helper content_range_key("content-range: bytes ");
+/* Writes a response whose body is the range [offset, offset + size) of file,
+   framed by a content-length header and sent with sendfile(2). The descriptor
+   held by file is used if there is one.
+
+   Returns false, leaving handler untouched, if the file cannot be opened this
+   way. */
+template<class StringRef, class ServerSocket, class Message, class Handler>
+bool async_response_sendfile(ServerSocket &socket, std::uint_fast16_t status,
+                             const StringRef &reason_phrase, Message &omessage,
+                             Handler &handler, const stat_cache::entry &file,
+                             std::uintmax_t offset, std::uintmax_t size,
+                             std::true_type)
+{
+    auto source = open_native_file(file);
+    if (!source)
+        return false;
 
-        auto schedule_more = [this]() {
-            auto self = this->shared_from_this();
-            socket.async_write(message, [self](const system::error_code &ec) {
-                    self->process(ec);
-                });
-        };
+    auto &channel = socket.next_layer();
+    bool non_blocking = channel.native_non_blocking();
+    {
+        system::error_code ec;
+        channel.native_non_blocking(true, ec);
+        if (ec)
+            return false;
+    }
 
-        try {
-            auto next_read = min<uintmax_t>(remaining, message.body().size());
-            auto body_it = message.body().begin();
-
-            while (true) {
-                auto &range = range_set[index];
-
-                switch (state) {
-                case STATE_BOUNDARY_LINE: {
-                    auto it = boundary_line.begin<body_value_type>()
-                        + (boundary_line.size - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = content_type.size()
-                            ? STATE_CONTENT_TYPE_KEY : STATE_CONTENT_RANGE_KEY;
-                        remaining = content_type.size()
-                            ? content_type_key.size : content_range_key.size;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
+    omessage.headers().emplace("content-length", std::to_string(size));
 
-                        break;
-                    }
-                }
-                case STATE_CONTENT_TYPE_KEY: {
-                    auto it = content_type_key.begin<body_value_type>()
-                        + (content_type_key.size - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_TYPE_VALUE;
-                        remaining = content_type.size();
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_TYPE_VALUE: {
-                    auto it = content_type.begin()
-                        + (content_type.size() - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_TYPE_CRLF;
-                        remaining = crlf.size;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_TYPE_CRLF: {
-                    auto it = crlf.begin<body_value_type>()
-                        + (crlf.size - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_RANGE_KEY;
-                        remaining = content_range_key.size;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_RANGE_KEY: {
-                    auto it = content_range_key.begin<body_value_type>()
-                        + (content_range_key.size - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_RANGE_VALUE_FIRST;
-                        remaining = to_string(range.first).size();
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_RANGE_VALUE_FIRST: {
-                    auto value = to_string(range.first);
-                    auto it = value.begin() + (value.size() - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_RANGE_VALUE_DASH;
-                        remaining = 1;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_RANGE_VALUE_DASH: {
-                    *body_it = '-';
-                    body_it += next_read;
-                    remaining -= next_read;
+    typedef on_async_response_sendfile<ServerSocket, Handler> pointee;
 
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_RANGE_VALUE_SECOND;
-                        remaining = to_string(range.second).size();
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_RANGE_VALUE_SECOND: {
-                    auto value = to_string(range.second);
-                    auto it = value.begin() + (value.size() - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        to_cpp_range(range);
+    auto loop = std::make_shared<pointee>(socket, std::move(handler),
+                                          std::move(source), offset, size,
+                                          non_blocking);
 
-                        state = STATE_CONTENT_RANGE_VALUE_SLASH;
-                        remaining = 1;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
+    socket.async_write_response_metadata(status, reason_phrase, omessage,
+                                         [loop](const system::error_code
+                                                &ec) {
+                                             loop->process(ec);
+                                         });
+    return true;
+}
+#endif // BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
 
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_RANGE_VALUE_SLASH: {
-                    *body_it = '/';
-                    body_it += next_read;
-                    remaining -= next_read;
+template<class ServerSocket, class Message, class Handler>
+bool async_response_sendfile_multi(ServerSocket &, Message &, Handler &,
+                                   const stat_cache::entry &,
+                                   std::shared_ptr<const multipart_ranges> &,
+                                   std::false_type)
+{
+    return false;
+}
 
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_RANGE_VALUE_SIZE;
-                        remaining = file_size.size();
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
-                }
-                case STATE_CONTENT_RANGE_VALUE_SIZE: {
-                    auto it = file_size.begin()
-                        + (file_size.size() - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_CONTENT_RANGE_CRLF;
-                        remaining = double_crlf.size;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
+#ifdef BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
+/* Sends the parts of a multipart/byteranges response once its metadata is
+   written. The precomputed heads are written as they are and the ranges are
+   sent with sendfile(2), retried whenever the socket becomes writable again. */
+template<class Socket, class Handler>
+struct on_async_response_sendfile_multi
+    : public std::enable_shared_from_this<
+        on_async_response_sendfile_multi<Socket, Handler>>
+{
+    on_async_response_sendfile_multi
+        (Socket &socket, Handler &&handler,
+         std::shared_ptr<const native_file> file,
+         std::shared_ptr<const multipart_ranges> parts, bool non_blocking)
+        : socket(socket)
+        , handler(handler)
+        , file(std::move(file))
+        , parts(std::move(parts))
+        , offset(this->parts->range(0).first)
+        , remaining(this->parts->range(0).second)
+        , non_blocking(non_blocking)
+    {}
+
+    void process(const system::error_code &ec)
+    {
+        if (ec) {
+            complete(ec);
+            return;
+        }
+
+        auto &channel = socket.next_layer();
+
+        while (true) {
+            auto head = (index == parts->size()) ? parts->final_boundary()
+                : parts->head(index);
+
+            while (head_offset != asio::buffer_size(head)) {
+                system::error_code write_ec;
+                auto written
+                    = channel.write_some(asio::buffer(head + head_offset),
+                                         write_ec);
+                head_offset += written;
+                socket.consume_content_length(written);
+
+                if (write_ec == asio::error::would_block) {
+                    wait_writable();
+                    return;
                 }
-                case STATE_CONTENT_RANGE_CRLF: {
-                    auto it = double_crlf.begin<body_value_type>()
-                        + (double_crlf.size - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        state = STATE_BODY;
-                        remaining = range.second;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
-                    }
+
+                if (write_ec) {
+                    complete(write_ec);
+                    return;
                 }
-                case STATE_BODY: {
-                    stream.seekg(range.first);
-                    stream.read(reinterpret_cast<filesystem::ifstream
-                                    ::char_type*>
-                                (&*body_it),
-                                next_read);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        ++index;
-
-                        state = (index == range_set.size())
-                            ? STATE_FINAL_BOUNDARY : STATE_BOUNDARY_LINE;
-                        remaining = (state == STATE_FINAL_BOUNDARY)
-                            ? final_boundary.size : boundary_line.size;
-                        next_read = min<uintmax_t>(remaining,
-                                                   message.body().end()
-                                                   - body_it);
-
-                        if (state == STATE_FINAL_BOUNDARY) {
-                            /* Required to avoid UB within the line:
-
-                               auto &range = range_set[index]; */
-                            --index;
-                        }
+            }
 
-                        if (!next_read) {
-                            schedule_more();
-                            return;
-                        }
+            if (index == parts->size())
+                break;
 
-                        break;
-                    }
+            while (remaining) {
+                system::error_code sendfile_ec;
+                auto sent = file->sendfile(channel.native_handle(), offset,
+                                           remaining, sendfile_ec);
+
+                if (sendfile_ec == asio::error::would_block) {
+                    wait_writable();
+                    return;
                 }
-                case STATE_FINAL_BOUNDARY: {
-                    auto it = final_boundary.begin<body_value_type>()
-                        + (final_boundary.size - remaining);
-                    copy(it, it + next_read, body_it);
-                    body_it += next_read;
-                    remaining -= next_read;
-
-                    if (remaining) {
-                        schedule_more();
-                        return;
-                    } else {
-                        message.body().resize(body_it - message.body().begin());
-                        auto self = this->shared_from_this();
-
-                        auto on_finished
-                            = [self](const system::error_code &ec) {
-                            if (ec) {
-                                self->handler(ec);
-                                return;
-                            }
-
-                            self->socket
-                            .async_write_end_of_message([self]
-                                                        (const system::error_code
-                                                         &ec) {
-                                                            self->handler(ec);
-                                                        });
-                        };
-
-                        socket.async_write(message, on_finished);
-                        return;
-                    }
+
+                if (sendfile_ec) {
+                    complete(sendfile_ec);
+                    return;
                 }
+
+                // the file was truncated after the headers were sent
+                if (sent == 0) {
+                    complete(file_server_errc::irrecoverable_io_error);
+                    return;
                 }
+
+                remaining -= sent;
+                socket.consume_content_length(sent);
+            }
+
+            ++index;
+            head_offset = 0;
+            if (index != parts->size()) {
+                offset = parts->range(index).first;
+                remaining = parts->range(index).second;
             }
-        } catch(std::ios_base::failure&) {
-            handler(file_server_errc::irrecoverable_io_error);
         }
+
+        auto self = this->shared_from_this();
+        socket.async_write_end_of_message([self](const system::error_code
+                                                 &ec) {
+                                              self->complete(ec);
+                                          });
+    }
+
+    void wait_writable()
+    {
+        auto self = this->shared_from_this();
+        socket.next_layer()
+            .async_write_some(asio::null_buffers(),
+                              [self](const system::error_code &ec,
+                                     std::size_t) {
+                                  self->process(ec);
+                              });
+    }
+
+    void complete(const system::error_code &ec)
+    {
+        system::error_code ignored;
+        socket.next_layer().native_non_blocking(non_blocking, ignored);
+        handler(ec);
     }
 
     Socket &socket;
-    Message &message;
-    String content_type;
     Handler handler;
-    filesystem::ifstream stream;
-    State state = STATE_BOUNDARY_LINE;
-    typename Message::body_type::size_type remaining;
-    std::vector<std::pair<std::uintmax_t, std::uintmax_t>> range_set;
-    std::vector<std::pair<std::uintmax_t, std::uintmax_t>>::size_type index = 0;
-    const std::string file_size;
+    std::shared_ptr<const native_file> file;
+    std::shared_ptr<const multipart_ranges> parts;
+
+    // The part being sent
+    std::size_t index = 0;
+    // Bytes of its head already written
+    std::size_t head_offset = 0;
+    std::uintmax_t offset;
+    // Bytes of its range not sent yet
+    std::uintmax_t remaining;
+    bool non_blocking;
 };
 
-template<class CharT>
-filesystem::path
-resolve_dots_or_throw_not_found(const std::basic_string<CharT> &ipath)
+/* Writes a 206 response made of the parts, framed by a content-length header
+   and sent with sendfile(2).
+
+   Returns false, leaving handler untouched, if the file cannot be opened this
+   way. */
+template<class ServerSocket, class Message, class Handler>
+bool async_response_sendfile_multi(ServerSocket &socket, Message &omessage,
+                                   Handler &handler,
+                                   const stat_cache::entry &file,
+                                   std::shared_ptr<const multipart_ranges>
+                                   &parts,
+                                   std::true_type)
 {
-    using boost::algorithm::split_iterator;
-    using boost::algorithm::first_finder;
-    using boost::algorithm::equal;
+    auto source = open_native_file(file);
+    if (!source)
+        return false;
 
-    typedef std::basic_string<CharT> StringT;
-    typedef split_iterator<typename StringT::const_iterator>
-        string_split_iterator;
+    auto &channel = socket.next_layer();
+    bool non_blocking = channel.native_non_blocking();
+    {
+        system::error_code ec;
+        channel.native_non_blocking(true, ec);
+        if (ec)
+            return false;
+    }
 
-    filesystem::path ret;
+    omessage.headers().emplace("content-length",
+                               std::to_string(parts->body_size()));
 
-    std::array<CharT, 1> dot{'.'};
-    std::array<CharT, 2> dot_dot{'.', '.'};
+    typedef on_async_response_sendfile_multi<ServerSocket, Handler> pointee;
 
-    for (string_split_iterator it =
+    auto loop = std::make_shared<pointee>(socket, std::move(handler),
+                                          std::move(source), std::move(parts),
+                                          non_blocking);
+
+    socket.async_write_response_metadata(206, string_ref("Partial Content"),
+                                         omessage,
+                                         [loop](const system::error_code
+                                                &ec) {
+                                             loop->process(ec);
+                                         });
+    return true;
+}
+#endif // BOOST_HTTP_DETAIL_FILE_SERVER_SENDFILE
+
+/* Streams the parts of a multipart/byteranges response. The chunks are filled
+   with the precomputed heads and the ranges of the file they announce, so
+   several small parts share a single write. */
+template<class Socket, class Message, class Handler>
+struct on_async_response_transmit_file_multi
+    : public std::enable_shared_from_this<
+        on_async_response_transmit_file_multi<Socket, Message, Handler>>
+{
+    on_async_response_transmit_file_multi
+        (Socket &socket, Message &omessage, Handler &&handler,
+         std::shared_ptr<const native_file> file,
+         std::shared_ptr<const multipart_ranges> parts)
+        : socket(socket)
+        , chunks(omessage)
+        , message(chunks.message())
+        , handler(handler)
+        , file(std::move(file))
+        , parts(std::move(parts))
+        , remaining(this->parts->range(0).second)
+    {}
+
+    void process(const system::error_code &ec)
+    {
+        if (ec) {
+            handler(ec);
+            return;
+        }
+
+        message.body().resize(chunks.size());
+        fill(0);
+    }
+
+    // Fills the chunk from used on
+    void fill(std::size_t used)
+    {
+        auto &body = message.body();
+
+        while (true) {
+            auto head = (index == parts->size()) ? parts->final_boundary()
+                : parts->head(index);
+            auto head_size = asio::buffer_size(head) - head_offset;
+            auto n = std::min(head_size, body.size() - used);
+            std::memcpy(body.data() + used,
+                        asio::buffer_cast<const char*>(head) + head_offset, n);
+            head_offset += n;
+            used += n;
+
+            if (n != head_size) {
+                schedule_more(used);
+                return;
+            }
+
+            if (index == parts->size()) {
+                body.resize(used);
+                auto self = this->shared_from_this();
+
+                auto on_finished = [self](const system::error_code &ec) {
+                    if (ec) {
+                        self->handler(ec);
+                        return;
+                    }
+
+                    self->socket
+                    .async_write_end_of_message([self](const system::error_code
+                                                       &ec) {
+                                                    self->handler(ec);
+                                                });
+                };
+
+                socket.async_write(message, on_finished);
+                return;
+            }
+
+            if (remaining) {
+                auto next_read
+                    = std::min<std::uintmax_t>(remaining, body.size() - used);
+
+                if (!next_read) {
+                    schedule_more(used);
+                    return;
+                }
+
+                const auto &range = parts->range(index);
+                auto self = this->shared_from_this();
+                asio::use_service<file_read_service>(socket.get_io_service())
+                    .async_read_at(file,
+                                   range.first + (range.second - remaining),
+                                   asio::buffer(body.data() + used,
+                                                next_read),
+                                   [self,used,next_read]
+                                   (const system::error_code &ec) {
+                                       self->on_body_read(ec, used, next_read);
+                                   });
+                return;
+            }
+
+            ++index;
+            head_offset = 0;
+            remaining = (index == parts->size()) ? 0
+                : parts->range(index).second;
+        }
+    }
+
+    void on_body_read(const system::error_code &ec, std::size_t used,
+                      std::size_t nread)
+    {
+        if (ec) {
+            handler(file_server_errc::irrecoverable_io_error);
+            return;
+        }
+
+        remaining -= nread;
+        fill(used + nread);
+    }
+
+    void schedule_more(std::size_t used)
+    {
+        message.body().resize(used);
+
+        auto self = this->shared_from_this();
+        chunks.write_started();
+        socket.async_write(message, [self,used](const system::error_code &ec) {
+                self->chunks.write_finished(used);
+                self->process(ec);
+            });
+    }
+
+    Socket &socket;
+    transmit_chunks<Message> chunks;
+    Message &message;
+    Handler handler;
+    std::shared_ptr<const native_file> file;
+    std::shared_ptr<const multipart_ranges> parts;
+
+    // The part being sent
+    std::size_t index = 0;
+    // Bytes of its head already in a chunk
+    std::size_t head_offset = 0;
+    // Bytes of its range not read yet
+    std::uintmax_t remaining;
+};
+
+/* Fills the body of a multipart/byteranges response with the precomputed
+   heads and the ranges of the file, read one after the other, and then writes
+   the whole response (i.e. for sockets without the streaming interface). */
+template<class Socket, class Message, class Handler>
+struct on_async_response_read_file_multi
+    : public std::enable_shared_from_this<
+        on_async_response_read_file_multi<Socket, Message, Handler>>
+{
+    on_async_response_read_file_multi(Socket &socket, Message &omessage,
+                                      Handler &&handler,
+                                      std::shared_ptr<const native_file> file,
+                                      multipart_ranges parts)
+        : socket(socket)
+        , message(omessage)
+        , handler(handler)
+        , file(std::move(file))
+        , parts(std::move(parts))
+    {}
+
+    void start()
+    {
+        // the exact size is known, so the body is allocated once
+        message.body().resize(parts.body_size());
+        fill(0);
+    }
+
+    // Fills the body from used on
+    void fill(std::size_t used)
+    {
+        auto &body = message.body();
+
+        if (index == parts.size()) {
+            auto final_boundary = parts.final_boundary();
+            std::memcpy(body.data() + used,
+                        asio::buffer_cast<const char*>(final_boundary),
+                        asio::buffer_size(final_boundary));
+
+            socket.async_write_response(206, string_ref("Partial Content"),
+                                        message, handler);
+            return;
+        }
+
+        auto head = parts.head(index);
+        std::memcpy(body.data() + used, asio::buffer_cast<const char*>(head),
+                    asio::buffer_size(head));
+        used += asio::buffer_size(head);
+
+        const auto &range = parts.range(index++);
+        auto nread = range.second;
+        auto self = this->shared_from_this();
+        asio::use_service<file_read_service>(socket.get_io_service())
+            .async_read_at(file, range.first,
+                           asio::buffer(body.data() + used, nread),
+                           [self,used,nread](const system::error_code &ec) {
+                               if (ec) {
+                                   self->handler(system::error_code
+                                                 {file_server_errc::io_error});
+                                   return;
+                               }
+
+                               self->fill(used + nread);
+                           });
+    }
+
+    Socket &socket;
+    Message &message;
+    Handler handler;
+    std::shared_ptr<const native_file> file;
+    multipart_ranges parts;
+
+    // The next part to fill
+    std::size_t index = 0;
+};
+
+template<class CharT>
+filesystem::path
+resolve_dots_or_throw_not_found(const std::basic_string<CharT> &ipath)
+{
+    using boost::algorithm::split_iterator;
+    using boost::algorithm::first_finder;
+    using boost::algorithm::equal;
+
+    typedef std::basic_string<CharT> StringT;
+    typedef split_iterator<typename StringT::const_iterator>
+        string_split_iterator;
+
+    filesystem::path ret;
+
+    std::array<CharT, 1> dot{'.'};
+    std::array<CharT, 2> dot_dot{'.', '.'};
+
+    for (string_split_iterator it =
              make_split_iterator(ipath, first_finder("/", is_iequal()));
          it != string_split_iterator();
          ++it) {
@@ -879,64 +1300,64 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                              Message &omessage, const filesystem::path &file,
                              CompletionToken &&token);
 
-template<class ServerSocket, class Message, class CompletionToken>
-typename asio::async_result<
-    typename asio::handler_type<CompletionToken,
-                                void(system::error_code)>::type>::type
-async_response_transmit_file(ServerSocket &socket, const Message &imessage,
-                             Message &omessage, const filesystem::path &file,
-                             bool is_head_request, CompletionToken &&token)
+namespace detail {
+
+inline bool check_transmit_write_state(write_state state)
 {
-    static_assert(is_server_socket<ServerSocket>::value,
-                  "ServerSocket must fulfill the ServerSocket concept");
-    static_assert(is_message<Message>::value,
-                  "Message must fulfill the Message concept");
+    return state == write_state::empty || state == write_state::continue_issued;
+}
+
+/* Whether the body can be written in pieces after the metadata. basic_socket
+   also does so for HTTP/1.0 as long as the response has a "content-length"
+   header, so the file never has to be held in memory at once. */
+template<class ServerSocket>
+bool can_stream_body(ServerSocket &socket)
+{
+    return socket.write_response_native_stream()
+        || is_basic_socket<ServerSocket>::value;
+}
 
+/* async_response_transmit_file once the metadata of the file is known (entry
+   comes from a stat_cache or from the filesystem). If contents isn't empty, it
+   holds the bytes of the file and the filesystem isn't touched at all.
+   Otherwise, if cache isn't null and the file is small enough, the file is
+   read into cache once a body is going to be sent (i.e. not for HEAD requests
+   or failed preconditions). */
+template<class ServerSocket, class Message, class Handler>
+void async_response_transmit_file(ServerSocket &socket,
+                                  const Message &imessage, Message &omessage,
+                                  const stat_cache::entry &entry,
+                                  std::shared_ptr<const file_cache::entry>
+                                  contents,
+                                  bool is_head_request, Handler &handler,
+                                  file_cache *cache = nullptr)
+{
     typedef typename Message::headers_type::value_type headers_value_type;
     typedef typename Message::headers_type::mapped_type String;
     typedef typename String::value_type CharT;
     typedef basic_string_ref<CharT> string_ref_type;
-    typedef typename Message::body_type::value_type body_value_type;
-    typedef typename asio::handler_type<
-        CompletionToken, void(system::error_code)>::type Handler;
 
-    Handler handler(std::forward<CompletionToken>(token));
-    asio::async_result<Handler> result(handler);
-
-    {
-        auto state = socket.write_state();
-        if (state != write_state::empty
-            && state != write_state::continue_issued) {
-            socket.get_io_service().post([handler]() mutable {
-                    handler(system::error_code(file_server_errc
-                                               ::write_state_not_supported));
-                });
-            return result.get();
-        }
-    }
-
-    detail::constchar_helper crlf("\r\n");
+    const auto &file = entry.path;
 
     try {
-        /* BEWARE: std::time_t is not TZ aware and some old filesystems report
-           time as local (i.e. non-UTC). We don't try to detect filesystem
-           behaviour to avoid races and because all modern filesystems adopted
-           UTC. */
-        auto last_modified = detail::last_modified_http_date(file);
-        const auto size = file_size(file);
-        const auto buffer_size = [&omessage]() {
-            auto ret = omessage.body().capacity();
-            // can be any number > 0
-            decltype(ret) magic_constant = 64;
-            return (ret != 0) ? ret : magic_constant;
-        }();
-
+        auto last_modified = posix_time::from_time_t(entry.last_write_time);
+        const auto size = entry.size;
         omessage.body().clear();
 
+        const bool fill_cache = !contents && cache && size != 0
+            && size <= cache->max_file_size();
+
+        // an entity-tag set by the user takes precedence
+        if (!entry.etag.empty()
+            && omessage.headers().find("etag") == omessage.headers().end()) {
+            omessage.headers().emplace("etag", String(entry.etag.data(),
+                                                      entry.etag.size()));
+        }
+
         if (size == 0) {
             socket.async_write_response(200, string_ref("OK"), omessage,
                                         handler);
-            return result.get();
+            return;
         }
 
         auto etag = [](const typename Message::headers_type &headers) {
@@ -948,14 +1369,14 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
             if (value.size() < 2 || value.back() != '"')
                 return std::make_pair(string_ref_type{}, false);
 
+            /* the quotes are kept because they're part of the entity-tag
+               compared against the conditional request headers */
             if (value.front() == '"') {
-                return std::make_pair(string_ref_type{&value[1],
-                                                      value.size() - 2},
+                return std::make_pair(string_ref_type{&value[0], value.size()},
                                       true);
             } else if (value.size() > 2 && (value[0] == 'W' && value[1] == '/'
                                             && value[2] == '"')) {
-                return std::make_pair(string_ref_type{&value[3],
-                                                      value.size() - 4},
+                return std::make_pair(string_ref_type{&value[0], value.size()},
                                       false);
             }
 
@@ -970,26 +1391,37 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
             return etag.second;
         };
 
-        auto current_etag = etag(omessage.headers());
-        auto current_etag_value = etag_value(current_etag);
-
         /* only fill response headers that need no more than the target file
            to be computed (i.e. ignore all input headers) */
         {
             omessage.headers().emplace("accept-ranges", "bytes");
 
-            auto now = posix_time::second_clock::universal_time();
+            char date[date_cache::size];
+            auto now = posix_time::from_time_t(asio::use_service<date_cache>(
+                socket.get_io_service()).now(date));
 
             /* MUST NOT send a "last-modified" date that is later than the
                server’s time of message origination ("date") */
             if (last_modified > now)
                 last_modified = now;
 
-            omessage.headers().emplace("date", to_http_date<String>(now));
-            omessage.headers()
-            .emplace("last-modified", to_http_date<String>(last_modified));
+            omessage.headers().emplace("date", String(date, date_cache::size));
+            if (contents && last_modified == posix_time
+                ::from_time_t(contents->last_write_time)) {
+                const auto &value = contents->last_modified;
+                omessage.headers().emplace("last-modified",
+                                           String(value.data(), value.size()));
+            } else {
+                omessage.headers()
+                .emplace("last-modified", to_http_date<String>(last_modified));
+            }
         };
 
+        /* refers to the headers storage, so it's only taken after the last
+           header is added */
+        auto current_etag = etag(omessage.headers());
+        auto current_etag_value = etag_value(current_etag);
+
         /* The order to check the conditional request headers is defined in
            RFC7232 */
 
@@ -1014,7 +1446,7 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                 socket.async_write_response(412, string_ref("Precondition"
                                                             " Failed"),
                                             omessage, handler);
-                return result.get();
+                return;
             }
         } else {
             // Check "if-unmodified-since" header
@@ -1030,7 +1462,7 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                             .async_write_response(412, string_ref("Precondition"
                                                                   " Failed"),
                                                   omessage, handler);
-                        return result.get();
+                        return;
                     }
                 }
             }
@@ -1057,7 +1489,7 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                                any_of_predicate)) {
                 socket.async_write_response(304, string_ref("Not Modified"),
                                             omessage, handler);
-                return result.get();
+                return;
             }
         } else {
             // Check "if-modified-since" header
@@ -1072,7 +1504,7 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                         socket.async_write_response(304, string_ref("Not "
                                                                     "Modified"),
                                                     omessage, handler);
-                        return result.get();
+                        return;
                     }
                 }
             }
@@ -1088,11 +1520,22 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
             if (std::distance(query.first, query.second) == 1) {
                 auto query_datetime = header_to_ptime(query.first->second);
 
-                /* valid HTTP-date (otherwise must ignore it) */
+                const auto &value = query.first->second;
+
+                /* Only a matching HTTP-date or a strongly matching entity-tag
+                   validates the range. Anything else (e.g. a weak entity-tag)
+                   means the full representation must be sent. */
+                bool valid = false;
                 if (!query_datetime.is_not_a_date_time()) {
-                    if (last_modified != query_datetime)
-                        process_range = false;
+                    valid = last_modified == query_datetime;
+                } else if (value.size() > 1 && value.front() == '"') {
+                    string_ref_type query_etag(&value[0], value.size());
+                    valid = etag_is_strong(current_etag)
+                        && etag_match_strong(current_etag_value, query_etag);
                 }
+
+                if (!valid)
+                    process_range = false;
             }
         }
 
@@ -1105,7 +1548,7 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                 socket.async_write_response(416,
                                             string_ref("Range Not Satisfiable"),
                                             omessage, handler);
-                return result.get();
+                return;
             }
 
             assert(range_set.size() > 0);
@@ -1120,17 +1563,52 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
 
                 detail::to_cpp_range(range);
 
-                if (socket.write_response_native_stream()) {
-                    omessage.body().resize(buffer_size);
+                if (contents) {
+                    detail::async_response_cached_file
+                        (socket, 206, string_ref("Partial Content"), omessage,
+                         handler, std::move(contents), range.first,
+                         range.second, detail::is_basic_socket<ServerSocket>{});
+                    return;
+                }
+
+                if (fill_cache) {
+                    detail::async_response_fill_cache
+                        (socket, 206, string_ref("Partial Content"), omessage,
+                         handler, entry, *cache, range.first, range.second);
+                    return;
+                }
+
+                if (detail::can_stream_body(socket)) {
+                    if (detail::async_response_sendfile
+                        (socket, 206, string_ref("Partial Content"), omessage,
+                         handler, entry, range.first, range.second,
+                         detail::use_sendfile<ServerSocket>{})) {
+                        return;
+                    }
+
+                    auto source = detail::open_native_file(entry);
+                    if (!source) {
+                        socket.get_io_service().post([handler]() mutable {
+                                handler(system::error_code
+                                        {file_server_errc::io_error});
+                            });
+                        return;
+                    }
+
+                    // HTTP/1.0 has no chunked transfer coding
+                    if (!socket.write_response_native_stream()) {
+                        omessage.headers()
+                            .emplace("content-length",
+                                     std::to_string(range.second));
+                    }
 
                     typedef detail
                         ::on_async_response_transmit_file<ServerSocket, Message,
                                                           Handler> pointee;
 
                     auto loop = std::make_shared<pointee>
-                        (socket, omessage, std::move(handler), file,
-                         range.second);
-                    loop->stream.seekg(range.first);
+                        (socket, omessage, std::move(handler),
+                         std::move(source), range.first, range.second);
 
                     auto callback = [loop](const system::error_code &ec) {
                         loop->process(ec);
@@ -1146,25 +1624,42 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                                 handler(system::error_code
                                         {file_server_errc::io_error});
                             });
-                        return result.get();
+                        return;
+                    }
+
+                    auto source = detail::open_native_file(entry);
+                    if (!source) {
+                        socket.get_io_service().post([handler]() mutable {
+                                handler(system::error_code
+                                        {file_server_errc::io_error});
+                            });
+                        return;
                     }
 
                     omessage.body().resize(range.second);
 
-                    filesystem::ifstream stream(file);
-                    stream.exceptions(filesystem::ifstream::badbit
-                                      | filesystem::ifstream::failbit
-                                      | filesystem::ifstream::eofbit);
-                    stream.seekg(range.first);
-                    stream.read(reinterpret_cast<filesystem::ifstream
-                                    ::char_type*>(omessage.body().data()),
-                                range.second);
-
-                    socket.async_write_response(206,
-                                                string_ref("Partial Content"),
-                                                omessage, handler);
+                    auto on_read = [&socket,&omessage,handler]
+                        (const system::error_code &ec) mutable {
+                        if (ec) {
+                            handler(system::error_code
+                                    {file_server_errc::io_error});
+                            return;
+                        }
+
+                        socket.async_write_response(206,
+                                                    string_ref("Partial"
+                                                               " Content"),
+                                                    omessage, handler);
+                    };
+
+                    asio::use_service<file_read_service>
+                        (socket.get_io_service())
+                        .async_read_at(std::move(source), range.first,
+                                       asio::buffer(omessage.body().data(),
+                                                    range.second),
+                                       std::move(on_read));
                 }
-                return result.get();
+                return;
             } else {
                 // range_set.size() > 1
                 // TODO: use string_ref?
@@ -1180,18 +1675,45 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                                            "multipart/byteranges;boundary="
                                            BOOST_HTTP_FILE_SERVER_BOUNDARY);
 
-                if (socket.write_response_native_stream()) {
-                    omessage.body().resize(buffer_size);
+                if (detail::can_stream_body(socket)) {
+                    auto parts = std::make_shared<const detail
+                                                  ::multipart_ranges>
+                        (std::move(range_set),
+                         string_ref(content_type.data(), content_type.size()),
+                         size);
+
+                    if (detail::async_response_sendfile_multi
+                        (socket, omessage, handler, entry, parts,
+                         detail::use_sendfile<ServerSocket>{})) {
+                        return;
+                    }
+
+                    auto source = detail::open_native_file(entry);
+                    if (!source) {
+                        socket.get_io_service().post([handler]() mutable {
+                                handler(system::error_code
+                                        {file_server_errc::io_error});
+                            });
+                        return;
+                    }
+
+                    /* basic_socket frames the body by a "content-length"
+                       header instead of the chunked transfer coding */
+                    if (detail::is_basic_socket<ServerSocket>::value) {
+                        omessage.headers()
+                            .emplace("content-length",
+                                     std::to_string(parts->body_size()));
+                    }
 
                     typedef detail
                         ::on_async_response_transmit_file_multi<ServerSocket,
-                                                                Message, String,
+                                                                Message,
                                                                 Handler>
                         pointee;
 
                     auto loop = std::make_shared<pointee>
-                        (socket, omessage, std::move(content_type),
-                         std::move(handler), file, std::move(range_set), size);
+                        (socket, omessage, std::move(handler),
+                         std::move(source), std::move(parts));
 
                     auto callback = [loop](const system::error_code &ec) {
                         loop->process(ec);
@@ -1202,95 +1724,40 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                                                                     " Content"),
                                                          omessage, callback);
                 } else {
-                    using std::copy;
-                    using std::back_inserter;
-                    using std::to_string;
-
-                    detail::constchar_helper
-                        boundary_line("\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY
-                                      "\r\n");
-                    detail::constchar_helper
-                        final_boundary("\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY
-                                       "--\r\n");
-
-                    filesystem::ifstream stream(file);
-                    stream.exceptions(filesystem::ifstream::badbit
-                                      | filesystem::ifstream::failbit
-                                      | filesystem::ifstream::eofbit);
-
-                    //omessage.body().resize(/*total size*/); // TODO
-                    for (auto &range: range_set) {
-                        // e.g. "\r\n--THIS_STRING_SEPARATES"
-                        copy(boundary_line.begin<body_value_type>(),
-                             boundary_line.end<body_value_type>(),
-                             back_inserter(omessage.body()));
-
-                        // e.g. "content-type: application/pdf\r\n"
-                        if (content_type.size()) {
-                            detail::constchar_helper h("content-type: ");
-                            copy(h.begin<body_value_type>(),
-                                 h.end<body_value_type>(),
-                                 back_inserter(omessage.body()));
-                            copy(content_type.begin(), content_type.end(),
-                                 back_inserter(omessage.body()));
-                            copy(crlf.begin<body_value_type>(),
-                                 crlf.end<body_value_type>(),
-                                 back_inserter(omessage.body()));
-                        }
+                    detail::multipart_ranges parts
+                        (std::move(range_set),
+                         string_ref(content_type.data(), content_type.size()),
+                         size);
 
-                        // e.g. "content-range: bytes 500-999/8000\r\n"
-                        {
-                            detail::constchar_helper h("content-range: bytes ");
-                            copy(h.begin<body_value_type>(),
-                                 h.end<body_value_type>(),
-                                 back_inserter(omessage.body()));
-                            auto value = to_string(range.first);
-                            copy(value.begin(), value.end(),
-                                 back_inserter(omessage.body()));
-                            omessage.body().push_back('-');
-                            value = to_string(range.second);
-                            copy(value.begin(), value.end(),
-                                 back_inserter(omessage.body()));
-                            omessage.body().push_back('/');
-                            value = to_string(size);
-                            copy(value.begin(), value.end(),
-                                 back_inserter(omessage.body()));
-                        }
-                        copy(crlf.begin<body_value_type>(),
-                             crlf.end<body_value_type>(),
-                             back_inserter(omessage.body()));
-                        detail::to_cpp_range(range);
-                        // "\r\n"
-                        copy(crlf.begin<body_value_type>(),
-                             crlf.end<body_value_type>(),
-                             back_inserter(omessage.body()));
-
-                        // body part
-                        auto index = omessage.body().size();
-                        try {
-                            auto newsiz = detail::safe_add(index, range.second);
-                            omessage.body().resize(newsiz);
-                        } catch(std::overflow_error&) {
-                            socket.get_io_service().post([handler]() mutable {
-                                    handler(system::error_code{file_server_errc
-                                                ::io_error});
-                                });
-                            return result.get();
-                        }
-                        stream.seekg(range.first);
-                        stream.read(reinterpret_cast<filesystem::ifstream
-                                        ::char_type*>
-                                    (omessage.body().data() + index),
-                                    range.second);
+                    if (parts.body_size() > omessage.body().max_size()) {
+                        socket.get_io_service().post([handler]() mutable {
+                                handler(system::error_code
+                                        {file_server_errc::io_error});
+                            });
+                        return;
                     }
-                    copy(final_boundary.begin<body_value_type>(),
-                         final_boundary.end<body_value_type>(),
-                         back_inserter(omessage.body()));
-                    socket.async_write_response(206,
-                                                string_ref("Partial Content"),
-                                                omessage, handler);
+
+                    auto source = detail::open_native_file(entry);
+                    if (!source) {
+                        socket.get_io_service().post([handler]() mutable {
+                                handler(system::error_code
+                                        {file_server_errc::io_error});
+                            });
+                        return;
+                    }
+
+                    typedef detail
+                        ::on_async_response_read_file_multi<ServerSocket,
+                                                            Message, Handler>
+                        pointee;
+
+                    std::make_shared<pointee>(socket, omessage,
+                                              std::move(handler),
+                                              std::move(source),
+                                              std::move(parts))
+                        ->start();
                 }
-                return result.get();
+                return;
             }
         }
 
@@ -1298,20 +1765,54 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
             omessage.headers().emplace("content-length", std::to_string(size));
             socket.async_write_response(200, string_ref("OK"), omessage,
                                         handler);
-            return result.get();
+            return;
         }
 
         // non-byte-range-request
 
-        if (socket.write_response_native_stream()) {
-            omessage.body().resize(buffer_size);
+        if (contents) {
+            detail::async_response_cached_file
+                (socket, 200, string_ref("OK"), omessage, handler,
+                 std::move(contents), 0, size,
+                 detail::is_basic_socket<ServerSocket>{});
+            return;
+        }
+
+        if (fill_cache) {
+            detail::async_response_fill_cache(socket, 200, string_ref("OK"),
+                                              omessage, handler, entry, *cache,
+                                              0, size);
+            return;
+        }
+
+        if (detail::can_stream_body(socket)) {
+            if (detail::async_response_sendfile
+                (socket, 200, string_ref("OK"), omessage, handler, entry, 0,
+                 size, detail::use_sendfile<ServerSocket>{})) {
+                return;
+            }
+
+            auto source = detail::open_native_file(entry);
+            if (!source) {
+                socket.get_io_service().post([handler]() mutable {
+                        handler(system::error_code{file_server_errc::io_error});
+                    });
+                return;
+            }
+
+            // HTTP/1.0 has no chunked transfer coding
+            if (!socket.write_response_native_stream()) {
+                omessage.headers().emplace("content-length",
+                                           std::to_string(size));
+            }
 
             typedef detail
                 ::on_async_response_transmit_file<ServerSocket, Message,
                                                   Handler> pointee;
 
             auto loop = std::make_shared<pointee>
-                (socket, omessage, std::move(handler), file, size);
+                (socket, omessage, std::move(handler), std::move(source), 0,
+                 size);
 
             auto callback = [loop](const system::error_code &ec) {
                 loop->process(ec);
@@ -1324,29 +1825,95 @@ async_response_transmit_file(ServerSocket &socket, const Message &imessage,
                 socket.get_io_service().post([handler]() mutable {
                         handler(system::error_code{file_server_errc::io_error});
                     });
-                return result.get();
+                return;
+            }
+
+            auto source = detail::open_native_file(entry);
+            if (!source) {
+                socket.get_io_service().post([handler]() mutable {
+                        handler(system::error_code{file_server_errc::io_error});
+                    });
+                return;
             }
 
             omessage.body().resize(size);
 
-            filesystem::ifstream stream(file);
-            stream.exceptions(filesystem::ifstream::badbit
-                              | filesystem::ifstream::failbit
-                              | filesystem::ifstream::eofbit);
-            stream.read(reinterpret_cast<filesystem::ifstream
-                            ::char_type*>(omessage.body().data()),
-                        size);
+            auto on_read = [&socket,&omessage,handler]
+                (const system::error_code &ec) mutable {
+                if (ec) {
+                    handler(system::error_code{file_server_errc::io_error});
+                    return;
+                }
 
-            socket.async_write_response(200, string_ref("OK"), omessage,
-                                        handler);
+                socket.async_write_response(200, string_ref("OK"), omessage,
+                                            handler);
+            };
+
+            asio::use_service<file_read_service>(socket.get_io_service())
+                .async_read_at(std::move(source), 0,
+                               asio::buffer(omessage.body().data(), size),
+                               std::move(on_read));
         }
     } catch (std::ios_base::failure&) {
         socket.get_io_service().post([handler]() mutable {
                 handler(system::error_code{file_server_errc::io_error});
             });
+    }
+}
+
+/* Serves entry from cache, filling the cache once the file is known to be
+   sent if it's small enough */
+template<class ServerSocket, class Message, class Handler>
+void async_response_transmit_file(ServerSocket &socket,
+                                  const Message &imessage, Message &omessage,
+                                  const stat_cache::entry &entry,
+                                  file_cache &cache, bool is_head_request,
+                                  Handler &handler)
+{
+    async_response_transmit_file(socket, imessage, omessage, entry,
+                                 cache.find(entry), is_head_request, handler,
+                                 &cache);
+}
+
+} // namespace detail
+
+template<class ServerSocket, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+async_response_transmit_file(ServerSocket &socket, const Message &imessage,
+                             Message &omessage, const filesystem::path &file,
+                             bool is_head_request, CompletionToken &&token)
+{
+    static_assert(is_server_socket<ServerSocket>::value,
+                  "ServerSocket must fulfill the ServerSocket concept");
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+    asio::async_result<Handler> result(handler);
+
+    if (!detail::check_transmit_write_state(socket.write_state())) {
+        socket.get_io_service().post([handler]() mutable {
+                handler(system::error_code(file_server_errc
+                                           ::write_state_not_supported));
+            });
         return result.get();
     }
 
+    /* BEWARE: std::time_t is not TZ aware and some old filesystems report time
+       as local (i.e. non-UTC). We don't try to detect filesystem behaviour to
+       avoid races and because all modern filesystems adopted UTC. */
+    stat_cache::entry entry;
+    entry.path = file;
+    entry.last_write_time = last_write_time(file);
+    entry.size = file_size(file);
+
+    detail::async_response_transmit_file(socket, imessage, omessage, entry,
+                                         nullptr, is_head_request, handler);
     return result.get();
 }
 
@@ -1478,6 +2045,219 @@ async_response_transmit_dir(ServerSocket &socket, const String &method,
                                        omessage, root_dir, filter, token);
 }
 
+namespace detail {
+
+/* Picks the representation of entry accepted by the request: a precompressed
+   sibling or entry itself. The coding of the sibling is also returned (null
+   for entry itself). */
+template<class Headers>
+std::pair<const stat_cache::entry*, const char*>
+select_precompressed(const stat_cache::entry &entry, const Headers &headers)
+{
+    if (!entry.br && !entry.gzip)
+        return std::make_pair(&entry, nullptr);
+
+    auto qvalues = accept_encoding(headers);
+    int br = entry.br ? accept_encoding_qvalues::of(qvalues.br, qvalues.any)
+        : 0;
+    int gzip = entry.gzip
+        ? accept_encoding_qvalues::of(qvalues.gzip, qvalues.any) : 0;
+
+    // ties go to the smaller one, which usually is br
+    if (br > 0 && br >= gzip)
+        return std::make_pair(entry.br.get(), "br");
+    if (gzip > 0)
+        return std::make_pair(entry.gzip.get(), "gzip");
+
+    return std::make_pair(&entry, nullptr);
+}
+
+/* async_response_transmit_dir backed by cache. If contents_cache isn't null,
+   the contents of the small files are served from it. */
+template<class ServerSocket, class String, class ConvertibleToPath,
+         class Message, class Predicate, class Handler>
+void async_response_transmit_dir(ServerSocket &socket, const String &method,
+                                 const ConvertibleToPath &ipath,
+                                 const Message &imessage, Message &omessage,
+                                 stat_cache &cache, file_cache *contents_cache,
+                                 Predicate filter, Handler &handler)
+{
+    if (method != "GET" && method != "HEAD") {
+        omessage.headers().emplace("allow", "GET, HEAD");
+        socket.async_write_response(405, string_ref("Method Not Allowed"),
+                                    omessage, handler);
+        return;
+    }
+
+    bool is_head = (method == "HEAD");
+
+    try {
+        system::error_code ec;
+        auto entry
+            = cache.lookup(detail::resolve_dots_or_throw_not_found(ipath), ec);
+
+        if (!entry) {
+            socket.get_io_service().post([handler,ec]() mutable {
+                    handler(ec);
+                });
+            return;
+        }
+
+        auto path = entry->path;
+        if (!filter(path)) {
+            socket.get_io_service().post([handler]() mutable {
+                    handler(system::error_code{file_server_errc::filter_set});
+                });
+            return;
+        }
+
+        // filter redirected the request, the cached metadata doesn't apply
+        if (path != entry->path) {
+            http::async_response_transmit_file(socket, imessage, omessage,
+                                               path, is_head, handler);
+            return;
+        }
+
+        if (!detail::check_transmit_write_state(socket.write_state())) {
+            socket.get_io_service().post([handler]() mutable {
+                    handler(system::error_code(file_server_errc
+                                               ::write_state_not_supported));
+                });
+            return;
+        }
+
+        auto selected = detail::select_precompressed(*entry,
+                                                     imessage.headers());
+        if (entry->br || entry->gzip) {
+            // the choice depends on the request even if entry was selected
+            omessage.headers().emplace("vary", "accept-encoding");
+            if (selected.second)
+                omessage.headers().emplace("content-encoding", selected.second);
+        }
+        const auto &file = *selected.first;
+
+        if (contents_cache) {
+            detail::async_response_transmit_file(socket, imessage, omessage,
+                                                 file, *contents_cache,
+                                                 is_head, handler);
+        } else {
+            detail::async_response_transmit_file(socket, imessage, omessage,
+                                                 file, nullptr, is_head,
+                                                 handler);
+        }
+    } catch(filesystem::filesystem_error &e) {
+        auto err = e.code();
+        socket.get_io_service().post([handler,err]() mutable {
+                handler(err);
+            });
+    } catch(system::system_error &e) {
+        auto err = e.code();
+        socket.get_io_service().post([handler,err]() mutable {
+                handler(err);
+            });
+    }
+}
+
+} // namespace detail
+
+template<class ServerSocket, class String, class ConvertibleToPath,
+         class Message, class Predicate, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+async_response_transmit_dir(ServerSocket &socket, const String &method,
+                            const ConvertibleToPath &ipath,
+                            const Message &imessage, Message &omessage,
+                            stat_cache &cache, Predicate filter,
+                            CompletionToken &&token)
+{
+    static_assert(is_server_socket<ServerSocket>::value,
+                  "ServerSocket must fulfill the ServerSocket concept");
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+    asio::async_result<Handler> result(handler);
+
+    detail::async_response_transmit_dir(socket, method, ipath, imessage,
+                                        omessage, cache, nullptr, filter,
+                                        handler);
+    return result.get();
+}
+
+template<class ServerSocket, class String, class ConvertibleToPath,
+         class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+async_response_transmit_dir(ServerSocket &socket, const String &method,
+                            const ConvertibleToPath &ipath,
+                            const Message &imessage, Message &omessage,
+                            stat_cache &cache, CompletionToken &&token)
+{
+    static_assert(is_server_socket<ServerSocket>::value,
+                  "ServerSocket must fulfill the ServerSocket concept");
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    auto filter = [](const filesystem::path&){ return true; };
+    return async_response_transmit_dir(socket, method, ipath, imessage,
+                                       omessage, cache, filter, token);
+}
+
+template<class ServerSocket, class String, class ConvertibleToPath,
+         class Message, class Predicate, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+async_response_transmit_dir(ServerSocket &socket, const String &method,
+                            const ConvertibleToPath &ipath,
+                            const Message &imessage, Message &omessage,
+                            stat_cache &cache, file_cache &contents_cache,
+                            Predicate filter, CompletionToken &&token)
+{
+    static_assert(is_server_socket<ServerSocket>::value,
+                  "ServerSocket must fulfill the ServerSocket concept");
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+    asio::async_result<Handler> result(handler);
+
+    detail::async_response_transmit_dir(socket, method, ipath, imessage,
+                                        omessage, cache, &contents_cache,
+                                        filter, handler);
+    return result.get();
+}
+
+template<class ServerSocket, class String, class ConvertibleToPath,
+         class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+async_response_transmit_dir(ServerSocket &socket, const String &method,
+                            const ConvertibleToPath &ipath,
+                            const Message &imessage, Message &omessage,
+                            stat_cache &cache, file_cache &contents_cache,
+                            CompletionToken &&token)
+{
+    static_assert(is_server_socket<ServerSocket>::value,
+                  "ServerSocket must fulfill the ServerSocket concept");
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    auto filter = [](const filesystem::path&){ return true; };
+    return async_response_transmit_dir(socket, method, ipath, imessage,
+                                       omessage, cache, contents_cache, filter,
+                                       token);
+}
+
 } // namespace http
 } // namespace boost
 
@@ -7,6 +7,7 @@
 #define BOOST_HTTP_HEADERS_HPP
 
 #include <boost/container/flat_map.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <string>
 
 namespace boost {
@@ -14,6 +15,8 @@ namespace http {
 
 typedef boost::container::flat_multimap<std::string, std::string> headers;
 
+typedef boost::container::flat_multimap<string_ref, string_ref> headers_view;
+
 } // namespace http
 } // namespace boost
 
@@ -17,7 +17,11 @@ enum class http_errc {
     native_stream_unsupported,
     parsing_error,
     buffer_exhausted,
-    wrong_direction
+    wrong_direction,
+    url_too_long,
+    headers_too_large,
+    body_too_large,
+    content_length_mismatch
 };
 
 inline boost::system::error_code make_error_code(http_errc e)
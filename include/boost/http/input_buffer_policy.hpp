@@ -0,0 +1,23 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_INPUT_BUFFER_POLICY_HPP
+#define BOOST_HTTP_INPUT_BUFFER_POLICY_HPP
+
+#include <cstddef>
+
+namespace boost {
+namespace http {
+
+struct input_buffer_policy
+{
+    std::size_t initial_size;
+    std::size_t max_size;
+};
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_INPUT_BUFFER_POLICY_HPP
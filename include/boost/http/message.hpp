@@ -40,6 +40,9 @@ private:
 
 typedef basic_message<boost::http::headers, std::vector<std::uint8_t>> message;
 
+typedef basic_message<boost::http::headers_view, std::vector<std::uint8_t>>
+message_view;
+
 template<class Headers, class Body>
 struct is_message<basic_message<Headers, Body>>: public std::true_type {};
 
@@ -0,0 +1,32 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_PIPELINED_REQUEST_HPP
+#define BOOST_HTTP_PIPELINED_REQUEST_HPP
+
+#include <string>
+
+#include <boost/http/message.hpp>
+
+namespace boost {
+namespace http {
+
+template<class String, class Message>
+struct basic_pipelined_request
+{
+    typedef String string_type;
+    typedef Message message_type;
+
+    String method;
+    String path;
+    Message message;
+};
+
+typedef basic_pipelined_request<std::string, message> pipelined_request;
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_PIPELINED_REQUEST_HPP
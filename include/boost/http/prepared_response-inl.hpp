@@ -0,0 +1,86 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+namespace boost {
+namespace http {
+
+template<class StringRef, class Message>
+prepared_response::prepared_response(std::uint_fast16_t status_code,
+                                     const StringRef &reason_phrase,
+                                     const Message &message)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    auto data = std::make_shared<data_type>();
+    std::string &bytes = data->bytes;
+
+    data->status_code = status_code;
+    data->has_connection_close
+        = detail::has_connection_close(message.headers());
+    data->has_date_header
+        = message.headers().find("date") != message.headers().end();
+
+    bytes.append("HTTP/1.1 ");
+    bytes.append(std::to_string(status_code));
+    bytes.push_back(' ');
+    bytes.append(reason_phrase.data(), reason_phrase.size());
+    bytes.append("\r\n");
+    data->status_line_size = bytes.size();
+
+    for (const auto &header: message.headers()) {
+        bytes.append(header.first.data(), header.first.size());
+        bytes.append(": ");
+        bytes.append(header.second.data(), header.second.size());
+        bytes.append("\r\n");
+    }
+    data->headers_size = bytes.size() - data->status_line_size;
+
+    bool implicit_content_length
+        = (message.headers().find("content-length") != message.headers().end())
+        || (status_code / 100 == 1) || (status_code == 204);
+
+    auto body = asio::buffer(message.body());
+
+    if (!implicit_content_length) {
+        bytes.append("content-length: ");
+        bytes.append(std::to_string(asio::buffer_size(body)));
+        bytes.append("\r\n");
+    }
+
+    bytes.append("\r\n");
+
+    if (!implicit_content_length) {
+        bytes.append(asio::buffer_cast<const char*>(body),
+                     asio::buffer_size(body));
+    }
+
+    data_ = std::move(data);
+}
+
+inline std::uint_fast16_t prepared_response::status_code() const
+{
+    return data_->status_code;
+}
+
+inline asio::const_buffer prepared_response::data() const
+{
+    return asio::buffer(data_->bytes);
+}
+
+inline asio::const_buffer prepared_response::headers() const
+{
+    return asio::buffer(data_->bytes.data() + data_->status_line_size,
+                        data_->headers_size);
+}
+
+inline asio::const_buffer prepared_response::payload() const
+{
+    return asio::buffer(data()
+                        + (data_->status_line_size + data_->headers_size));
+}
+
+} // namespace http
+} // namespace boost
@@ -0,0 +1,69 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_PREPARED_RESPONSE_HPP
+#define BOOST_HTTP_PREPARED_RESPONSE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/asio/buffer.hpp>
+
+#include <boost/http/traits.hpp>
+#include <boost/http/detail/has_connection_close.hpp>
+
+namespace boost {
+namespace http {
+
+template<class Socket>
+class basic_socket;
+
+/* A complete response serialized once and shared (it's immutable and copies
+   share the same bytes) among any number of connections and threads. */
+class prepared_response
+{
+public:
+    template<class StringRef, class Message>
+    prepared_response(std::uint_fast16_t status_code,
+                      const StringRef &reason_phrase, const Message &message);
+
+    std::uint_fast16_t status_code() const;
+
+    // The serialized HTTP/1.1 response
+    asio::const_buffer data() const;
+
+private:
+    template<class Socket>
+    friend class basic_socket;
+
+    struct data_type
+    {
+        std::uint_fast16_t status_code;
+        bool has_connection_close;
+        bool has_date_header;
+
+        /* bytes is "HTTP/1.1 NNN reason\r\n" + headers + content-length
+           header (unless implicit) + "\r\n" + body (unless implicit) */
+        std::string bytes;
+        std::size_t status_line_size;
+        std::size_t headers_size;
+    };
+
+    // [status_line_size, status_line_size + headers_size)
+    asio::const_buffer headers() const;
+
+    // content-length header + CRLF + body
+    asio::const_buffer payload() const;
+
+    std::shared_ptr<const data_type> data_;
+};
+
+} // namespace http
+} // namespace boost
+
+#include "prepared_response-inl.hpp"
+
+#endif // BOOST_HTTP_PREPARED_RESPONSE_HPP
@@ -0,0 +1,240 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_RECEIVE_BODY_TO_FILE_HPP
+#define BOOST_HTTP_RECEIVE_BODY_TO_FILE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+#include <boost/system/error_code.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <boost/http/traits.hpp>
+#include <boost/http/read_state.hpp>
+#include <boost/http/detail/native_file.hpp>
+
+/* Bodies received through a basic_socket over a plain TCP socket are moved
+   into the file with splice(2), so they never cross userspace. Define
+   BOOST_HTTP_RECEIVE_BODY_NO_SPLICE to always read them into the message body
+   instead. */
+#if defined(__linux__) && !defined(BOOST_HTTP_RECEIVE_BODY_NO_SPLICE)
+#define BOOST_HTTP_DETAIL_RECEIVE_BODY_SPLICE
+#endif
+
+namespace boost {
+namespace http {
+
+template<class Socket>
+class basic_socket;
+
+namespace detail {
+
+#ifdef BOOST_HTTP_DETAIL_RECEIVE_BODY_SPLICE
+template<class ServerSocket>
+struct use_splice
+    : public std::is_base_of<basic_socket<asio::ip::tcp::socket>, ServerSocket>
+{};
+#else
+template<class ServerSocket>
+struct use_splice: public std::false_type {};
+#endif // BOOST_HTTP_DETAIL_RECEIVE_BODY_SPLICE
+
+/* Reads the rest of the request body, writing each piece to the file as soon
+   as it lands in the message body. The part framed by "content-length" is
+   moved with splice(2) instead when use_splice holds. */
+template<class ServerSocket, class Message, class Handler>
+struct on_async_receive_body_to_file
+    : public std::enable_shared_from_this<
+        on_async_receive_body_to_file<ServerSocket, Message, Handler>>
+{
+    on_async_receive_body_to_file(ServerSocket &socket, Message &message,
+                                  Handler &&handler, native_output_file &&file)
+        : socket(socket)
+        , message(message)
+        , handler(std::move(handler))
+        , file(std::move(file))
+    {}
+
+    void process(const system::error_code &ec)
+    {
+        if (ec) {
+            complete(ec);
+            return;
+        }
+
+        auto &body = message.body();
+        if (body.size()) {
+            system::error_code write_ec;
+            file.write_at(offset, body.data(), body.size(), write_ec);
+            if (write_ec) {
+                complete(write_ec);
+                return;
+            }
+
+            offset += body.size();
+            body.clear();
+        }
+
+        auto self = this->shared_from_this();
+        switch (socket.read_state()) {
+        case read_state::message_ready:
+            if (splice(use_splice<ServerSocket>{}))
+                return;
+
+            socket.async_read_some(message,
+                                   [self](const system::error_code &ec) {
+                                       self->process(ec);
+                                   });
+            return;
+        case read_state::body_ready:
+            socket.async_read_trailers(message,
+                                       [self](const system::error_code &ec) {
+                                           self->process(ec);
+                                       });
+            return;
+        case read_state::empty:
+        case read_state::finished:
+            complete(system::error_code{});
+        }
+    }
+
+    bool splice(std::false_type)
+    {
+        return false;
+    }
+
+#ifdef BOOST_HTTP_DETAIL_RECEIVE_BODY_SPLICE
+    /* Returns false once the rest of the body must go through the socket
+       (i.e. buffered bytes, chunked framing or the last byte) */
+    bool splice(std::true_type)
+    {
+        auto &channel = socket.next_layer();
+
+        if (!socket.direct_body_size())
+            return false;
+
+        if (!switched_mode) {
+            system::error_code ec;
+            non_blocking = channel.native_non_blocking();
+            channel.native_non_blocking(true, ec);
+            if (ec)
+                return false;
+
+            switched_mode = true;
+        }
+
+        while (auto size = socket.direct_body_size()) {
+            system::error_code splice_ec;
+            auto moved = file.splice(channel.native_handle(), offset, size,
+                                     splice_ec);
+
+            if (splice_ec == asio::error::would_block) {
+                auto self = this->shared_from_this();
+                channel.async_read_some(asio::null_buffers(),
+                                        [self](const system::error_code &ec,
+                                               std::size_t) {
+                                            self->process(ec);
+                                        });
+                return true;
+            }
+
+            if (splice_ec) {
+                complete(splice_ec);
+                return true;
+            }
+
+            if (moved == 0) {
+                complete(asio::error::eof);
+                return true;
+            }
+
+            socket.consume_direct_body(moved);
+        }
+
+        return false;
+    }
+#endif // BOOST_HTTP_DETAIL_RECEIVE_BODY_SPLICE
+
+    void complete(const system::error_code &ec)
+    {
+        restore(use_splice<ServerSocket>{});
+        handler(ec, offset);
+    }
+
+    void restore(std::false_type) {}
+
+    void restore(std::true_type)
+    {
+        if (switched_mode) {
+            system::error_code ignored;
+            socket.next_layer().native_non_blocking(non_blocking, ignored);
+        }
+    }
+
+    ServerSocket &socket;
+    Message &message;
+    Handler handler;
+    native_output_file file;
+    std::uintmax_t offset = 0;
+
+    // The channel is made non-blocking for splice(2) and restored at the end
+    bool switched_mode = false;
+    bool non_blocking;
+};
+
+} // namespace detail
+
+template<class ServerSocket, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code,
+                                     std::uintmax_t)>::type>::type
+async_receive_body_to_file(ServerSocket &socket, Message &message,
+                           const filesystem::path &file,
+                           CompletionToken &&token)
+{
+    static_assert(is_server_socket<ServerSocket>::value,
+                  "ServerSocket must fulfill the ServerSocket concept");
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code, std::uintmax_t)>::type
+        Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+    asio::async_result<Handler> result(handler);
+
+    system::error_code ec;
+    detail::native_output_file output(file, ec);
+    if (ec) {
+        socket.get_io_service().post([handler,ec]() mutable {
+                handler(ec, 0);
+            });
+        return result.get();
+    }
+
+    typedef detail::on_async_receive_body_to_file<ServerSocket, Message,
+                                                  Handler> pointee;
+
+    auto loop = std::make_shared<pointee>(socket, message, std::move(handler),
+                                          std::move(output));
+
+    // the body received together with the headers is written from there
+    socket.get_io_service().post([loop]() {
+            loop->process(system::error_code{});
+        });
+
+    return result.get();
+}
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_RECEIVE_BODY_TO_FILE_HPP
@@ -0,0 +1,51 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_REQUEST_LIMITS_HPP
+#define BOOST_HTTP_REQUEST_LIMITS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef BOOST_HTTP_SOCKET_DEFAULT_MAX_URL_SIZE
+#define BOOST_HTTP_SOCKET_DEFAULT_MAX_URL_SIZE SIZE_MAX
+#endif // BOOST_HTTP_SOCKET_DEFAULT_MAX_URL_SIZE
+
+#ifndef BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS
+#define BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS SIZE_MAX
+#endif // BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS
+
+#ifndef BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS_SIZE
+#define BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS_SIZE SIZE_MAX
+#endif // BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS_SIZE
+
+#ifndef BOOST_HTTP_SOCKET_DEFAULT_MAX_BODY_SIZE
+#define BOOST_HTTP_SOCKET_DEFAULT_MAX_BODY_SIZE UINT64_MAX
+#endif // BOOST_HTTP_SOCKET_DEFAULT_MAX_BODY_SIZE
+
+namespace boost {
+namespace http {
+
+/* Nothing is limited by default (beyond what fits in the input buffer), so
+   servers opt in to each limit */
+struct request_limits
+{
+    // Bytes of the request target
+    std::size_t url_size = BOOST_HTTP_SOCKET_DEFAULT_MAX_URL_SIZE;
+
+    // Fields of the header section plus the trailers
+    std::size_t headers = BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS;
+
+    // Bytes of the names and values of the fields counted above
+    std::size_t headers_size = BOOST_HTTP_SOCKET_DEFAULT_MAX_HEADERS_SIZE;
+
+    // Bytes of the (decoded) body
+    std::uint64_t body_size = BOOST_HTTP_SOCKET_DEFAULT_MAX_BODY_SIZE;
+};
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_REQUEST_LIMITS_HPP
@@ -3,23 +3,46 @@ namespace http {
 
 namespace detail {
 
-template <class Headers>
-bool has_connection_close(const Headers &headers)
-{
-    typedef basic_string_ref<typename Headers::mapped_type::value_type>
-        string_ref_type;
-
-    auto range = headers.equal_range("connection");
-    for (; range.first != range.second ; ++range.first) {
-        if (header_value_any_of((*range.first).second,
-                                [](const string_ref_type &v) {
-                                    return iequals(v, "close");
-                                })) {
-            return true;
-        }
-    }
+// The target string has been cleared before the message was read
+template<class String>
+void set_string(String &s, const char *data, std::size_t size)
+{
+    s.append(data, size);
+}
 
-    return false;
+inline void set_string(string_ref &s, const char *data, std::size_t size)
+{
+    s = string_ref(data, size);
+}
+
+template<class Headers>
+void erase_ambiguous_expect(Headers &headers)
+{
+    auto er = headers.equal_range("expect");
+    if (std::distance(er.first, er.second) > 1)
+        headers.erase(er.first, er.second);
+}
+
+// A "content-length" value is made of digits only
+template<class String>
+bool parse_content_length(const String &value, std::uint64_t &length)
+{
+    if (value.size() == 0)
+        return false;
+
+    std::uint64_t ret = 0;
+    for (auto c: value) {
+        if (c < '0' || c > '9')
+            return false;
+
+        std::uint64_t digit = c - '0';
+        if (ret > (UINT64_MAX - digit) / 10)
+            return false;
+
+        ret = ret * 10 + digit;
+    }
+    length = ret;
+    return true;
 }
 
 } // namespace detail
@@ -54,6 +77,24 @@ asio::io_service &basic_socket<Socket>::get_io_service()
     return channel.get_io_service();
 }
 
+template<class Socket>
+std::size_t basic_socket<Socket>::pipelined_flush_threshold() const
+{
+    return flush_threshold;
+}
+
+template<class Socket>
+bool basic_socket<Socket>::date_header() const
+{
+    return dates;
+}
+
+template<class Socket>
+const request_limits &basic_socket<Socket>::limits() const
+{
+    return limits_;
+}
+
 template<class Socket>
 template<class String, class Message, class CompletionToken>
 typename asio::async_result<
@@ -73,7 +114,7 @@ basic_socket<Socket>
 
     asio::async_result<Handler> result(handler);
 
-    if (istate != http::read_state::empty) {
+    if (istate != http::read_state::empty || pending_responses()) {
         invoke_handler(std::forward<decltype(handler)>(handler),
                        http_errc::out_of_order);
         return result.get();
@@ -81,12 +122,65 @@ basic_socket<Socket>
 
     method.clear();
     path.clear();
+    release_idle_input();
+    pipelined_read = false;
+    pipelined.clear();
     writer_helper = http::write_state::finished;
     schedule_on_async_read_message<READY>(handler, message, &method, &path);
 
     return result.get();
 }
 
+template<class Socket>
+template<class Queue, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code, std::size_t)>::type>
+::type
+basic_socket<Socket>::async_read_requests(Queue &queue, CompletionToken &&token)
+{
+    typedef typename Queue::value_type request_type;
+    typedef decltype(std::declval<request_type&>().message) Message;
+
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code, std::size_t)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+
+    asio::async_result<Handler> result(handler);
+
+    if (istate != http::read_state::empty || pending_responses()) {
+        channel.get_io_service().post([handler]() mutable {
+            handler(system::error_code{http_errc::out_of_order}, 0);
+        });
+        return result.get();
+    }
+
+    release_idle_input();
+    pipelined_read = true;
+    pipelined.clear();
+    writer_helper = http::write_state::finished;
+
+    if (buffer.size()) {
+        // Have cached some bytes from a previous read
+        on_async_read_requests(std::move(handler), queue, false,
+                               system::error_code{}, 0);
+    } else {
+        // TODO (C++14): move in lambda capture list
+        read_input([this,handler,&queue](const system::error_code &ec,
+                                         std::size_t bytes_transferred)
+                   mutable {
+            on_async_read_requests(std::move(handler), queue, false, ec,
+                                   bytes_transferred);
+        }, detail::can_wait_readable<Socket>{});
+    }
+
+    return result.get();
+}
+
 template<class Socket>
 template<class Message, class CompletionToken>
 typename asio::async_result<
@@ -115,6 +209,82 @@ basic_socket<Socket>::async_read_some(Message &message, CompletionToken &&token)
     return result.get();
 }
 
+template<class Socket>
+template<class MutableBufferSequence, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code, std::size_t)>::type>
+::type
+basic_socket<Socket>::async_read_some(const MutableBufferSequence &buffers,
+                                      Message &message, CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code, std::size_t)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+
+    asio::async_result<Handler> result(handler);
+
+    if (istate != http::read_state::message_ready) {
+        channel.get_io_service().post([handler]() mutable {
+            handler(system::error_code{http_errc::out_of_order}, 0);
+        });
+        return result.get();
+    }
+
+    sink.buffers.clear();
+    sink.next = 0;
+    sink.size = 0;
+    sink.transferred = 0;
+    for (auto it = buffers.begin() ; it != buffers.end() ; ++it) {
+        asio::mutable_buffer piece(*it);
+        if (asio::buffer_size(piece) == 0)
+            continue;
+
+        sink.size += asio::buffer_size(piece);
+        sink.buffers.push_back(piece);
+    }
+
+    if (sink.size == 0) {
+        channel.get_io_service().post([handler]() mutable {
+            handler(system::error_code{}, 0);
+        });
+        return result.get();
+    }
+
+    sink.active = true;
+    auto on_read = [this,handler](const system::error_code &ec) mutable {
+        auto transferred = sink.transferred;
+        sink.active = false;
+        handler(ec, transferred);
+    };
+
+    if (buffer.size() || !detail::body_is_identity(parser)) {
+        schedule_on_async_read_message<DATA>(on_read, message);
+        return result.get();
+    }
+
+    /* Nothing is buffered and the next bytes are body bytes, so they're read
+       straight into the caller storage and the parser is run over them. The
+       read can't go past the body, or the next message would land there. */
+    auto target = sink.buffers[sink.next];
+    if (asio::buffer_size(target) > parser.content_length)
+        target = asio::buffer(target, parser.content_length);
+
+    // TODO (C++14): move in lambda capture list
+    channel.async_read_some(asio::buffer(target),
+                            [this,on_read,&message]
+                            (const system::error_code &ec,
+                             std::size_t bytes_transferred) mutable {
+        on_async_read_body(std::move(on_read), message, ec, bytes_transferred);
+    });
+
+    return result.get();
+}
+
 template<class Socket>
 template<class Message, class CompletionToken>
 typename asio::async_result<
@@ -157,6 +327,24 @@ basic_socket<Socket>
     static_assert(is_message<Message>::value,
                   "Message must fulfill the Message concept");
 
+    return async_write_response(status_code, reason_phrase, message,
+                                asio::const_buffer(asio::buffer(message.body())),
+                                std::forward<CompletionToken>(token));
+}
+
+template<class Socket>
+template<class StringRef, class Message, class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_socket<Socket>
+::async_write_response(std::uint_fast16_t status_code,
+                       const StringRef &reason_phrase, const Message &message,
+                       asio::const_buffer body, CompletionToken &&token)
+{
+    static_assert(is_message<Message>::value,
+                  "Message must fulfill the Message concept");
+
     using detail::string_literal_buffer;
     typedef typename asio::handler_type<
         CompletionToken, void(system::error_code)>::type Handler;
@@ -184,71 +372,97 @@ basic_socket<Socket>
     auto use_connection_close_buf = ((flags & KEEP_ALIVE) == 0)
         && !has_connection_close;
 
-    // because we don't create multiple responses at once with HTTP/1.1
-    // pipelining, it's safe to use this "shared state"
-    content_length_buffer = std::to_string(status_code) + ' ';
-    std::string::size_type content_length_delim = content_length_buffer.size();
-
-    // because we don't create multiple responses at once with HTTP/1.1
-    // pipelining, it's safe to use this "shared state"
-    content_length_buffer += std::to_string(message.body().size());
-
-    const auto nbuffer_pieces =
-        // Start line (http version + status code + reason phrase) + CRLF
-        4
-        // Headers
-        // If user didn't provided "connection: close"
-        + (use_connection_close_buf ? 1 : 0)
-        // Each header is 4 buffer pieces: key + sep + value + crlf
-        + 4 * message.headers().size()
-        // Extra content-length header uses 3 pieces
-        + (implicit_content_length ? 0 : 3)
-        // Extra CRLF for end of headers
-        + 1
-        // And finally, the message body
-        + (implicit_content_length ? 0 : 1);
-
-    // TODO (C++14): replace by dynarray
-    std::vector<asio::const_buffer> buffers;
-    buffers.reserve(nbuffer_pieces);
-
-    buffers.push_back((flags & HTTP_1_1) ? string_literal_buffer("HTTP/1.1 ")
-                      : string_literal_buffer("HTTP/1.0 "));
-    buffers.push_back(asio::buffer(content_length_buffer.data(),
-                                   content_length_delim));
-    buffers.push_back(asio::buffer(reason_phrase.data(), reason_phrase.size()));
-    buffers.push_back(crlf);
+    output->clear();
+
+    detail::push_status_line_prefix(*output, flags & HTTP_1_1, status_code);
+    output->push_back(asio::buffer(reason_phrase.data(), reason_phrase.size()));
+    output->push_back(crlf);
 
     if (use_connection_close_buf)
-        buffers.push_back(string_literal_buffer("connection: close\r\n"));
+        output->push_back(string_literal_buffer("connection: close\r\n"));
+
+    if (dates && message.headers().find("date") == message.headers().end())
+        push_date_header();
 
     for (const auto &header: message.headers()) {
-        buffers.push_back(asio::buffer(header.first));
-        buffers.push_back(sep);
-        buffers.push_back(asio::buffer(header.second));
-        buffers.push_back(crlf);
+        output->push_back(asio::buffer(header.first.data(),
+                                      header.first.size()));
+        output->push_back(sep);
+        output->push_back(asio::buffer(header.second.data(),
+                                      header.second.size()));
+        output->push_back(crlf);
     }
 
     if (!implicit_content_length) {
-        buffers.push_back(string_literal_buffer("content-length: "));
-        buffers.push_back(asio::buffer(content_length_buffer.data()
-                                       + content_length_delim,
-                                       content_length_buffer.size()
-                                       - content_length_delim));
-        buffers.push_back(crlf);
+        output->push_back(string_literal_buffer("content-length: "));
+        output->push_decimal(asio::buffer_size(body));
+        output->push_back(crlf);
     }
 
-    buffers.push_back(crlf);
+    output->push_back(crlf);
 
     if (!implicit_content_length)
-        buffers.push_back(asio::buffer(message.body()));
+        output->push_back(body);
 
-    asio::async_write(channel, buffers,
-                      [handler,this]
-                      (const system::error_code &ec, std::size_t) mutable {
-        is_open_ = flags & KEEP_ALIVE;
-        if (!is_open_)
-            channel.close();
+    write_response(std::forward<decltype(handler)>(handler));
+
+    return result.get();
+}
+
+template<class Socket>
+template<class CompletionToken>
+typename asio::async_result<
+    typename asio::handler_type<CompletionToken,
+                                void(system::error_code)>::type>::type
+basic_socket<Socket>
+::async_write_response(const prepared_response &response,
+                       CompletionToken &&token)
+{
+    using detail::string_literal_buffer;
+    typedef typename asio::handler_type<
+        CompletionToken, void(system::error_code)>::type Handler;
+
+    Handler handler(std::forward<CompletionToken>(token));
+    asio::async_result<Handler> result(handler);
+
+    if (!writer_helper.write_message()) {
+        invoke_handler(std::forward<decltype(handler)>(handler),
+                       http_errc::out_of_order);
+        return result.get();
+    }
+
+    const auto &data = *response.data_;
+
+    if (data.has_connection_close)
+        flags &= ~KEEP_ALIVE;
+
+    auto use_connection_close_buf = ((flags & KEEP_ALIVE) == 0)
+        && !data.has_connection_close;
+
+    output->clear();
+
+    // The stored status line always starts with "HTTP/1.1 "
+    output->push_back((flags & HTTP_1_1) ? string_literal_buffer("HTTP/1.1 ")
+                     : string_literal_buffer("HTTP/1.0 "));
+    output->push_back(asio::buffer(data.bytes.data() + 9,
+                                  data.status_line_size - 9));
+
+    if (use_connection_close_buf)
+        output->push_back(string_literal_buffer("connection: close\r\n"));
+
+    if (dates && !data.has_date_header)
+        push_date_header();
+
+    output->push_back(response.headers());
+
+    // A successful response to CONNECT has no payload
+    if (connect_request && (data.status_code / 100 == 2))
+        output->push_back(string_literal_buffer("\r\n"));
+    else
+        output->push_back(response.payload());
+
+    // The bytes must outlive the write operation
+    write_response([handler,response](const system::error_code &ec) mutable {
         handler(ec);
     });
 
@@ -276,11 +490,12 @@ basic_socket<Socket>
         return result.get();
     }
 
-    asio::async_write(channel,
-                      detail::string_literal_buffer("HTTP/1.1 100"
-                                                    " Continue\r\n\r\n"),
-                      [handler]
-                      (const system::error_code &ec, std::size_t) mutable {
+    output->clear();
+    output->push_back(detail::string_literal_buffer("HTTP/1.1 100"
+                                                   " Continue\r\n\r\n"));
+
+    write_output([handler]
+                 (const system::error_code &ec, std::size_t) mutable {
         handler(ec);
     });
 
@@ -316,12 +531,28 @@ basic_socket<Socket>
             return result.get();
         }
 
-        if ((flags & HTTP_1_1) == 0) {
+        auto content_length = message.headers().find("content-length");
+
+        /* HTTP/1.0 has no chunked transfer coding, but a body delimited by
+           "content-length" can still be written in pieces */
+        if ((flags & HTTP_1_1) == 0
+            && content_length == message.headers().end()) {
             writer_helper = prev;
             invoke_handler(std::forward<decltype(handler)>(handler),
                            http_errc::native_stream_unsupported);
             return result.get();
         }
+
+        response_status = status_code;
+        content_length_framing = content_length != message.headers().end();
+        if (content_length_framing
+            && !detail::parse_content_length(content_length->second,
+                                             content_length_left)) {
+            writer_helper = prev;
+            invoke_handler(std::forward<decltype(handler)>(handler),
+                           http_errc::content_length_mismatch);
+            return result.get();
+        }
     }
 
     auto crlf = string_literal_buffer("\r\n");
@@ -334,47 +565,35 @@ basic_socket<Socket>
     auto use_connection_close_buf = ((flags & KEEP_ALIVE) == 0)
         && !has_connection_close;
 
-    // because we don't create multiple responses at once with HTTP/1.1
-    // pipelining, it's safe to use this "shared state"
-    content_length_buffer = std::to_string(status_code) + ' ';
-
-    const auto nbuffer_pieces =
-        // Start line (http version + status code + reason phrase) + CRLF
-        4
-        // Headers
-        // If user didn't provided "connection: close"
-        + (use_connection_close_buf ? 1 : 0)
-        // Each header is 4 buffer pieces: key + sep + value + crlf
-        + 4 * message.headers().size()
-        // Extra transfer-encoding header and extra CRLF for end of headers
-        + 1;
-
-    // TODO (C++14): replace by dynarray
-    std::vector<asio::const_buffer> buffers;
-    buffers.reserve(nbuffer_pieces);
-
-    buffers.push_back((flags & HTTP_1_1) ? string_literal_buffer("HTTP/1.1 ")
-                      : string_literal_buffer("HTTP/1.0 "));
-    buffers.push_back(asio::buffer(content_length_buffer));
-    buffers.push_back(asio::buffer(reason_phrase.data(), reason_phrase.size()));
-    buffers.push_back(crlf);
+    output->clear();
+
+    detail::push_status_line_prefix(*output, flags & HTTP_1_1, status_code);
+    output->push_back(asio::buffer(reason_phrase.data(), reason_phrase.size()));
+    output->push_back(crlf);
 
     if (use_connection_close_buf)
-        buffers.push_back(string_literal_buffer("connection: close\r\n"));
+        output->push_back(string_literal_buffer("connection: close\r\n"));
+
+    if (dates && message.headers().find("date") == message.headers().end())
+        push_date_header();
 
     for (const auto &header: message.headers()) {
-        buffers.push_back(asio::buffer(header.first));
-        buffers.push_back(sep);
-        buffers.push_back(asio::buffer(header.second));
-        buffers.push_back(crlf);
+        output->push_back(asio::buffer(header.first.data(),
+                                      header.first.size()));
+        output->push_back(sep);
+        output->push_back(asio::buffer(header.second.data(),
+                                      header.second.size()));
+        output->push_back(crlf);
     }
 
-    buffers.push_back(string_literal_buffer("transfer-encoding: chunked\r\n"
-                                            "\r\n"));
+    if (content_length_framing)
+        output->push_back(crlf);
+    else
+        output->push_back(string_literal_buffer("transfer-encoding: chunked\r\n"
+                                               "\r\n"));
 
-    asio::async_write(channel, buffers,
-                      [handler]
-                      (const system::error_code &ec, std::size_t) mutable {
+    write_output([handler]
+                 (const system::error_code &ec, std::size_t) mutable {
         handler(ec);
     });
 
@@ -411,26 +630,29 @@ basic_socket<Socket>::async_write(const Message &message,
         return result.get();
     }
 
+    if (content_length_framing) {
+        if (message.body().size() > content_length_left) {
+            invoke_handler(std::forward<decltype(handler)>(handler),
+                           http_errc::content_length_mismatch);
+            return result.get();
+        }
+        content_length_left -= message.body().size();
+    }
+
     auto crlf = string_literal_buffer("\r\n");
 
-    {
-        std::ostringstream ostr;
-        ostr << std::hex << message.body().size();
-        // because we don't create multiple responses at once with HTTP/1.1
-        // pipelining, it's safe to use this "shared state"
-        content_length_buffer = ostr.str();
-    }
-
-    std::array<boost::asio::const_buffer, 4> buffers = {
-        asio::buffer(content_length_buffer),
-        crlf,
-        asio::buffer(message.body()),
-        crlf
-    };
+    output->clear();
+    if (content_length_framing) {
+        output->push_back(asio::buffer(message.body()));
+    } else {
+        output->push_hex(message.body().size());
+        output->push_back(crlf);
+        output->push_back(asio::buffer(message.body()));
+        output->push_back(crlf);
+    }
 
-    asio::async_write(channel, buffers,
-                      [handler]
-                      (const system::error_code &ec, std::size_t) mutable {
+    write_output([handler]
+                 (const system::error_code &ec, std::size_t) mutable {
         handler(ec);
     });
 
@@ -456,6 +678,14 @@ basic_socket<Socket>::async_write_trailers(const Message &message,
 
     asio::async_result<Handler> result(handler);
 
+    // Without chunked encoding, there is nowhere to put the trailers
+    if (content_length_framing
+        && writer_helper.state == http::write_state::metadata_issued) {
+        invoke_handler(std::forward<decltype(handler)>(handler),
+                       http_errc::content_length_mismatch);
+        return result.get();
+    }
+
     if (!writer_helper.write_trailers()) {
         invoke_handler(std::forward<decltype(handler)>(handler),
                        http_errc::out_of_order);
@@ -466,34 +696,26 @@ basic_socket<Socket>::async_write_trailers(const Message &message,
     auto crlf = string_literal_buffer("\r\n");
     auto sep = string_literal_buffer(": ");
 
-    const auto nbuffer_pieces =
-        // last_chunk
-        1
-        // Trailers
-        // Each header is 4 buffer pieces: key + sep + value + crlf
-        + 4 * message.trailers().size()
-        // Final CRLF for end of trailers
-        + 1;
-
-    // TODO (C++14): replace by dynarray
-    std::vector<asio::const_buffer> buffers;
-    buffers.reserve(nbuffer_pieces);
-
-    buffers.push_back(last_chunk);
+    output->clear();
+    output->push_back(last_chunk);
 
     for (const auto &header: message.trailers()) {
-        buffers.push_back(asio::buffer(header.first));
-        buffers.push_back(sep);
-        buffers.push_back(asio::buffer(header.second));
-        buffers.push_back(crlf);
+        output->push_back(asio::buffer(header.first.data(),
+                                      header.first.size()));
+        output->push_back(sep);
+        output->push_back(asio::buffer(header.second.data(),
+                                      header.second.size()));
+        output->push_back(crlf);
     }
 
-    buffers.push_back(crlf);
+    output->push_back(crlf);
+
+    bool keep_alive = flags & KEEP_ALIVE;
+    next_pipelined_response(keep_alive);
 
-    asio::async_write(channel, buffers,
-                      [handler,this]
-                      (const system::error_code &ec, std::size_t) mutable {
-        is_open_ = flags & KEEP_ALIVE;
+    write_output([handler,this,keep_alive]
+                 (const system::error_code &ec, std::size_t) mutable {
+        is_open_ = keep_alive;
         if (!is_open_)
             channel.close();
         handler(ec);
@@ -518,18 +740,30 @@ basic_socket<Socket>
 
     asio::async_result<Handler> result(handler);
 
+    if (content_length_framing && content_length_left != 0
+        && writer_helper.state == http::write_state::metadata_issued
+        && response_has_body()) {
+        invoke_handler(std::forward<decltype(handler)>(handler),
+                       http_errc::content_length_mismatch);
+        return result.get();
+    }
+
     if (!writer_helper.end()) {
         invoke_handler(std::forward<decltype(handler)>(handler),
                        http_errc::out_of_order);
         return result.get();
     }
 
-    auto last_chunk = string_literal_buffer("0\r\n\r\n");
+    output->clear();
+    if (!content_length_framing)
+        output->push_back(string_literal_buffer("0\r\n\r\n"));
 
-    asio::async_write(channel, last_chunk,
-                      [handler,this]
-                      (const system::error_code &ec, std::size_t) mutable {
-        is_open_ = flags & KEEP_ALIVE;
+    bool keep_alive = flags & KEEP_ALIVE;
+    next_pipelined_response(keep_alive);
+
+    write_output([handler,this,keep_alive]
+                 (const system::error_code &ec, std::size_t) mutable {
+        is_open_ = keep_alive;
         if (!is_open_)
             channel.close();
         handler(ec);
@@ -547,7 +781,7 @@ basic_socket<Socket>
     buffer(inbuffer),
     writer_helper(http::write_state::empty)
 {
-    if (asio::buffer_size(buffer) == 0)
+    if (asio::buffer_size(inbuffer) == 0)
         throw std::invalid_argument("buffers must not be 0-sized");
 
     detail::init(parser);
@@ -563,13 +797,45 @@ basic_socket<Socket>
     , buffer(inbuffer)
     , writer_helper(http::write_state::empty)
 {
-    if (asio::buffer_size(buffer) == 0)
+    if (asio::buffer_size(inbuffer) == 0)
         throw std::invalid_argument("buffers must not be 0-sized");
 
     detail::init(parser);
     parser.data = this;
 }
 
+template<class Socket>
+basic_socket<Socket>
+::basic_socket(boost::asio::io_service &io_service,
+               input_buffer_policy policy) :
+    channel(io_service),
+    istate(http::read_state::empty),
+    buffer(policy),
+    writer_helper(http::write_state::empty)
+{
+    if (policy.initial_size == 0 || policy.initial_size > policy.max_size)
+        throw std::invalid_argument("invalid input buffer policy");
+
+    detail::init(parser);
+    parser.data = this;
+}
+
+template<class Socket>
+template<class... Args>
+basic_socket<Socket>
+::basic_socket(input_buffer_policy policy, Args&&... args)
+    : channel(std::forward<Args>(args)...)
+    , istate(http::read_state::empty)
+    , buffer(policy)
+    , writer_helper(http::write_state::empty)
+{
+    if (policy.initial_size == 0 || policy.initial_size > policy.max_size)
+        throw std::invalid_argument("invalid input buffer policy");
+
+    detail::init(parser);
+    parser.data = this;
+}
+
 template<class Socket>
 Socket &basic_socket<Socket>::next_layer()
 {
@@ -588,25 +854,101 @@ void basic_socket<Socket>::open()
     is_open_ = true;
 }
 
+template<class Socket>
+void basic_socket<Socket>::set_pipelined_flush_threshold(std::size_t bytes)
+{
+    flush_threshold = bytes;
+}
+
+template<class Socket>
+void basic_socket<Socket>::set_date_header(bool enable)
+{
+    dates = enable ? &asio::use_service<date_cache>(channel.get_io_service())
+        : nullptr;
+}
+
+template<class Socket>
+void basic_socket<Socket>::set_limits(request_limits limits)
+{
+    limits_ = limits;
+}
+
+template<class Socket>
+std::uint64_t basic_socket<Socket>::direct_body_size() const
+{
+    if (istate != http::read_state::message_ready || buffer.size()
+        || !detail::body_is_identity(parser)) {
+        return 0;
+    }
+
+    return parser.content_length - 1;
+}
+
+template<class Socket>
+void basic_socket<Socket>::consume_direct_body(std::uint64_t n)
+{
+    BOOST_ASSERT(n <= direct_body_size());
+
+    // The parser never looks at the bytes of such a body, only at their count
+    parser.content_length -= n;
+}
+
+template<class Socket>
+void basic_socket<Socket>::release_idle_input()
+{
+    if (detail::can_wait_readable<Socket>::value)
+        buffer.release_idle();
+    else
+        buffer.shrink();
+}
+
+template<class Socket>
+template<class Handler>
+void basic_socket<Socket>::read_input(Handler handler, std::false_type)
+{
+    channel.async_read_some(buffer.prepare(), std::move(handler));
+}
+
+template<class Socket>
+template<class Handler>
+void basic_socket<Socket>::read_input(Handler handler, std::true_type)
+{
+    if (buffer.capacity()) {
+        read_input(std::move(handler), std::false_type{});
+        return;
+    }
+
+    // TODO (C++14): move in lambda capture list
+    channel.async_read_some(asio::null_buffers(),
+                            [this,handler](const system::error_code &ec,
+                                           std::size_t) mutable {
+        if (ec) {
+            handler(ec, 0);
+            return;
+        }
+
+        channel.async_read_some(buffer.prepare(), std::move(handler));
+    });
+}
+
 template<class Socket>
 template<int target, class Message, class Handler, class String>
 void basic_socket<Socket>
 ::schedule_on_async_read_message(Handler &handler, Message &message,
                                  String *method, String *path)
 {
-    if (used_size) {
+    if (buffer.size()) {
         // Have cached some bytes from a previous read
         on_async_read_message<target>(std::move(handler), method, path, message,
                                          system::error_code{}, 0);
     } else {
         // TODO (C++14): move in lambda capture list
-        channel.async_read_some(asio::buffer(buffer + used_size),
-                                [this,handler,method,path,&message]
-                                (const system::error_code &ec,
-                                 std::size_t bytes_transferred) mutable {
+        read_input([this,handler,method,path,&message]
+                   (const system::error_code &ec,
+                    std::size_t bytes_transferred) mutable {
             on_async_read_message<target>(std::move(handler), method, path,
                                           message, ec, bytes_transferred);
-        });
+        }, detail::can_wait_readable<Socket>{});
     }
 }
 
@@ -617,51 +959,50 @@ void basic_socket<Socket>
                         Message &message, const system::error_code &ec,
                         std::size_t bytes_transferred)
 {
-    using detail::string_literal_buffer;
-
     if (ec) {
         clear_buffer();
         handler(ec);
         return;
     }
 
-    used_size += bytes_transferred;
+    buffer.commit(bytes_transferred);
     current_method = reinterpret_cast<void*>(method);
     current_path = reinterpret_cast<void*>(path);
     current_message = reinterpret_cast<void*>(&message);
-    auto nparsed = detail::execute(parser, settings<Message, String>(),
-                                   asio::buffer_cast<const std::uint8_t*>
-                                   (buffer),
-                                   used_size);
 
-    if (parser.http_errno) {
-        system::error_code ignored_ec;
+    std::size_t nparsed;
+    for (;;) {
+        /* A body read into caller buffers is fed in steps no larger than the
+           room left, so on_body never gets more than what fits. Steps made
+           only of chunked framing deliver nothing and are followed by the next
+           one. */
+        auto size = sink.active ? std::min(buffer.size(), sink.size)
+            : buffer.size();
+        nparsed = detail::execute(parser, settings<Message, String>(),
+                                  buffer.data(), size);
+
+        if (!sink.active || parser.http_errno || (flags & (DATA|END))
+            || nparsed == buffer.size()) {
+            break;
+        }
 
-        if (parser.http_errno
+        buffer.consume(nparsed);
+    }
+
+    if (parser.http_errno) {
+        if (limit_error || parser.http_errno
             == int(detail::parser_error::cb_headers_complete)) {
-            clear_buffer();
             clear_message(message);
-
-            auto error_message
-                = string_literal_buffer("HTTP/1.1 505 HTTP Version Not"
-                                        " Supported\r\n"
-                                        "Content-Length: 48\r\n"
-                                        "Connection: close\r\n"
-                                        "\r\n"
-                                        "This server only supports HTTP/1.0 and"
-                                        " HTTP/1.1\n");
-            asio::async_write(channel, asio::buffer(error_message),
-                              [this,handler](system::error_code /*ignored_ec*/,
-                                             std::size_t /*bytes_transferred*/)
-                              mutable {
-                handler(system::error_code{http_errc::parsing_error});
-            });
+            write_error_response(std::move(handler));
             return;
         } else if (parser.http_errno
                    == int(detail::parser_error::cb_message_complete)) {
             /* After an error is set, http_parser enter in an invalid state
-               and needs to be reset. */
-            detail::init(parser);
+               and needs to be reset (or resumed). */
+            if ((flags & KEEP_ALIVE) && !(flags & UPGRADE))
+                detail::resume(parser);
+            else
+                detail::init(parser);
         } else {
             clear_buffer();
             handler(system::error_code(http_errc::parsing_error));
@@ -669,12 +1010,7 @@ void basic_socket<Socket>
         }
     }
 
-    {
-        auto b = asio::buffer_cast<std::uint8_t*>(buffer);
-        std::copy_n(b + nparsed, used_size - nparsed, b);
-    }
-
-    used_size -= nparsed;
+    buffer.consume(nparsed);
 
     if (target == READY && flags & READY) {
         flags &= ~READY;
@@ -686,13 +1022,13 @@ void basic_socket<Socket>
         flags &= ~(READY|DATA|END);
         handler(system::error_code{});
     } else {
-        if (used_size == asio::buffer_size(buffer)) {
+        if (buffer.full()) {
             handler(system::error_code{http_errc::buffer_exhausted});
             return;
         }
 
         // TODO (C++14): move in lambda capture list
-        channel.async_read_some(asio::buffer(buffer + used_size),
+        channel.async_read_some(buffer.prepare(),
                                 [this,handler,method,path,&message]
                                 (const system::error_code &ec,
                                  std::size_t bytes_transferred) mutable {
@@ -702,6 +1038,423 @@ void basic_socket<Socket>
     }
 }
 
+template<class Socket>
+template<class Message, class Handler>
+void basic_socket<Socket>
+::on_async_read_body(Handler handler, Message &message,
+                     const system::error_code &ec,
+                     std::size_t bytes_transferred)
+{
+    if (ec) {
+        clear_buffer();
+        handler(ec);
+        return;
+    }
+
+    // on_body recognizes the bytes are already in place
+    current_message = reinterpret_cast<void*>(&message);
+    detail::execute(parser, settings<Message, std::string>(),
+                    asio::buffer_cast<const std::uint8_t*>
+                    (sink.buffers[sink.next]),
+                    bytes_transferred);
+
+    if (parser.http_errno) {
+        if (limit_error) {
+            write_error_response(std::move(handler));
+            return;
+        }
+
+        if (parser.http_errno
+            != int(detail::parser_error::cb_message_complete)) {
+            clear_buffer();
+            handler(system::error_code(http_errc::parsing_error));
+            return;
+        }
+
+        if ((flags & KEEP_ALIVE) && !(flags & UPGRADE))
+            detail::resume(parser);
+        else
+            detail::init(parser);
+    }
+
+    flags &= ~(READY|DATA);
+    handler(system::error_code{});
+}
+
+template<class Socket>
+template<class Queue, class Handler>
+void basic_socket<Socket>
+::on_async_read_requests(Handler handler, Queue &queue, bool started,
+                         const system::error_code &ec,
+                         std::size_t bytes_transferred)
+{
+    typedef typename Queue::value_type request_type;
+    typedef decltype(std::declval<request_type&>().method) String;
+    typedef decltype(std::declval<request_type&>().message) Message;
+
+    if (ec) {
+        if (started)
+            queue.pop_back();
+        clear_buffer();
+        handler(ec, 0);
+        return;
+    }
+
+    buffer.commit(bytes_transferred);
+
+    const auto parser_settings = settings<Message, String>();
+    std::size_t count = 0;
+
+    /* Only the first message of the batch may span several reads. Any other
+       message is parsed from a checkpoint, so an incomplete message at the end
+       of the buffer can be left untouched for the next call. */
+    while (started || buffer.size()) {
+        const auto saved_parser = parser;
+        const auto saved_flags = flags;
+        const auto saved_istate = istate;
+        const auto saved_writer_helper = writer_helper;
+        const auto saved_use_trailers = use_trailers;
+        const auto saved_connect_request = connect_request;
+        const auto saved_head_request = head_request;
+
+        auto rollback = [&]() {
+            parser = saved_parser;
+            flags = saved_flags;
+            istate = saved_istate;
+            writer_helper = saved_writer_helper;
+            use_trailers = saved_use_trailers;
+            connect_request = saved_connect_request;
+            head_request = saved_head_request;
+            last_header.first.clear();
+            last_header.second.clear();
+            header_views.clear();
+            header_section_views = 0;
+            limit_error.clear();
+            buffer.unpin();
+            queue.pop_back();
+        };
+
+        if (!started) {
+            queue.emplace_back();
+            started = true;
+        }
+
+        auto &request = queue.back();
+        current_method = reinterpret_cast<void*>(&request.method);
+        current_path = reinterpret_cast<void*>(&request.path);
+        current_message = reinterpret_cast<void*>(&request.message);
+        auto nparsed = detail::execute(parser, parser_settings, buffer.data(),
+                                       buffer.size());
+
+        if (parser.http_errno
+            == int(detail::parser_error::cb_message_complete)) {
+            if ((flags & KEEP_ALIVE) && !(flags & UPGRADE))
+                detail::resume(parser);
+            else
+                detail::init(parser);
+        } else if (parser.http_errno) {
+            if (count) {
+                // The error will be reported by the next call
+                rollback();
+                break;
+            }
+
+            queue.pop_back();
+            clear_buffer();
+
+            if (limit_error || parser.http_errno
+                == int(detail::parser_error::cb_headers_complete)) {
+                write_error_response([handler](const system::error_code &ec)
+                                     mutable {
+                    handler(ec, 0);
+                });
+                return;
+            }
+
+            handler(system::error_code{http_errc::parsing_error}, 0);
+            return;
+        }
+
+        if (flags & END) {
+            buffer.consume(nparsed);
+            started = false;
+            pipelined.push_back(pipelined_state{flags, connect_request,
+                                                head_request});
+            ++count;
+
+            // Whatever comes next doesn't belong to this batch
+            if (!(flags & KEEP_ALIVE) || (flags & UPGRADE) || connect_request)
+                break;
+
+            continue;
+        }
+
+        if (count) {
+            rollback();
+            break;
+        }
+
+        buffer.consume(nparsed);
+
+        if (buffer.full()) {
+            queue.pop_back();
+            handler(system::error_code{http_errc::buffer_exhausted}, 0);
+            return;
+        }
+
+        // TODO (C++14): move in lambda capture list
+        channel.async_read_some(buffer.prepare(),
+                                [this,handler,&queue]
+                                (const system::error_code &ec,
+                                 std::size_t bytes_transferred) mutable {
+            on_async_read_requests(std::move(handler), queue, true, ec,
+                                   bytes_transferred);
+        });
+        return;
+    }
+
+    if (count == 0) {
+        // TODO (C++14): move in lambda capture list
+        channel.async_read_some(buffer.prepare(),
+                                [this,handler,&queue]
+                                (const system::error_code &ec,
+                                 std::size_t bytes_transferred) mutable {
+            on_async_read_requests(std::move(handler), queue, false, ec,
+                                   bytes_transferred);
+        });
+        return;
+    }
+
+    // Responses follow the order of the requests
+    flags = pipelined.front().flags;
+    connect_request = pipelined.front().connect_request;
+    head_request = pipelined.front().head_request;
+    next_pipelined = 1;
+    writer_helper = http::write_state::empty;
+    handler(system::error_code{}, count);
+}
+
+template<class Socket>
+bool basic_socket<Socket>::pending_responses() const
+{
+    return next_pipelined < pipelined.size() || !queued_responses.empty()
+        || (pipelined.size()
+            && writer_helper.state != http::write_state::finished);
+}
+
+template<class Socket>
+void basic_socket<Socket>::next_pipelined_response(bool keep_alive)
+{
+    if (next_pipelined >= pipelined.size())
+        return;
+
+    if (!keep_alive) {
+        pipelined.clear();
+        return;
+    }
+
+    const auto &state = pipelined[next_pipelined++];
+    flags = state.flags;
+    connect_request = state.connect_request;
+    head_request = state.head_request;
+    writer_helper = http::write_state::empty;
+}
+
+template<class Socket>
+bool basic_socket<Socket>::response_has_body() const
+{
+    return !head_request && response_status / 100 != 1
+        && response_status != 204 && response_status != 304;
+}
+
+template<class Socket>
+void basic_socket<Socket>::consume_content_length(std::uint64_t n)
+{
+    content_length_left -= std::min(n, content_length_left);
+}
+
+template<class Socket>
+template<class Handler>
+void basic_socket<Socket>::write_response(Handler &&handler)
+{
+    bool keep_alive = flags & KEEP_ALIVE;
+    bool more_responses = next_pipelined < pipelined.size();
+    next_pipelined_response(keep_alive);
+
+    if (keep_alive && more_responses
+        && (queued_responses.size() + asio::buffer_size(output->sequence())
+            <= flush_threshold)) {
+        // The handler is only called once the response is actually written
+        queued_responses.push(*output, std::forward<Handler>(handler));
+        schedule_flush();
+        return;
+    }
+
+    write_output([handler,this,keep_alive]
+                 (const system::error_code &ec, std::size_t) mutable {
+        is_open_ = keep_alive;
+        if (!is_open_)
+            channel.close();
+        handler(ec);
+    });
+}
+
+template<class Socket>
+void basic_socket<Socket>::push_date_header()
+{
+    char line[6 + date_cache::size + 2];
+    std::memcpy(line, "date: ", 6);
+    dates->now(line + 6);
+    std::memcpy(line + 6 + date_cache::size, "\r\n", 2);
+    output->push_copy(line, sizeof(line));
+}
+
+template<class Socket>
+template<class Handler>
+void basic_socket<Socket>::write_error_response(Handler handler)
+{
+    using detail::string_literal_buffer;
+
+    auto ec = limit_error ? limit_error
+        : system::error_code{http_errc::parsing_error};
+    limit_error.clear();
+
+    /* Once the head is read, the user might have started a response already
+       and the error is only reported. The connection is still closed once that
+       response is complete. */
+    if (istate != http::read_state::empty
+        && writer_helper.state != http::write_state::empty
+        && writer_helper.state != http::write_state::continue_issued) {
+        auto state = writer_helper.state;
+        clear_buffer();
+        writer_helper.state = state;
+        flags &= ~KEEP_ALIVE;
+        handler(ec);
+        return;
+    }
+
+    clear_buffer();
+
+    // Both limit_error and parsing_error belong to http_category
+    asio::const_buffers_1 error_message(NULL, 0);
+    switch (static_cast<http_errc>(ec.value())) {
+    case http_errc::url_too_long:
+        error_message = string_literal_buffer("HTTP/1.1 414 URI Too Long\r\n"
+                                              "Content-Length: 31\r\n"
+                                              "Connection: close\r\n"
+                                              "\r\n"
+                                              "The request target is too"
+                                              " long\n");
+        break;
+    case http_errc::headers_too_large:
+        error_message = string_literal_buffer("HTTP/1.1 431 Request Header"
+                                              " Fields Too Large\r\n"
+                                              "Content-Length: 32\r\n"
+                                              "Connection: close\r\n"
+                                              "\r\n"
+                                              "The header section is too"
+                                              " large\n");
+        break;
+    case http_errc::body_too_large:
+        error_message = string_literal_buffer("HTTP/1.1 413 Payload Too"
+                                              " Large\r\n"
+                                              "Content-Length: 22\r\n"
+                                              "Connection: close\r\n"
+                                              "\r\n"
+                                              "The body is too large\n");
+        break;
+    default:
+        error_message = string_literal_buffer("HTTP/1.1 505 HTTP Version Not"
+                                              " Supported\r\n"
+                                              "Content-Length: 48\r\n"
+                                              "Connection: close\r\n"
+                                              "\r\n"
+                                              "This server only supports"
+                                              " HTTP/1.0 and HTTP/1.1\n");
+    }
+
+    writer_helper = http::write_state::finished;
+    output->clear();
+    output->push_back(error_message);
+
+    /* The rest of the rejected request (e.g. the body after a 413) is still in
+       the stream, so the connection can't be used for any further request */
+    write_output([handler,this,ec](const system::error_code &/*ignored_ec*/,
+                                   std::size_t /*bytes_transferred*/) mutable {
+        is_open_ = false;
+        channel.close();
+        handler(ec);
+    });
+}
+
+template<class Socket>
+template<class Handler>
+void basic_socket<Socket>::write_output(Handler &&handler)
+{
+    if (queued_responses.empty() && !writing) {
+        writing = true;
+        auto written = output;
+        output = written == outputs ? outputs + 1 : outputs;
+        written->begin_write();
+
+        // TODO (C++14): move in lambda capture list
+        asio::async_write(channel, written->sequence(),
+                          [this,handler,written]
+                          (const system::error_code &ec,
+                           std::size_t bytes_transferred) mutable {
+            written->end_write();
+            writing = false;
+            if (!queued_responses.empty())
+                flush_queue();
+            handler(ec, bytes_transferred);
+        });
+        return;
+    }
+
+    // TODO (C++14): move in lambda capture list
+    queued_responses.push(*output, [handler](const system::error_code &ec)
+                          mutable {
+        handler(ec, 0);
+    });
+
+    if (!writing)
+        flush_queue();
+}
+
+template<class Socket>
+void basic_socket<Socket>::flush_queue()
+{
+    writing = true;
+    flushing_responses.swap(queued_responses);
+
+    asio::async_write(channel, flushing_responses.sequence(),
+                      [this](const system::error_code &ec, std::size_t) {
+        std::vector<detail::response_queue::handler_type> handlers;
+        flushing_responses.release(handlers);
+
+        writing = false;
+        if (!queued_responses.empty())
+            flush_queue();
+
+        for (auto &handler: handlers)
+            handler(ec);
+    });
+}
+
+template<class Socket>
+void basic_socket<Socket>::schedule_flush()
+{
+    if (flush_scheduled)
+        return;
+
+    flush_scheduled = true;
+    channel.get_io_service().post([this]() {
+        flush_scheduled = false;
+        if (!writing && !queued_responses.empty())
+            flush_queue();
+    });
+}
+
 template<class Socket>
 template<class Message, class String>
 detail::http_parser_settings basic_socket<Socket>::settings()
@@ -711,16 +1464,51 @@ detail::http_parser_settings basic_socket<Socket>::settings()
     init(settings);
 
     settings.on_message_begin = on_message_begin<Message>;
-    settings.on_url = on_url<Message, String>;
-    settings.on_header_field = on_header_field<Message>;
-    settings.on_header_value = on_header_value<Message>;
+    set_url_callback<Message, String>(settings,
+                                      detail::is_string_view<String>{});
+    set_header_callbacks<Message>(settings,
+                                  detail::has_header_views<Message>{});
     settings.on_headers_complete = on_headers_complete<Message, String>;
     settings.on_body = on_body<Message>;
-    settings.on_message_complete = on_message_complete<Message>;
+    settings.on_message_complete = on_message_complete<Message, String>;
 
     return settings;
 }
 
+template<class Socket>
+template<class Message, class String>
+void basic_socket<Socket>
+::set_url_callback(http_parser_settings &settings, std::false_type)
+{
+    settings.on_url = on_url<Message, String>;
+}
+
+template<class Socket>
+template<class Message, class String>
+void basic_socket<Socket>
+::set_url_callback(http_parser_settings &settings, std::true_type)
+{
+    settings.on_url = on_url_view;
+}
+
+template<class Socket>
+template<class Message>
+void basic_socket<Socket>
+::set_header_callbacks(http_parser_settings &settings, std::false_type)
+{
+    settings.on_header_field = on_header_field<Message>;
+    settings.on_header_value = on_header_value<Message>;
+}
+
+template<class Socket>
+template<class Message>
+void basic_socket<Socket>
+::set_header_callbacks(http_parser_settings &settings, std::true_type)
+{
+    settings.on_header_field = on_header_field_view;
+    settings.on_header_value = on_header_value_view;
+}
+
 template<class Socket>
 template<class Message>
 int basic_socket<Socket>::on_message_begin(http_parser *parser)
@@ -729,6 +1517,10 @@ int basic_socket<Socket>::on_message_begin(http_parser *parser)
     auto message = reinterpret_cast<Message*>(socket->current_message);
     socket->flags = 0;
     socket->use_trailers = false;
+    socket->path_view = input_view{0, 0};
+    socket->header_views.clear();
+    socket->used = {};
+    socket->limit_error.clear();
     clear_message(*message);
     return 0;
 }
@@ -740,10 +1532,33 @@ int basic_socket<Socket>::on_url(http_parser *parser, const char *at,
 {
     auto socket = reinterpret_cast<basic_socket*>(parser->data);
     auto path = reinterpret_cast<String*>(socket->current_path);
+
+    if (!socket->accept_url(size))
+        return -1;
+
     path->append(at, size);
     return 0;
 }
 
+template<class Socket>
+int basic_socket<Socket>::on_url_view(http_parser *parser, const char *at,
+                                      std::size_t size)
+{
+    auto socket = reinterpret_cast<basic_socket*>(parser->data);
+    auto &path = socket->path_view;
+
+    if (!socket->accept_url(size))
+        return -1;
+
+    // Pieces of the same URL are contiguous in the input buffer
+    if (path.size)
+        path.size += size;
+    else
+        path = socket->pin_input(at, size);
+
+    return 0;
+}
+
 template<class Socket>
 template<class Message>
 int basic_socket<Socket>
@@ -757,6 +1572,12 @@ int basic_socket<Socket>
     auto &field = socket->last_header.first;
     auto &value = socket->last_header.second;
 
+    if ((field.empty() || value.size()) && !socket->accept_header_field())
+        return -1;
+
+    if (!socket->accept_header_bytes(size))
+        return -1;
+
     if (value.size() /* last header piece was value */) {
         algorithm::trim_right_if(socket->last_header.second, [](char ch) {
                 return ch == ' ' || ch == '\t';
@@ -787,10 +1608,78 @@ int basic_socket<Socket>
 {
     auto socket = reinterpret_cast<basic_socket*>(parser->data);
     auto &value = socket->last_header.second;
+
+    if (!socket->accept_header_bytes(size))
+        return -1;
+
     value.append(at, size);
     return 0;
 }
 
+template<class Socket>
+int basic_socket<Socket>
+::on_header_field_view(http_parser *parser, const char *at, std::size_t size)
+{
+    auto tolower = [](int ch) -> int { return std::tolower(ch); };
+
+    auto socket = reinterpret_cast<basic_socket*>(parser->data);
+    auto &views = socket->header_views;
+
+    if (!socket->accept_header_bytes(size))
+        return -1;
+
+    auto piece = socket->pin_input(at, size);
+
+    {
+        auto begin = socket->buffer.pinned_data() + piece.offset;
+        std::transform(begin, begin + size, begin, tolower);
+    }
+
+    /* A field name split across two reads is delivered in contiguous pieces
+       and always before any piece of its value. */
+    if (views.size() && views.back().second.size == 0
+        && (views.back().first.offset + views.back().first.size
+            == piece.offset)) {
+        views.back().first.size += size;
+    } else {
+        if (!socket->accept_header_field())
+            return -1;
+
+        views.emplace_back(piece, input_view{0, 0});
+    }
+
+    return 0;
+}
+
+template<class Socket>
+int basic_socket<Socket>
+::on_header_value_view(http_parser *parser, const char *at, std::size_t size)
+{
+    auto socket = reinterpret_cast<basic_socket*>(parser->data);
+    auto &value = socket->header_views.back().second;
+
+    if (!socket->accept_header_bytes(size))
+        return -1;
+
+    auto piece = socket->pin_input(at, size);
+
+    if (value.size == 0) {
+        value = piece;
+        return 0;
+    }
+
+    /* The gap between two pieces of the same value is an obs-fold (or empty if
+       the value was split across two reads) and RFC 7230 allows it to be
+       replaced by spaces. */
+    {
+        auto data = socket->buffer.pinned_data();
+        std::fill(data + value.offset + value.size, data + piece.offset, ' ');
+    }
+    value.size = piece.offset + size - value.offset;
+
+    return 0;
+}
+
 template<class Socket>
 template<class Message, class String>
 int basic_socket<Socket>::on_headers_complete(http_parser *parser)
@@ -837,8 +1726,15 @@ int basic_socket<Socket>::on_headers_complete(http_parser *parser)
             "UNLINK"
         };
         const auto &m = methods[parser->method];
-        method->append(m.data, m.size);
+        detail::set_string(*method, m.data, m.size);
         socket->connect_request = parser->method == 5;
+        socket->head_request = parser->method == 2;
+    }
+
+    if (detail::is_string_view<String>::value && !socket->pipelined_read) {
+        auto path = reinterpret_cast<String*>(socket->current_path);
+        auto view = socket->input_view_ref(socket->path_view);
+        detail::set_string(*path, view.data(), view.size());
     }
 
     {
@@ -895,27 +1791,23 @@ int basic_socket<Socket>::on_headers_complete(http_parser *parser)
         }
     }
 
-    if (socket->last_header.first.size()
-        && ((socket->flags & HTTP_1_1)
-            || (socket->last_header.first != "expect"
-                && socket->last_header.first != "upgrade"))) {
-        algorithm::trim_right_if(socket->last_header.second, [](char ch) {
-                return ch == ' ' || ch == '\t';
-            });
-        message->headers().insert(socket->last_header);
+    // No need to wait for the body to reject it
+    if (detail::body_is_identity(*parser)
+        && parser->content_length > socket->limits_.body_size) {
+        socket->limit_error = http_errc::body_too_large;
+        return -1;
     }
-    socket->last_header.first.clear();
-    socket->last_header.second.clear();
+
+    socket->flush_headers(message->headers(), !(socket->flags & HTTP_1_1),
+                          detail::has_header_views<Message>{});
+    if (!socket->pipelined_read)
+        socket->buffer.unpin();
     socket->use_trailers = true;
     socket->istate = http::read_state::message_ready;
     socket->flags |= READY;
     socket->writer_helper = http::write_state::empty;
 
-    {
-        auto er = message->headers().equal_range("expect");
-        if (std::distance(er.first, er.second) > 1)
-            message->headers().erase(er.first, er.second);
-    }
+    detail::erase_ambiguous_expect(message->headers());
 
     if (detail::should_keep_alive(*parser))
         socket->flags |= KEEP_ALIVE;
@@ -931,9 +1823,35 @@ int basic_socket<Socket>
     auto socket = reinterpret_cast<basic_socket*>(parser->data);
     auto message = reinterpret_cast<Message*>(socket->current_message);
     auto begin = reinterpret_cast<const std::uint8_t*>(data);
-    message->body().insert(message->body().end(), begin, begin + size);
+
+    if (!socket->accept_body(size))
+        return -1;
+
     socket->flags |= DATA;
 
+    if (socket->sink.active) {
+        // The parser is never fed more body bytes than the buffers can hold
+        auto &sink = socket->sink;
+        sink.size -= size;
+        sink.transferred += size;
+        while (size) {
+            auto &target = sink.buffers[sink.next];
+            auto n = std::min(size, asio::buffer_size(target));
+
+            // on_async_read_body read the bytes in place already
+            if (asio::buffer_cast<const std::uint8_t*>(target) != begin)
+                std::memcpy(asio::buffer_cast<void*>(target), begin, n);
+
+            target = target + n;
+            if (asio::buffer_size(target) == 0)
+                ++sink.next;
+            begin += n;
+            size -= n;
+        }
+    } else {
+        message->body().insert(message->body().end(), begin, begin + size);
+    }
+
     if (detail::body_is_final(*parser))
         socket->istate = http::read_state::body_ready;
 
@@ -941,19 +1859,25 @@ int basic_socket<Socket>
 }
 
 template<class Socket>
-template<class Message>
+template<class Message, class String>
 int basic_socket<Socket>::on_message_complete(http_parser *parser)
 {
     auto socket = reinterpret_cast<basic_socket*>(parser->data);
     auto message = reinterpret_cast<Message*>(socket->current_message);
-    if (socket->last_header.first.size()) {
-        algorithm::trim_right_if(socket->last_header.second, [](char ch) {
-                return ch == ' ' || ch == '\t';
-            });
-        message->trailers().insert(socket->last_header);
+
+    if (socket->pipelined_read) {
+        if (detail::is_string_view<String>::value) {
+            auto path = reinterpret_cast<String*>(socket->current_path);
+            auto view = socket->input_view_ref(socket->path_view);
+            detail::set_string(*path, view.data(), view.size());
+        }
+        socket->flush_pipelined_views(*message,
+                                      detail::has_header_views<Message>{});
     }
-    socket->last_header.first.clear();
-    socket->last_header.second.clear();
+
+    socket->flush_headers(message->trailers(), false,
+                          detail::has_header_views<Message>{});
+    socket->buffer.unpin();
     socket->istate = http::read_state::empty;
     socket->use_trailers = false;
     socket->flags |= END | (parser->upgrade ? UPGRADE : 0);
@@ -963,12 +1887,152 @@ int basic_socket<Socket>::on_message_complete(http_parser *parser)
     return -1;
 }
 
+template<class Socket>
+bool basic_socket<Socket>::accept_url(std::size_t size)
+{
+    used.url_size += size;
+    if (used.url_size <= limits_.url_size)
+        return true;
+
+    limit_error = http_errc::url_too_long;
+    return false;
+}
+
+template<class Socket>
+bool basic_socket<Socket>::accept_header_field()
+{
+    if (++used.headers <= limits_.headers)
+        return true;
+
+    limit_error = http_errc::headers_too_large;
+    return false;
+}
+
+template<class Socket>
+bool basic_socket<Socket>::accept_header_bytes(std::size_t size)
+{
+    used.headers_size += size;
+    if (used.headers_size <= limits_.headers_size)
+        return true;
+
+    limit_error = http_errc::headers_too_large;
+    return false;
+}
+
+template<class Socket>
+bool basic_socket<Socket>::accept_body(std::uint64_t size)
+{
+    if (size <= limits_.body_size - used.body_size) {
+        used.body_size += size;
+        return true;
+    }
+
+    limit_error = http_errc::body_too_large;
+    return false;
+}
+
+template<class Socket>
+typename basic_socket<Socket>::input_view
+basic_socket<Socket>::pin_input(const char *at, std::size_t size)
+{
+    if (!buffer.pinned())
+        buffer.pin(at);
+
+    return input_view{
+        std::size_t(reinterpret_cast<const std::uint8_t*>(at)
+                    - buffer.pinned_data()),
+        size
+    };
+}
+
+template<class Socket>
+string_ref basic_socket<Socket>::input_view_ref(input_view view) const
+{
+    return string_ref(reinterpret_cast<const char*>(buffer.pinned_data())
+                      + view.offset, view.size);
+}
+
+template<class Socket>
+template<class Headers>
+void basic_socket<Socket>::flush_headers(Headers &headers, bool filter,
+                                         std::false_type)
+{
+    if (last_header.first.size()
+        && (!filter || (last_header.first != "expect"
+                        && last_header.first != "upgrade"))) {
+        algorithm::trim_right_if(last_header.second, [](char ch) {
+                return ch == ' ' || ch == '\t';
+            });
+        headers.insert(last_header);
+    }
+    last_header.first.clear();
+    last_header.second.clear();
+}
+
+template<class Socket>
+template<class Headers>
+void basic_socket<Socket>::insert_header_views(Headers &headers,
+                                               std::size_t first,
+                                               std::size_t last, bool filter)
+{
+    for (;first != last;++first) {
+        auto field = input_view_ref(header_views[first].first);
+        auto value = input_view_ref(header_views[first].second);
+
+        if (filter && (field == "expect" || field == "upgrade"))
+            continue;
+
+        while (value.size() && (value.back() == ' ' || value.back() == '\t'))
+            value.remove_suffix(1);
+
+        headers.emplace(field, value);
+    }
+}
+
+template<class Socket>
+template<class Headers>
+void basic_socket<Socket>::flush_headers(Headers &headers, bool filter,
+                                         std::true_type)
+{
+    if (pipelined_read && !use_trailers) {
+        // See flush_pipelined_views
+        header_section_views = header_views.size();
+        return;
+    }
+
+    insert_header_views(headers, 0, header_views.size(), filter);
+    header_views.clear();
+}
+
+template<class Socket>
+template<class Message>
+void basic_socket<Socket>::flush_pipelined_views(Message &, std::false_type)
+{}
+
+template<class Socket>
+template<class Message>
+void basic_socket<Socket>::flush_pipelined_views(Message &message,
+                                                 std::true_type)
+{
+    insert_header_views(message.headers(), 0, header_section_views,
+                        !(flags & HTTP_1_1));
+    detail::erase_ambiguous_expect(message.headers());
+
+    // Only the trailers are left
+    header_views.erase(header_views.begin(),
+                       header_views.begin() + header_section_views);
+    header_section_views = 0;
+}
+
 template<class Socket>
 void basic_socket<Socket>::clear_buffer()
 {
     istate = http::read_state::empty;
     writer_helper.state = http::write_state::empty;
-    used_size = 0;
+    buffer.clear();
+    header_views.clear();
+    header_section_views = 0;
+    pipelined.clear();
     detail::init(parser);
 }
 
@@ -8,13 +8,15 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 
 #include <algorithm>
-#include <sstream>
 #include <array>
+#include <vector>
 #include <type_traits>
 #include <utility>
 
+#include <boost/assert.hpp>
 #include <boost/utility/string_ref.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -24,13 +26,27 @@
 
 #include <boost/http/traits.hpp>
 #include <boost/http/read_state.hpp>
+#include <boost/http/input_buffer_policy.hpp>
+#include <boost/http/request_limits.hpp>
+#include <boost/http/date_cache.hpp>
 #include <boost/http/write_state.hpp>
 #include <boost/http/message.hpp>
+#include <boost/http/pipelined_request.hpp>
+#include <boost/http/prepared_response.hpp>
 #include <boost/http/http_errc.hpp>
 #include <boost/http/detail/writer_helper.hpp>
+#include <boost/http/detail/input_buffer.hpp>
 #include <boost/http/detail/constchar_helper.hpp>
+#include <boost/http/detail/has_connection_close.hpp>
+#include <boost/http/detail/output_buffers.hpp>
+#include <boost/http/detail/response_queue.hpp>
+#include <boost/http/detail/status_line.hpp>
 #include <boost/http/algorithm/header.hpp>
 
+#ifndef BOOST_HTTP_SOCKET_DEFAULT_FLUSH_THRESHOLD
+#define BOOST_HTTP_SOCKET_DEFAULT_FLUSH_THRESHOLD 16384
+#endif // BOOST_HTTP_SOCKET_DEFAULT_FLUSH_THRESHOLD
+
 namespace boost {
 namespace http {
 
@@ -96,6 +112,47 @@ BOOST_HTTP_DECL std::size_t execute(http_parser &parser,
 BOOST_HTTP_DECL bool should_keep_alive(const http_parser &parser);
 BOOST_HTTP_DECL bool body_is_final(const http_parser &parser);
 
+/* True if the rest of the body is delimited by a "content-length" header (i.e.
+   the next bytes received are body bytes, with no framing) */
+BOOST_HTTP_DECL bool body_is_identity(const http_parser &parser);
+
+/* The parser is stopped with an error after each message. If the connection
+   is kept alive and wasn't upgraded, it's already waiting for the next message
+   and clearing the error is enough (and cheaper than init). */
+inline void resume(http_parser &parser)
+{
+    parser.http_errno = 0;
+    parser.nread = 0;
+}
+
+/* Streams whose readiness can be awaited (i.e. with null_buffers), so an idle
+   connection doesn't need to hold any input memory while it waits for the
+   next request */
+template<class Socket>
+struct can_wait_readable: public std::is_same<Socket, asio::ip::tcp::socket>
+{};
+
+/* Messages whose headers are made of string_refs are filled with views into
+   the socket input buffer instead of copies. */
+template<class String>
+struct is_string_view: public std::is_same<String, string_ref> {};
+
+template<class Message>
+struct has_header_views
+    : public is_string_view<typename Message::headers_type::key_type>
+{};
+
+// The file_server operations writing the body straight to next_layer()
+template<class Socket, class Handler>
+struct on_async_response_sendfile;
+
+template<class Socket, class Handler>
+struct on_async_response_sendfile_multi;
+
+// The receive_body_to_file operation reading the body straight from next_layer()
+template<class ServerSocket, class Message, class Handler>
+struct on_async_receive_body_to_file;
+
 } // namespace detail
 
 template<class Socket>
@@ -113,6 +170,12 @@ public:
 
     asio::io_service &get_io_service();
 
+    std::size_t pipelined_flush_threshold() const;
+
+    bool date_header() const;
+
+    const request_limits &limits() const;
+
     // ### END OF QUERY FUNCTIONS ###
 
     // ### READ FUNCTIONS ###
@@ -124,12 +187,27 @@ public:
     async_read_request(String &method, String &path, Message &message,
                        CompletionToken &&token);
 
+    template<class Queue, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code,
+                                         std::size_t)>::type>::type
+    async_read_requests(Queue &queue, CompletionToken &&token);
+
     template<class Message, class CompletionToken>
     typename asio::async_result<
         typename asio::handler_type<CompletionToken,
                                     void(system::error_code)>::type>::type
     async_read_some(Message &message, CompletionToken &&token);
 
+    template<class MutableBufferSequence, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code,
+                                         std::size_t)>::type>::type
+    async_read_some(const MutableBufferSequence &buffers, Message &message,
+                    CompletionToken &&token);
+
     template<class Message, class CompletionToken>
     typename asio::async_result<
         typename asio::handler_type<CompletionToken,
@@ -148,6 +226,21 @@ public:
                          const StringRef &reason_phrase, const Message &message,
                          CompletionToken &&token);
 
+    template<class StringRef, class Message, class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_response(std::uint_fast16_t status_code,
+                         const StringRef &reason_phrase, const Message &message,
+                         asio::const_buffer body, CompletionToken &&token);
+
+    template<class CompletionToken>
+    typename asio::async_result<
+        typename asio::handler_type<CompletionToken,
+                                    void(system::error_code)>::type>::type
+    async_write_response(const prepared_response &response,
+                         CompletionToken &&token);
+
     template<class CompletionToken>
     typename asio::async_result<
         typename asio::handler_type<CompletionToken,
@@ -191,15 +284,65 @@ public:
     template<class... Args>
     basic_socket(boost::asio::mutable_buffer inbuffer, Args&&... args);
 
+    basic_socket(boost::asio::io_service &io_service,
+                 input_buffer_policy policy);
+
+    template<class... Args>
+    basic_socket(input_buffer_policy policy, Args&&... args);
+
     next_layer_type &next_layer();
     const next_layer_type &next_layer() const;
 
     void open();
 
+    void set_pipelined_flush_threshold(std::size_t bytes);
+
+    void set_date_header(bool enable);
+
+    void set_limits(request_limits limits);
+
 private:
+    template<class, class>
+    friend struct detail::on_async_response_sendfile;
+
+    template<class, class>
+    friend struct detail::on_async_response_sendfile_multi;
+
+    template<class, class, class>
+    friend struct detail::on_async_receive_body_to_file;
+
     typedef detail::http_parser http_parser;
     typedef detail::http_parser_settings http_parser_settings;
 
+    struct input_view
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    /* Caller storage receiving the body instead of message.body() (see the
+       async_read_some overload taking a buffer sequence) */
+    struct body_sink
+    {
+        /* The non-empty caller buffers, where the ones before next are
+           already filled */
+        std::vector<asio::mutable_buffer> buffers;
+        std::size_t next;
+
+        // Room left in the buffers
+        std::size_t size;
+
+        std::size_t transferred;
+        bool active = false;
+    };
+
+    struct pipelined_state
+    {
+        int flags;
+        bool connect_request;
+        bool head_request;
+    };
+
     enum Flags
     {
         NONE,
@@ -211,6 +354,19 @@ private:
         UPGRADE    = 1 << 5
     };
 
+    /* Gives the input buffer back to the pool between requests. Only a grown
+       buffer is given back unless the readiness of the stream can be
+       awaited. */
+    void release_idle_input();
+
+    /* Reads more input. A buffer given back by release_idle_input is only
+       taken from the pool again once the stream is readable. */
+    template<class Handler>
+    void read_input(Handler handler, std::false_type);
+
+    template<class Handler>
+    void read_input(Handler handler, std::true_type);
+
     template<int target, class Message, class Handler,
              class String = std::string>
     void schedule_on_async_read_message(Handler &handler, Message &message,
@@ -223,15 +379,98 @@ private:
                                Message &message, const system::error_code &ec,
                                std::size_t bytes_transferred);
 
+    /* Completion of a read issued straight into the caller buffers (only done
+       while the body is delimited by content-length and no byte is buffered) */
+    template<class Message, class Handler>
+    void on_async_read_body(Handler handler, Message &message,
+                            const system::error_code &ec,
+                            std::size_t bytes_transferred);
+
+    template<class Queue, class Handler>
+    void on_async_read_requests(Handler handler, Queue &queue, bool started,
+                                const system::error_code &ec,
+                                std::size_t bytes_transferred);
+
+    /* True while the batch read by async_read_requests has requests not
+       answered yet (or queued responses not written yet) */
+    bool pending_responses() const;
+
+    // To be called once a response is complete
+    void next_pipelined_response(bool keep_alive);
+
+    /* False if the "content-length" of the current response describes a body
+       that is never sent (i.e. HEAD requests, 1xx, 204 and 304) */
+    bool response_has_body() const;
+
+    /* Accounts for n body bytes written straight to next_layer() against the
+       declared "content-length" */
+    void consume_content_length(std::uint64_t n);
+
+    /* Number of body bytes that may be read straight from next_layer(), i.e.
+       the rest of a body framed by "content-length" when no byte is buffered.
+       The last byte is left out, so the socket still parses the end of the
+       message. */
+    std::uint64_t direct_body_size() const;
+
+    // Accounts for n (up to direct_body_size()) bytes read from next_layer()
+    void consume_direct_body(std::uint64_t n);
+
+    /* Writes output as a complete response, which may be queued instead (see
+       set_pipelined_flush_threshold) */
+    template<class Handler>
+    void write_response(Handler &&handler);
+
+    // Appends a "date" header line taken from dates to output
+    void push_date_header();
+
+    /* Writes the automatic response to a request that breaks the limits (or
+       uses an unsupported HTTP version) and then calls handler with the error
+       (i.e. limit_error or parsing_error). The response is skipped if the user
+       has already started one. */
+    template<class Handler>
+    void write_error_response(Handler handler);
+
+    /* Writes output, or queues it behind the write in progress (the handler
+       signature is void(system::error_code, std::size_t), but only the error
+       is meaningful) */
+    template<class Handler>
+    void write_output(Handler &&handler);
+
+    // Writes every queued response with a single gathered write
+    void flush_queue();
+
+    /* Flushes the queue once the io_service runs the next handlers, so the
+       responses written until then share the same write */
+    void schedule_flush();
+
     template<class Message, class String>
     static http_parser_settings settings();
 
+    template<class Message, class String>
+    static void set_url_callback(http_parser_settings &settings,
+                                 std::false_type);
+
+    template<class Message, class String>
+    static void set_url_callback(http_parser_settings &settings,
+                                 std::true_type);
+
+    template<class Message>
+    static void set_header_callbacks(http_parser_settings &settings,
+                                     std::false_type);
+
+    template<class Message>
+    static void set_header_callbacks(http_parser_settings &settings,
+                                     std::true_type);
+
     template<class Message>
     static int on_message_begin(http_parser *parser);
 
     template<class Message, class String>
     static int on_url(http_parser *parser, const char *at, std::size_t size);
 
+    static int on_url_view(http_parser *parser, const char *at,
+                           std::size_t size);
+
     template<class Message>
     static int on_header_field(http_parser *parser, const char *at,
                                std::size_t size);
@@ -240,15 +479,48 @@ private:
     static int on_header_value(http_parser *parser, const char *at,
                                std::size_t size);
 
+    static int on_header_field_view(http_parser *parser, const char *at,
+                                    std::size_t size);
+
+    static int on_header_value_view(http_parser *parser, const char *at,
+                                    std::size_t size);
+
     template<class Message, class String>
     static int on_headers_complete(http_parser *parser);
 
     template<class Message>
     static int on_body(http_parser *parser, const char *data, std::size_t size);
 
-    template<class Message>
+    template<class Message, class String>
     static int on_message_complete(http_parser *parser);
 
+    /* Account for the pieces of the current message. They return false (and
+       set limit_error) once the message breaks the limits. */
+    bool accept_url(std::size_t size);
+    bool accept_header_field();
+    bool accept_header_bytes(std::size_t size);
+    bool accept_body(std::uint64_t size);
+
+    input_view pin_input(const char *at, std::size_t size);
+    string_ref input_view_ref(input_view view) const;
+
+    // Inserts the pending fields, skipping expect and upgrade if filter is set
+    template<class Headers>
+    void insert_header_views(Headers &headers, std::size_t first,
+                             std::size_t last, bool filter);
+
+    template<class Headers>
+    void flush_headers(Headers &headers, bool filter, std::false_type);
+
+    template<class Headers>
+    void flush_headers(Headers &headers, bool filter, std::true_type);
+
+    template<class Message>
+    void flush_pipelined_views(Message &message, std::false_type);
+
+    template<class Message>
+    void flush_pipelined_views(Message &message, std::true_type);
+
     void clear_buffer();
 
     template<class Message>
@@ -266,9 +538,7 @@ private:
     bool is_open_ = true;
     http::read_state istate;
 
-    // TODO: maybe replace by buffersequence to allow scatter-gather operations
-    asio::mutable_buffer buffer;
-    std::size_t used_size = 0;
+    detail::input_buffer buffer;
 
     /* pimpl is not used to avoid the extra level of indirection and the extra
        allocation. Also, related objects that are closer together are more cache
@@ -286,13 +556,81 @@ private:
     void *current_path;
     void *current_message;
 
+    body_sink sink;
+
+    request_limits limits_;
+
+    // What the current message used from limits_
+    struct
+    {
+        std::size_t url_size;
+        std::size_t headers;
+        std::size_t headers_size;
+        std::uint64_t body_size;
+    } used = {};
+
+    /* The parser callbacks can only report a generic error, so the broken limit
+       is stored here */
+    system::error_code limit_error;
+
     std::pair<std::string, std::string> last_header;
-    bool use_trailers;
+    bool use_trailers = false;
+
+    /* Used instead of last_header when the user asks for string_refs. Pieces
+       are stored as offsets relative to the pinned input (the head of the
+       message or of the trailers), because the input buffer might be
+       compacted between two parser calls. */
+    input_view path_view;
+    std::vector<std::pair<input_view, input_view>> header_views;
+
+    /* Set by async_read_requests. Messages are only delivered once complete,
+       so header views are created at the end of the message (the first
+       message might span several reads and the buffer can move). */
+    bool pipelined_read = false;
+    std::size_t header_section_views = 0;
+
+    // Per-request state of the requests read by async_read_requests
+    std::vector<pipelined_state> pipelined;
+    std::size_t next_pipelined = 0;
+
+    /* Complete responses to pipelined requests are held until the last
+       response of the batch is written (or flush_threshold bytes are queued, or
+       the scheduled flush runs), so they go in a single gathered write. Any
+       output written while a write is in progress also waits here. */
+    detail::response_queue queued_responses;
+    std::size_t flush_threshold = BOOST_HTTP_SOCKET_DEFAULT_FLUSH_THRESHOLD;
+
+    // The responses of the gathered write in progress
+    detail::response_queue flushing_responses;
+
+    bool writing = false;
+    bool flush_scheduled = false;
 
     // Output state
     detail::writer_helper writer_helper;
-    std::string content_length_buffer;
-    bool connect_request;
+
+    /* Responses are serialized into *output. A write straight from it moves
+       output to the other arena, so the next response (e.g. to a pipelined
+       request) never overwrites the buffers of the write in progress. */
+    detail::output_buffers outputs[2];
+    detail::output_buffers *output = outputs;
+
+    bool connect_request = false;
+    bool head_request = false;
+
+    /* Set by async_write_response_metadata if the message has a
+       "content-length" header. The body is then written as is, with no chunked
+       framing. */
+    bool content_length_framing = false;
+
+    // Body bytes still owed under content_length_framing
+    std::uint64_t content_length_left = 0;
+
+    // Status code of the response started by async_write_response_metadata
+    std::uint_fast16_t response_status = 0;
+
+    // Non-null if responses get an automatic "date" header
+    date_cache *dates = nullptr;
 };
 
 typedef basic_socket<boost::asio::ip::tcp::socket> socket;
@@ -0,0 +1,122 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#ifndef BOOST_HTTP_STAT_CACHE_HPP
+#define BOOST_HTTP_STAT_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <boost/system/error_code.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <boost/http/detail/config.hpp>
+#include <boost/http/detail/native_file.hpp>
+
+namespace boost {
+namespace http {
+
+/* Bounded cache of the files found under a root directory, keyed by request
+   path. A hit answers everything the file server needs to know about the file
+   without a single filesystem syscall. Entries are trusted for a fixed TTL and
+   the least recently used entry is evicted once the cache is full. At most
+   max_open_files descriptors are kept open by the entries. Thread-safe. */
+class BOOST_HTTP_DECL stat_cache
+{
+public:
+    typedef std::chrono::steady_clock clock_type;
+
+    struct entry
+    {
+        // Canonical root directory joined with the request path
+        filesystem::path path;
+
+        std::uintmax_t size;
+        std::time_t last_write_time;
+
+        /* Entity-tag (quotes included) computed from the metadata. Weak if
+           the metadata cannot tell all revisions apart (i.e. on Windows). */
+        std::string etag;
+
+        /* Shared by all transfers of this file. Empty once the descriptor
+           budget of the cache is spent (the file is then opened for each
+           transfer). */
+        std::shared_ptr<const detail::native_file> file;
+
+        /* Precompressed siblings ("file.br" and "file.gz"). Only looked up if
+           the cache was asked to. */
+        std::shared_ptr<const entry> br;
+        std::shared_ptr<const entry> gzip;
+    };
+
+    explicit stat_cache(const filesystem::path &root_dir,
+                        std::size_t max_entries = 1024,
+                        clock_type::duration ttl = std::chrono::seconds(1),
+                        bool precompressed = false,
+                        std::size_t max_open_files = 256);
+
+    stat_cache(const stat_cache &) = delete;
+    stat_cache &operator=(const stat_cache &) = delete;
+
+    const filesystem::path &root_dir() const;
+
+    bool precompressed() const;
+
+    /* Returns the entry of relative_path (already free of dot segments). On a
+       miss, or if the TTL expired, the file is resolved again. Returns an empty
+       pointer and sets ec if the file cannot be served (see
+       file_server_errc). */
+    std::shared_ptr<const entry> lookup(const filesystem::path &relative_path,
+                                        system::error_code &ec);
+
+    // Forgets every entry
+    void clear();
+
+private:
+    struct node
+    {
+        std::shared_ptr<const entry> value;
+        clock_type::time_point expiry;
+        std::list<std::string>::iterator lru;
+    };
+
+    std::shared_ptr<const entry> resolve(const filesystem::path &relative_path,
+                                         system::error_code &ec) const;
+
+    // Fills the metadata of ret->path
+    static bool stat(entry &ret, system::error_code &ec);
+
+    // Opens ret.file unless the descriptor budget is spent
+    void open(entry &ret) const;
+
+    // Evicts the expired entries found at the back of lru
+    void evict_expired(clock_type::time_point now);
+
+    const filesystem::path root;
+    const std::size_t max_entries;
+    const clock_type::duration ttl;
+    const bool precompressed_;
+    const std::size_t max_open_files;
+
+    /* Descriptors held by the entries. Shared with them, as the transfers
+       might keep an entry alive after the cache is gone. */
+    std::shared_ptr<std::atomic<std::size_t>> open_files;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, node> entries;
+    // Most recently used first
+    std::list<std::string> lru;
+};
+
+} // namespace http
+} // namespace boost
+
+#endif // BOOST_HTTP_STAT_CACHE_HPP
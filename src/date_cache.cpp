@@ -0,0 +1,67 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#include <cstring>
+
+#include <boost/http/date_cache.hpp>
+
+namespace boost {
+namespace http {
+
+asio::io_service::id date_cache::id;
+
+const std::size_t date_cache::size;
+const std::size_t date_cache::words;
+
+date_cache::date_cache(asio::io_service &io_service)
+    : asio::io_service::service(io_service)
+{
+    for (auto &s: slots) {
+        s.second.store(-1, std::memory_order_relaxed);
+        for (auto &w: s.text)
+            w.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::time_t date_cache::now(char *out)
+{
+    std::time_t current = std::time(nullptr);
+    slot &s = slots[current & 1];
+    std::uint64_t text[words];
+
+    if (s.second.load(std::memory_order_acquire) == current) {
+        for (std::size_t i = 0;i != words;++i)
+            text[i] = s.text[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.second.load(std::memory_order_relaxed) == current) {
+            std::memcpy(out, text, size);
+            return current;
+        }
+    }
+
+    // Another thread publishing the same second is not waited for
+    std::memset(text, 0, sizeof(text));
+    detail::format_http_date(current, reinterpret_cast<char*>(text));
+    std::memcpy(out, text, size);
+
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (!lock || s.second.load(std::memory_order_relaxed) == current)
+        return current;
+
+    s.second.store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0;i != words;++i)
+        s.text[i].store(text[i], std::memory_order_relaxed);
+    s.second.store(current, std::memory_order_release);
+
+    return current;
+}
+
+void date_cache::shutdown_service()
+{}
+
+} // namespace http
+} // namespace boost
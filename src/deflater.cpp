@@ -0,0 +1,142 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include <zlib.h>
+
+#include <boost/http/detail/deflater.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+namespace {
+
+// Idle deflaters kept by each io_service (~256KiB each with the defaults)
+const std::size_t max_idle_deflaters = 16;
+
+} // namespace
+
+struct deflater::impl
+{
+    z_stream stream;
+    bool initialized = false;
+};
+
+deflater::deflater(int level)
+    : pimpl(new impl)
+    , level_(level)
+{
+    std::memset(&pimpl->stream, 0, sizeof(pimpl->stream));
+}
+
+deflater::~deflater()
+{
+    if (pimpl->initialized)
+        deflateEnd(&pimpl->stream);
+}
+
+int deflater::level() const
+{
+    return level_;
+}
+
+void deflater::reset(format_type format)
+{
+    auto &stream = pimpl->stream;
+
+    if (pimpl->initialized) {
+        // the wrapper (gzip or zlib) can only be chosen at initialization
+        if (format == this->format) {
+            deflateReset(&stream);
+            return;
+        }
+
+        deflateEnd(&stream);
+        pimpl->initialized = false;
+    }
+
+    // 16 is added to the window bits to get a gzip wrapper
+    int window_bits = (format == gzip) ? 15 + 16 : 15;
+    if (deflateInit2(&stream, level_, Z_DEFLATED, window_bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::bad_alloc();
+    }
+
+    pimpl->initialized = true;
+    this->format = format;
+}
+
+std::size_t deflater::bound(std::size_t size)
+{
+    // each flush may add an empty stored block (5 bytes) plus the trailer
+    return deflateBound(&pimpl->stream, size) + 64;
+}
+
+void deflater::input(const void *data, std::size_t size)
+{
+    auto &stream = pimpl->stream;
+    stream.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+    stream.avail_in = size;
+}
+
+std::size_t deflater::output(void *out, std::size_t size, bool finish,
+                             bool &more)
+{
+    auto &stream = pimpl->stream;
+    stream.next_out = static_cast<Bytef*>(out);
+    stream.avail_out = size;
+
+    int ret = deflate(&stream, finish ? Z_FINISH : Z_SYNC_FLUSH);
+    (void) ret;
+
+    // deflate is done once it has room left after consuming the input
+    more = stream.avail_out == 0 || (finish && ret != Z_STREAM_END);
+    return size - stream.avail_out;
+}
+
+asio::io_service::id deflater_pool::id;
+
+deflater_pool::deflater_pool(asio::io_service &io_service)
+    : asio::io_service::service(io_service)
+{}
+
+std::unique_ptr<deflater> deflater_pool::acquire(int level)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(idle.begin(), idle.end(),
+                               [level](const std::unique_ptr<deflater> &d) {
+                                   return d->level() == level;
+                               });
+        if (it != idle.end()) {
+            auto ret = std::move(*it);
+            idle.erase(it);
+            return ret;
+        }
+    }
+
+    return std::unique_ptr<deflater>(new deflater(level));
+}
+
+void deflater_pool::release(std::unique_ptr<deflater> d)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (idle.size() < max_idle_deflaters)
+        idle.push_back(std::move(d));
+}
+
+void deflater_pool::shutdown_service()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    idle.clear();
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
@@ -0,0 +1,107 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#include <algorithm>
+
+#include <boost/date_time/posix_time/conversion.hpp>
+
+#include <boost/http/file_cache.hpp>
+#include <boost/http/algorithm/header.hpp>
+
+namespace boost {
+namespace http {
+
+file_cache::file_cache(std::size_t max_size, std::size_t max_file_size)
+    : max_size_(max_size)
+    , max_file_size_(std::min(max_file_size, max_size))
+{}
+
+std::size_t file_cache::max_size() const
+{
+    return max_size_;
+}
+
+std::size_t file_cache::max_file_size() const
+{
+    return max_file_size_;
+}
+
+std::shared_ptr<const file_cache::entry>
+file_cache::find(const stat_cache::entry &file)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(file.path.native());
+        if (it != entries.end()) {
+            const auto &value = *it->second.value;
+            if (value.etag == file.etag
+                && value.contents.size() == file.size) {
+                lru.splice(lru.begin(), lru, it->second.lru);
+                ++hits;
+                return it->second.value;
+            }
+
+            erase(it);
+        }
+    }
+
+    ++misses;
+    return nullptr;
+}
+
+std::shared_ptr<const file_cache::entry>
+file_cache::insert(const stat_cache::entry &file, std::vector<char> contents)
+{
+    auto value = std::make_shared<entry>();
+    value->last_write_time = file.last_write_time;
+    value->etag = file.etag;
+    value->contents = std::move(contents);
+    value->last_modified = to_http_date<std::string>
+        (posix_time::from_time_t(file.last_write_time));
+
+    auto value_size = value->contents.size();
+    if (value_size > max_file_size_)
+        return value;
+
+    const auto &key = file.path.native();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end())
+        erase(it);
+
+    while (size + value_size > max_size_) {
+        erase(entries.find(lru.back()));
+        ++evictions;
+    }
+
+    lru.push_front(key);
+    entries.emplace(key, node{value, lru.begin()});
+    size += value_size;
+    return value;
+}
+
+void file_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    size = 0;
+}
+
+file_cache::statistics file_cache::stats() const
+{
+    return statistics{hits.load(), misses.load(), evictions.load()};
+}
+
+void file_cache::erase(std::unordered_map<std::string, node>::iterator it)
+{
+    size -= it->second.value->contents.size();
+    lru.erase(it->second.lru);
+    entries.erase(it);
+}
+
+} // namespace http
+} // namespace boost
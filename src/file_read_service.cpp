@@ -0,0 +1,134 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#include <utility>
+
+#include <boost/asio/error.hpp>
+
+#include <boost/http/file_read_service.hpp>
+
+namespace boost {
+namespace http {
+
+namespace detail {
+
+std::shared_ptr<file_read_engine> make_default_file_read_engine()
+{
+#ifdef BOOST_HTTP_USE_IO_URING
+    if (auto ret = make_io_uring_file_read_engine())
+        return ret;
+#endif // BOOST_HTTP_USE_IO_URING
+
+    return std::make_shared<thread_pool_file_read_engine>();
+}
+
+} // namespace detail
+
+file_read_engine::~file_read_engine() = default;
+
+thread_pool_file_read_engine::thread_pool_file_read_engine(std::size_t threads)
+{
+    if (threads == 0)
+        threads = 1;
+
+    workers.reserve(threads);
+    for (std::size_t i = 0 ; i != threads ; ++i)
+        workers.emplace_back([this]() { run(); });
+}
+
+thread_pool_file_read_engine::~thread_pool_file_read_engine()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+
+    for (auto &worker: workers)
+        worker.join();
+}
+
+void thread_pool_file_read_engine
+::async_read_at(std::shared_ptr<const detail::native_file> file,
+                std::uintmax_t offset, asio::mutable_buffer buffer,
+                handler_type handler)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(operation{std::move(file), offset, buffer,
+                                  std::move(handler)});
+    }
+    cv.notify_one();
+}
+
+void thread_pool_file_read_engine::run()
+{
+    while (true) {
+        operation op;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            op = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        auto data = asio::buffer_cast<char*>(op.buffer);
+        auto size = asio::buffer_size(op.buffer);
+        std::size_t nread = 0;
+        system::error_code ec;
+        while (nread != size) {
+            auto n = op.file->read_at(op.offset + nread, data + nread,
+                                      size - nread, ec);
+            if (ec)
+                break;
+
+            if (n == 0) {
+                ec = asio::error::eof;
+                break;
+            }
+
+            nread += n;
+        }
+
+        op.handler(ec, nread);
+    }
+}
+
+asio::io_service::id file_read_service::id;
+
+file_read_service::file_read_service(asio::io_service &io_service)
+    : asio::io_service::service(io_service)
+    , engine_(detail::make_default_file_read_engine())
+{}
+
+void file_read_service::engine(std::shared_ptr<file_read_engine> engine)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(engine_, engine);
+    }
+
+    /* The previous engine is released without the lock, as its destructor
+       waits for reads whose completion takes the lock */
+}
+
+std::shared_ptr<file_read_engine> file_read_service::engine()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return engine_;
+}
+
+void file_read_service::shutdown_service()
+{
+    // The engine would post the pending handlers into a dead io_service
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() { return pending == 0; });
+}
+
+} // namespace http
+} // namespace boost
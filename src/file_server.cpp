@@ -5,6 +5,20 @@
 
 #include <boost/http/file_server.hpp>
 
+#include <string>
+
+#ifdef BOOST_WINDOWS_API
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // BOOST_WINDOWS_API
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif // __linux__
+
 namespace boost {
 namespace http {
 
@@ -46,5 +60,384 @@ BOOST_HTTP_DECL const system::error_category& file_server_category()
     return category;
 }
 
+namespace detail {
+
+multipart_ranges::multipart_ranges(std::vector<range_type> range_set,
+                                   string_ref content_type,
+                                   std::uintmax_t file_size)
+    : ranges(std::move(range_set))
+    , body_size_(0)
+{
+    const auto file_size_value = std::to_string(file_size);
+
+    offsets.reserve(ranges.size() + 1);
+    for (auto &range: ranges) {
+        offsets.push_back(heads.size());
+
+        heads.append("\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY "\r\n");
+        if (content_type.size()) {
+            heads.append("content-type: ");
+            heads.append(content_type.data(), content_type.size());
+            heads.append("\r\n");
+        }
+        heads.append("content-range: bytes ");
+        heads.append(std::to_string(range.first));
+        heads.push_back('-');
+        heads.append(std::to_string(range.second));
+        heads.push_back('/');
+        heads.append(file_size_value);
+        heads.append("\r\n\r\n");
+
+        to_cpp_range(range);
+        body_size_ += range.second;
+    }
+
+    offsets.push_back(heads.size());
+    heads.append("\r\n--" BOOST_HTTP_FILE_SERVER_BOUNDARY "--\r\n");
+    body_size_ += heads.size();
+}
+
+std::size_t multipart_ranges::size() const
+{
+    return ranges.size();
+}
+
+asio::const_buffer multipart_ranges::head(std::size_t part) const
+{
+    return asio::const_buffer(heads.data() + offsets[part],
+                              offsets[part + 1] - offsets[part]);
+}
+
+const multipart_ranges::range_type &
+multipart_ranges::range(std::size_t part) const
+{
+    return ranges[part];
+}
+
+asio::const_buffer multipart_ranges::final_boundary() const
+{
+    return asio::const_buffer(heads.data() + offsets.back(),
+                              heads.size() - offsets.back());
+}
+
+std::uintmax_t multipart_ranges::body_size() const
+{
+    return body_size_;
+}
+
+#ifdef BOOST_WINDOWS_API
+
+native_file::native_file(const filesystem::path &file)
+    : handle(::CreateFileW(file.c_str(), GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE
+                           | FILE_SHARE_DELETE,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL))
+{
+    if (handle == INVALID_HANDLE_VALUE)
+        handle = nullptr;
+}
+
+native_file::native_file(native_file &&o)
+    : handle(o.handle)
+{
+    o.handle = nullptr;
+}
+
+native_file::~native_file()
+{
+    if (handle)
+        ::CloseHandle(handle);
+}
+
+bool native_file::is_open() const
+{
+    return handle != nullptr;
+}
+
+std::size_t native_file::read_at(std::uintmax_t offset, void *data,
+                                 std::size_t size,
+                                 system::error_code &ec) const
+{
+    // The offset given to ReadFile doesn't depend on the file pointer
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    DWORD ret;
+    if (!::ReadFile(handle, data,
+                    static_cast<DWORD>(std::min<std::size_t>(size, 0x7fffffff)),
+                    &ret, &overlapped)) {
+        DWORD error = ::GetLastError();
+        if (error == ERROR_HANDLE_EOF) {
+            ec.clear();
+            return 0;
+        }
+
+        ec = system::error_code(error, system::system_category());
+        return 0;
+    }
+
+    ec.clear();
+    return ret;
+}
+
+#else
+
+native_file::native_file(const filesystem::path &file)
+    : fd(::open(file.c_str(), O_RDONLY | O_CLOEXEC))
+{}
+
+native_file::native_file(native_file &&o)
+    : fd(o.fd)
+{
+    o.fd = -1;
+}
+
+native_file::~native_file()
+{
+    if (fd != -1)
+        ::close(fd);
+}
+
+bool native_file::is_open() const
+{
+    return fd != -1;
+}
+
+std::size_t native_file::read_at(std::uintmax_t offset, void *data,
+                                 std::size_t size,
+                                 system::error_code &ec) const
+{
+    ::ssize_t ret;
+    do {
+        ret = ::pread(fd, data, size, offset);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        ec = system::error_code(errno, system::system_category());
+        return 0;
+    }
+
+    ec.clear();
+    return ret;
+}
+
+#endif // BOOST_WINDOWS_API
+
+std::size_t native_file::sendfile(int out, std::uintmax_t &offset,
+                                  std::uintmax_t count,
+                                  system::error_code &ec) const
+{
+#ifdef __linux__
+    // Linux transfers at most 0x7ffff000 bytes per call anyway
+    const std::uintmax_t max_count = 0x7ffff000;
+
+    ::off_t off = offset;
+    ::ssize_t ret;
+    do {
+        ret = ::sendfile(out, fd, &off, std::min(count, max_count));
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        ec = system::error_code(errno, system::system_category());
+        return 0;
+    }
+
+    ec.clear();
+    offset = off;
+    return ret;
+#else
+    (void) out;
+    (void) offset;
+    (void) count;
+    ec = system::errc::make_error_code(system::errc::operation_not_supported);
+    return 0;
+#endif // __linux__
+}
+
+#ifdef BOOST_WINDOWS_API
+
+native_output_file::native_output_file(const filesystem::path &file,
+                                       system::error_code &ec)
+    : handle(::CreateFileW(file.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL))
+{
+    if (handle == INVALID_HANDLE_VALUE) {
+        ec = system::error_code(::GetLastError(), system::system_category());
+        handle = nullptr;
+        return;
+    }
+
+    ec.clear();
+}
+
+native_output_file::native_output_file(native_output_file &&o)
+    : handle(o.handle)
+{
+    o.handle = nullptr;
+}
+
+native_output_file::~native_output_file()
+{
+    if (handle)
+        ::CloseHandle(handle);
+}
+
+void native_output_file::write_at(std::uintmax_t offset, const void *data,
+                                  std::size_t size,
+                                  system::error_code &ec) const
+{
+    auto p = static_cast<const char*>(data);
+    while (size) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD ret;
+        if (!::WriteFile(handle, p,
+                         static_cast<DWORD>(std::min<std::size_t>(size,
+                                                                  0x7fffffff)),
+                         &ret, &overlapped)) {
+            ec = system::error_code(::GetLastError(),
+                                    system::system_category());
+            return;
+        }
+
+        p += ret;
+        size -= ret;
+        offset += ret;
+    }
+
+    ec.clear();
+}
+
+#else
+
+native_output_file::native_output_file(const filesystem::path &file,
+                                       system::error_code &ec)
+    : fd(::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666))
+{
+    pipe_fds[0] = pipe_fds[1] = -1;
+
+    if (fd == -1) {
+        ec = system::error_code(errno, system::system_category());
+        return;
+    }
+
+    ec.clear();
+}
+
+native_output_file::native_output_file(native_output_file &&o)
+    : fd(o.fd)
+{
+    pipe_fds[0] = o.pipe_fds[0];
+    pipe_fds[1] = o.pipe_fds[1];
+    o.fd = o.pipe_fds[0] = o.pipe_fds[1] = -1;
+}
+
+native_output_file::~native_output_file()
+{
+    for (int d: {fd, pipe_fds[0], pipe_fds[1]}) {
+        if (d != -1)
+            ::close(d);
+    }
+}
+
+void native_output_file::write_at(std::uintmax_t offset, const void *data,
+                                  std::size_t size,
+                                  system::error_code &ec) const
+{
+    auto p = static_cast<const char*>(data);
+    while (size) {
+        auto ret = ::pwrite(fd, p, size, offset);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+
+            ec = system::error_code(errno, system::system_category());
+            return;
+        }
+
+        p += ret;
+        size -= ret;
+        offset += ret;
+    }
+
+    ec.clear();
+}
+
+#endif // BOOST_WINDOWS_API
+
+std::size_t native_output_file::splice(int in, std::uintmax_t &offset,
+                                       std::uintmax_t count,
+                                       system::error_code &ec)
+{
+#ifdef __linux__
+    if (pipe_fds[0] == -1) {
+        if (::pipe2(pipe_fds, O_CLOEXEC) == -1) {
+            ec = system::error_code(errno, system::system_category());
+            return 0;
+        }
+
+        // A larger pipe takes fewer calls per body (it's fine if not allowed)
+        ::fcntl(pipe_fds[1], F_SETPIPE_SZ, 1024 * 1024);
+    }
+
+    const std::uintmax_t max_count = 0x7ffff000;
+
+    ::ssize_t ret;
+    do {
+        ret = ::splice(in, NULL, pipe_fds[1], NULL, std::min(count, max_count),
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        ec = system::error_code(errno, system::system_category());
+        return 0;
+    }
+
+    // The pipe is always drained, so it's empty on the next call
+    const std::size_t moved = ret;
+    std::size_t left = moved;
+    while (left) {
+        ::loff_t off = offset;
+        ret = ::splice(pipe_fds[0], NULL, fd, &off, left, SPLICE_F_MOVE);
+
+        if (ret == -1 && errno == EINVAL) {
+            // The filesystem doesn't support splice, so copy through userspace
+            char buffer[16384];
+            ret = ::read(pipe_fds[0], buffer, std::min(left, sizeof(buffer)));
+            if (ret > 0) {
+                write_at(offset, buffer, ret, ec);
+                if (ec)
+                    return 0;
+            }
+        }
+
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+
+            ec = system::error_code(errno, system::system_category());
+            return 0;
+        }
+
+        offset += ret;
+        left -= ret;
+    }
+
+    ec.clear();
+    return moved;
+#else
+    (void) in;
+    (void) offset;
+    (void) count;
+    ec = system::errc::make_error_code(system::errc::operation_not_supported);
+    return 0;
+#endif // __linux__
+}
+
+} // namespace detail
+
 } // namespace http
 } // namespace boost
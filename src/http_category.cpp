@@ -35,6 +35,14 @@ std::string http_category_impl::message(int condition) const noexcept
     case static_cast<int>(http_errc::wrong_direction):
         return "You're trying to use a server channel in client mode or vice"
             " versa!";
+    case static_cast<int>(http_errc::url_too_long):
+        return "The request target is longer than the socket limits allow";
+    case static_cast<int>(http_errc::headers_too_large):
+        return "The header section is larger than the socket limits allow";
+    case static_cast<int>(http_errc::body_too_large):
+        return "The body is larger than the socket limits allow";
+    case static_cast<int>(http_errc::content_length_mismatch):
+        return "The response doesn't match its content-length framing";
     default:
         return "undefined";
     }
@@ -0,0 +1,415 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+/* Only built on Linux when the USE_IO_URING CMake option is on. The kernel
+   interface is used directly, so liburing isn't needed. */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <boost/asio/error.hpp>
+
+#include <boost/http/file_read_service.hpp>
+
+namespace boost {
+namespace http {
+namespace detail {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+    return ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags)
+{
+    return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                     nullptr, 0);
+}
+
+unsigned load_acquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned *p, unsigned value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+/* A single ring shared by all the reads of an io_service. A dedicated thread
+   reaps the completions, which the kernel delivers in batches. New reads are
+   only queued in the submission ring and that thread submits them all together
+   with its next wait, so a busy ring costs far less than a syscall per read.
+   The calling thread submits by itself whenever the reaper is blocked in the
+   kernel, so a read never waits for the completion of an unrelated (maybe
+   slow) read. */
+class io_uring_file_read_engine: public file_read_engine
+{
+public:
+    explicit io_uring_file_read_engine(int ring_fd);
+    ~io_uring_file_read_engine();
+
+    // Returns false if the rings cannot be mapped
+    bool map(const io_uring_params &params);
+
+    void start();
+
+    void async_read_at(std::shared_ptr<const native_file> file,
+                       std::uintmax_t offset, asio::mutable_buffer buffer,
+                       handler_type handler) override;
+
+private:
+    struct operation
+    {
+        std::shared_ptr<const native_file> file;
+        std::uintmax_t offset;
+        ::iovec iov;
+        std::size_t size;
+        handler_type handler;
+    };
+
+    // user_data of the NOP used to wake up the reaper
+    static const std::uint64_t wakeup = 0;
+
+    // Entries of the submission ring not consumed by the kernel yet
+    unsigned queued() const
+    {
+        return *sq_tail - load_acquire(sq_head);
+    }
+
+    /* The kernel would drop (or make us wait for) the completions that don't
+       fit in the completion queue. One entry is left for the wakeup NOP. */
+    bool has_room() const
+    {
+        return inflight + 1 < cq_entries && queued() + 1 < sq_entries;
+    }
+
+    // Requires the mutex. Queues op (in backlog if there's no room).
+    void submit(operation *op);
+
+    /* Requires the mutex. Only fills the next entry of the submission ring
+       (see flush). */
+    void push(std::uint8_t opcode, int fd, std::uintmax_t offset,
+              const ::iovec *iov, std::uint64_t user_data);
+
+    /* Requires the mutex. Submits the queued entries. The ones the kernel
+       doesn't consume stay queued for the next submission. */
+    void flush();
+
+    void run();
+
+    int ring_fd;
+
+    void *sq_ring = MAP_FAILED;
+    std::size_t sq_ring_size = 0;
+    void *cq_ring = MAP_FAILED;
+    std::size_t cq_ring_size = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqes_size = 0;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+    unsigned cq_entries;
+
+    std::mutex mutex;
+    // Reads not submitted because the completion queue could overflow
+    std::deque<operation*> backlog;
+    // Reads in the submission ring or in the kernel
+    std::size_t inflight = 0;
+    // The reaper is (or is about to be) blocked waiting for completions
+    bool reaper_waiting = false;
+    bool stopping = false;
+    std::thread reaper;
+};
+
+io_uring_file_read_engine::io_uring_file_read_engine(int ring_fd)
+    : ring_fd(ring_fd)
+{}
+
+io_uring_file_read_engine::~io_uring_file_read_engine()
+{
+    if (reaper.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            push(IORING_OP_NOP, -1, 0, nullptr, wakeup);
+            flush();
+        }
+        reaper.join();
+    }
+
+    if (sqes != MAP_FAILED)
+        ::munmap(sqes, sqes_size);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        ::munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+        ::munmap(sq_ring, sq_ring_size);
+    ::close(ring_fd);
+}
+
+bool io_uring_file_read_engine::map(const io_uring_params &params)
+{
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes
+        + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+        return false;
+
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            return false;
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size,
+                                             PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE,
+                                             ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+        return false;
+
+    auto sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries = params.sq_entries;
+
+    auto cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    cq_entries = params.cq_entries;
+
+    return true;
+}
+
+void io_uring_file_read_engine::start()
+{
+    reaper = std::thread([this]() { run(); });
+}
+
+void io_uring_file_read_engine
+::async_read_at(std::shared_ptr<const native_file> file, std::uintmax_t offset,
+                asio::mutable_buffer buffer, handler_type handler)
+{
+    auto op = new operation;
+    op->file = std::move(file);
+    op->offset = offset;
+    op->iov.iov_base = asio::buffer_cast<void*>(buffer);
+    op->iov.iov_len = asio::buffer_size(buffer);
+    op->size = op->iov.iov_len;
+    op->handler = std::move(handler);
+
+    // READV would report the end of the file
+    if (op->size == 0) {
+        op->handler(system::error_code{}, 0);
+        delete op;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    submit(op);
+
+    /* A reaper busy with completions submits the read together with the
+       other reads queued meanwhile, right before it waits again */
+    if (reaper_waiting)
+        flush();
+}
+
+void io_uring_file_read_engine::submit(operation *op)
+{
+    if (!has_room()) {
+        backlog.push_back(op);
+        return;
+    }
+
+    auto done = op->size - op->iov.iov_len;
+    push(IORING_OP_READV, op->file->native_handle(), op->offset + done,
+         &op->iov, reinterpret_cast<std::uint64_t>(op));
+    ++inflight;
+}
+
+void io_uring_file_read_engine::push(std::uint8_t opcode, int fd,
+                                     std::uintmax_t offset, const ::iovec *iov,
+                                     std::uint64_t user_data)
+{
+    // This is the only producer, so the tail can be read without a barrier
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+
+    io_uring_sqe &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<std::uint64_t>(iov);
+    sqe.len = iov ? 1 : 0;
+    sqe.user_data = user_data;
+
+    sq_array[index] = index;
+    store_release(sq_tail, tail + 1);
+}
+
+void io_uring_file_read_engine::flush()
+{
+    /* A failure (e.g. EAGAIN) leaves the entries queued. The reaper submits
+       them again before it waits. */
+    int ret;
+    do {
+        ret = io_uring_enter(ring_fd, queued(), 0, 0);
+    } while (ret == -1 && errno == EINTR);
+}
+
+void io_uring_file_read_engine::run()
+{
+    struct completion
+    {
+        operation *op;
+        system::error_code ec;
+    };
+
+    std::vector<io_uring_cqe> batch;
+    std::vector<completion> completions;
+
+    while (true) {
+        unsigned to_submit;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            to_submit = queued();
+            reaper_waiting = true;
+        }
+
+        /* The entries the kernel doesn't consume (ret < to_submit) stay queued
+           and are submitted again on the next iteration. An entry the kernel
+           refuses gets a failed completion, so the wait still ends. */
+        int ret = io_uring_enter(ring_fd, to_submit, 1,
+                                 IORING_ENTER_GETEVENTS);
+        if (ret == -1 && errno != EINTR && errno != EAGAIN
+            && errno != EBUSY) {
+            /* Unrecoverable ring. There is nothing sensible to do with the
+               reads still in the kernel. */
+            std::terminate();
+        }
+
+        batch.clear();
+        unsigned head = *cq_head;
+        unsigned tail = load_acquire(cq_tail);
+        for (;head != tail;++head)
+            batch.push_back(cqes[head & *cq_mask]);
+        store_release(cq_head, head);
+
+        completions.clear();
+        bool exit;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reaper_waiting = false;
+
+            for (const auto &cqe: batch) {
+                if (cqe.user_data == wakeup)
+                    continue;
+
+                --inflight;
+                auto op = reinterpret_cast<operation*>(cqe.user_data);
+                system::error_code ec;
+
+                if (cqe.res < 0) {
+                    ec = system::error_code(-cqe.res,
+                                            system::system_category());
+                } else if (cqe.res == 0) {
+                    ec = asio::error::eof;
+                } else {
+                    op->iov.iov_base = static_cast<char*>(op->iov.iov_base)
+                        + cqe.res;
+                    op->iov.iov_len -= cqe.res;
+
+                    // short read
+                    if (op->iov.iov_len) {
+                        submit(op);
+                        continue;
+                    }
+                }
+
+                completions.push_back(completion{op, ec});
+            }
+
+            while (!backlog.empty() && has_room()) {
+                auto op = backlog.front();
+                backlog.pop_front();
+                submit(op);
+            }
+
+            exit = stopping && inflight == 0 && backlog.empty();
+        }
+
+        for (auto &c: completions) {
+            c.op->handler(c.ec, c.op->size - c.op->iov.iov_len);
+            delete c.op;
+        }
+
+        if (exit)
+            return;
+    }
+}
+
+} // namespace
+
+std::shared_ptr<file_read_engine> make_io_uring_file_read_engine()
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    // Kernels without io_uring (or with it disabled) fail here
+    int fd = io_uring_setup(256, &params);
+    if (fd == -1)
+        return nullptr;
+
+    auto ret = std::make_shared<io_uring_file_read_engine>(fd);
+    if (!ret->map(params))
+        return nullptr;
+
+    ret->start();
+    return ret;
+}
+
+} // namespace detail
+} // namespace http
+} // namespace boost
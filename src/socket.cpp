@@ -4,8 +4,18 @@
    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
 
 #include <stdexcept>
+#include <mutex>
+#include <vector>
+#include <limits>
+#include <algorithm>
 #include <boost/http/socket.hpp>
 
+/* Bytes of idle slabs the pool keeps for each size class. Only read when the
+   library itself is built. */
+#ifndef BOOST_HTTP_SLAB_POOL_CLASS_BYTES
+#define BOOST_HTTP_SLAB_POOL_CLASS_BYTES 1048576
+#endif // BOOST_HTTP_SLAB_POOL_CLASS_BYTES
+
 using boost::http::detail::http_parser;
 using boost::http::detail::http_parser_settings;
 
@@ -24,6 +34,8 @@ std::size_t http_parser_execute(http_parser *parser,
 int http_should_keep_alive(const http_parser *parser);
 int http_body_is_final(const http_parser *parser);
 
+enum flags { F_CHUNKED = 1 << 0 };
+
 #define HTTP_ERRNO_MAP(XX)                                           \
   /* No error */                                                     \
   XX(OK, "success")                                                  \
@@ -116,6 +128,79 @@ BOOST_HTTP_DECL bool body_is_final(const http_parser &parser)
     return http_body_is_final(&parser);
 }
 
+BOOST_HTTP_DECL bool body_is_identity(const http_parser &parser)
+{
+    // ULLONG_MAX means no "content-length" header was received
+    return !(parser.flags & F_CHUNKED) && parser.content_length != 0
+        && parser.content_length != std::numeric_limits<std::uint64_t>::max();
+}
+
+namespace {
+
+struct slab_pool
+{
+    std::mutex mutex;
+
+    // Indexed by log2 of the slab size
+    std::vector<void*> free_slabs[std::numeric_limits<std::size_t>::digits];
+};
+
+slab_pool &get_slab_pool()
+{
+    /* Never destroyed, so sockets outliving static destruction can still give
+       their slabs back. */
+    static slab_pool *pool = new slab_pool;
+    return *pool;
+}
+
+std::size_t size_class(std::size_t size)
+{
+    std::size_t ret = 0;
+    while (size >>= 1)
+        ++ret;
+    return ret;
+}
+
+} // namespace
+
+BOOST_HTTP_DECL void *acquire_slab(std::size_t size)
+{
+    auto &pool = get_slab_pool();
+    auto &free_slabs = pool.free_slabs[size_class(size)];
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (free_slabs.size()) {
+            auto slab = free_slabs.back();
+            free_slabs.pop_back();
+            return slab;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+BOOST_HTTP_DECL void release_slab(void *slab, std::size_t size)
+{
+    auto &pool = get_slab_pool();
+    auto &free_slabs = pool.free_slabs[size_class(size)];
+
+    // At least one slab is kept, whatever its size
+    auto max_slabs = std::max<std::size_t>(BOOST_HTTP_SLAB_POOL_CLASS_BYTES
+                                           / size, 1);
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (free_slabs.size() < max_slabs) {
+            free_slabs.push_back(slab);
+            return;
+        }
+    }
+
+    // The surplus of a burst of connections goes back to the system
+    ::operator delete(slab);
+}
+
 } // namespace detail
 } // namespace http
 } // namespace boost
@@ -0,0 +1,263 @@
+/* Copyright (c) 2016 Vinícius dos Santos Oliveira
+
+   Distributed under the Boost Software License, Version 1.0. (See accompanying
+   file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt) */
+
+#include <boost/filesystem/operations.hpp>
+
+#include <boost/http/stat_cache.hpp>
+#include <boost/http/file_server.hpp>
+
+#ifndef BOOST_WINDOWS_API
+#include <cerrno>
+#include <sys/stat.h>
+#endif // BOOST_WINDOWS_API
+
+namespace boost {
+namespace http {
+
+namespace {
+
+void append_hex(std::string &out, std::uintmax_t n)
+{
+    char digits[16];
+    char *first = digits + sizeof(digits);
+    do {
+        *--first = "0123456789abcdef"[n % 16];
+        n /= 16;
+    } while (n);
+    out.append(first, digits + sizeof(digits));
+}
+
+} // namespace
+
+stat_cache::stat_cache(const filesystem::path &root_dir,
+                       std::size_t max_entries, clock_type::duration ttl,
+                       bool precompressed, std::size_t max_open_files)
+    : root(root_dir)
+    , max_entries(max_entries)
+    , ttl(ttl)
+    , precompressed_(precompressed)
+    , max_open_files(max_open_files)
+    , open_files(std::make_shared<std::atomic<std::size_t>>(0))
+{}
+
+const filesystem::path &stat_cache::root_dir() const
+{
+    return root;
+}
+
+bool stat_cache::precompressed() const
+{
+    return precompressed_;
+}
+
+std::shared_ptr<const stat_cache::entry>
+stat_cache::lookup(const filesystem::path &relative_path,
+                   system::error_code &ec)
+{
+    const auto &key = relative_path.native();
+    auto now = clock_type::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            if (now < it->second.expiry) {
+                lru.splice(lru.begin(), lru, it->second.lru);
+                ec.clear();
+                return it->second.value;
+            }
+
+            lru.erase(it->second.lru);
+            entries.erase(it);
+        }
+
+        // their descriptors are given back before the file is opened
+        evict_expired(now);
+    }
+
+    // the filesystem is accessed without holding the lock
+    auto value = resolve(relative_path, ec);
+    if (!value || max_entries == 0)
+        return value;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        // another thread resolved the same path meanwhile
+        it->second.value = value;
+        it->second.expiry = now + ttl;
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return value;
+    }
+
+    if (entries.size() == max_entries) {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+
+    lru.push_front(key);
+    entries.emplace(key, node{value, now + ttl, lru.begin()});
+    return value;
+}
+
+void stat_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+}
+
+std::shared_ptr<const stat_cache::entry>
+stat_cache::resolve(const filesystem::path &relative_path,
+                    system::error_code &ec) const
+{
+    auto canonical_root = filesystem::canonical(root, ec);
+    if (ec)
+        return nullptr;
+
+    auto ret = std::make_shared<entry>();
+    ret->path = canonical_root / relative_path;
+
+    if (!detail::path_contains_file(canonical_root, ret->path)) {
+        ec = file_server_errc::file_not_found;
+        return nullptr;
+    }
+
+    if (!stat(*ret, ec))
+        return nullptr;
+
+    open(*ret);
+
+    if (precompressed_) {
+        // a missing (or unusable) sibling just isn't offered
+        system::error_code ignored;
+
+        /* the etag of each representation must be unique, even when the
+           metadata of the siblings is the same */
+        auto br = std::make_shared<entry>();
+        br->path = ret->path.native() + ".br";
+        if (stat(*br, ignored)) {
+            br->etag.insert(br->etag.size() - 1, "-br");
+            open(*br);
+            ret->br = std::move(br);
+        }
+
+        auto gzip = std::make_shared<entry>();
+        gzip->path = ret->path.native() + ".gz";
+        if (stat(*gzip, ignored)) {
+            gzip->etag.insert(gzip->etag.size() - 1, "-gz");
+            open(*gzip);
+            ret->gzip = std::move(gzip);
+        }
+    }
+
+    return ret;
+}
+
+bool stat_cache::stat(entry &ret, system::error_code &ec)
+{
+#ifdef BOOST_WINDOWS_API
+    // ec is also set when the file doesn't exist
+    auto status = filesystem::status(ret.path, ec);
+    if (status.type() == filesystem::file_not_found) {
+        ec = file_server_errc::file_not_found;
+        return false;
+    }
+
+    if (ec)
+        return false;
+
+    if (!filesystem::is_regular_file(status)) {
+        ec = file_server_errc::file_type_not_supported;
+        return false;
+    }
+
+    ret.size = filesystem::file_size(ret.path, ec);
+    if (ec)
+        return false;
+
+    ret.last_write_time = filesystem::last_write_time(ret.path, ec);
+    if (ec)
+        return false;
+
+    /* a file rewritten within the same second with the same size would keep
+       the etag, so it can only be weak */
+    ret.etag.append("W/\"");
+    append_hex(ret.etag, ret.last_write_time);
+    ret.etag.push_back('-');
+    append_hex(ret.etag, ret.size);
+    ret.etag.push_back('"');
+#else
+    struct ::stat st;
+    if (::stat(ret.path.c_str(), &st) == -1) {
+        if (errno == ENOENT || errno == ENOTDIR)
+            ec = file_server_errc::file_not_found;
+        else
+            ec.assign(errno, system::system_category());
+        return false;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        ec = file_server_errc::file_type_not_supported;
+        return false;
+    }
+
+#ifdef __APPLE__
+    const auto &mtime = st.st_mtimespec;
+#else
+    const auto &mtime = st.st_mtim;
+#endif // __APPLE__
+
+    ret.size = st.st_size;
+    ret.last_write_time = mtime.tv_sec;
+
+    /* the inode and the nanoseconds tell apart a file replaced (or rewritten)
+       within the same second with the same size */
+    ret.etag.push_back('"');
+    append_hex(ret.etag, st.st_ino);
+    ret.etag.push_back('-');
+    append_hex(ret.etag, mtime.tv_sec);
+    ret.etag.push_back('.');
+    append_hex(ret.etag, mtime.tv_nsec);
+    ret.etag.push_back('-');
+    append_hex(ret.etag, ret.size);
+    ret.etag.push_back('"');
+#endif // BOOST_WINDOWS_API
+
+    return true;
+}
+
+void stat_cache::open(entry &ret) const
+{
+    auto budget = open_files;
+    if (++*budget > max_open_files) {
+        --*budget;
+        return;
+    }
+
+    std::shared_ptr<const detail::native_file>
+        file(new detail::native_file(ret.path),
+             [budget](const detail::native_file *file) {
+                 delete file;
+                 --*budget;
+             });
+    if (file->is_open())
+        ret.file = std::move(file);
+}
+
+void stat_cache::evict_expired(clock_type::time_point now)
+{
+    while (lru.size()) {
+        auto it = entries.find(lru.back());
+        if (now < it->second.expiry)
+            return;
+
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+} // namespace http
+} // namespace boost
@@ -0,0 +1,295 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <zlib.h>
+
+#include <boost/http/compressing_socket.hpp>
+#include <boost/http/socket.hpp>
+#include "mocksocket.hpp"
+
+using namespace boost;
+using namespace std;
+
+typedef http::basic_compressing_socket<http::basic_socket<mock_socket>>
+    compressing_socket;
+
+// Decodes the chunked body that follows the headers of the response at begin
+string chunked_body(const string &output, string::size_type begin)
+{
+    string ret;
+    auto i = output.find("\r\n\r\n", begin) + 4;
+    for (;;) {
+        auto size = stoul(output.substr(i), nullptr, 16);
+        i = output.find("\r\n", i) + 2;
+        if (size == 0)
+            return ret;
+        ret.append(output, i, size);
+        i += size + 2;
+    }
+}
+
+string inflate(const string &input, int window_bits)
+{
+    z_stream stream = {};
+    BOOST_REQUIRE_EQUAL(inflateInit2(&stream, window_bits), Z_OK);
+    stream.next_in = (Bytef*)(input.data());
+    stream.avail_in = input.size();
+
+    string ret;
+    char buffer[256];
+    int res;
+    do {
+        stream.next_out = (Bytef*)(buffer);
+        stream.avail_out = sizeof(buffer);
+        res = inflate(&stream, Z_NO_FLUSH);
+        ret.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (res == Z_OK);
+    BOOST_CHECK_EQUAL(res, Z_STREAM_END);
+    inflateEnd(&stream);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(compressing_socket_streaming) {
+    asio::io_service ios;
+    char inbuffer[1024];
+    compressing_socket socket(ios, asio::buffer(inbuffer));
+    string request = "GET / HTTP/1.1\r\n"
+        "accept-encoding: deflate;q=0.5, gzip\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "accept-encoding: gzip;q=0, deflate\r\n"
+        "\r\n";
+    socket.next_layer().next_layer().input_buffer
+        .emplace_back(request.begin(), request.end());
+
+    string method;
+    string path;
+    http::message imessage;
+    http::message omessage;
+    omessage.headers().emplace("content-type", "text/plain; charset=utf-8");
+    omessage.headers().emplace("etag", "\"v1\"");
+    string contents(4000, 'a');
+    int responses = 0;
+
+    std::function<void()> serve = [&]() {
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            if (ec)
+                return;
+
+            socket.async_write_response_metadata(200, string_ref("OK"),
+                                                 omessage,
+                                                 [&](const system::error_code
+                                                     &ec) {
+                BOOST_REQUIRE(!ec);
+                BOOST_CHECK(socket.write_state()
+                            == http::write_state::metadata_issued);
+                omessage.body().assign(contents.begin(),
+                                       contents.begin() + 1000);
+                socket.async_write(omessage, [&](const system::error_code
+                                                 &ec) {
+                    BOOST_REQUIRE(!ec);
+                    omessage.body().assign(contents.begin() + 1000,
+                                           contents.end());
+                    socket.async_write(omessage, [&](const system::error_code
+                                                     &ec) {
+                        BOOST_REQUIRE(!ec);
+                        socket.async_write_end_of_message
+                            ([&](const system::error_code &ec) {
+                                BOOST_REQUIRE(!ec);
+                                BOOST_CHECK(socket.write_state()
+                                            == http::write_state::finished);
+                                ++responses;
+                                serve();
+                            });
+                    });
+                });
+            });
+        });
+    };
+    serve();
+    ios.run();
+    BOOST_REQUIRE_EQUAL(responses, 2);
+
+    string output(socket.next_layer().next_layer().output_buffer.begin(),
+                  socket.next_layer().next_layer().output_buffer.end());
+    auto second = output.find("HTTP/1.1 200 OK\r\n", 1);
+    BOOST_REQUIRE(second != string::npos);
+
+    string first_response = output.substr(0, second);
+    BOOST_CHECK(first_response.find("content-encoding: gzip\r\n")
+                != string::npos);
+    BOOST_CHECK(first_response.find("vary: accept-encoding\r\n")
+                != string::npos);
+    BOOST_CHECK(first_response.find("etag: W/\"v1\"\r\n") != string::npos);
+    BOOST_CHECK(first_response.find("transfer-encoding: chunked\r\n")
+                != string::npos);
+    BOOST_CHECK(inflate(chunked_body(output, 0), 15 + 16) == contents);
+
+    BOOST_CHECK(output.find("content-encoding: deflate\r\n", second)
+                != string::npos);
+    BOOST_CHECK(inflate(chunked_body(output, second), 15) == contents);
+}
+
+BOOST_AUTO_TEST_CASE(compressing_socket_filters) {
+    asio::io_service ios;
+    char inbuffer[1024];
+    compressing_socket socket(ios, asio::buffer(inbuffer));
+    string request = "GET / HTTP/1.1\r\n"
+        "accept-encoding: gzip\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "accept-encoding: gzip\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "accept-encoding: gzip\r\n"
+        "\r\n";
+    socket.next_layer().next_layer().input_buffer
+        .emplace_back(request.begin(), request.end());
+
+    string method;
+    string path;
+    http::message imessage;
+    http::message omessages[3];
+    string contents(2000, 'a');
+
+    // compressed
+    omessages[0].headers().emplace("content-type", "application/json");
+    omessages[0].body().assign(contents.begin(), contents.end());
+
+    // too small
+    omessages[1].headers().emplace("content-type", "text/html");
+    omessages[1].body().assign(contents.begin(), contents.begin() + 10);
+
+    // rejected media type
+    omessages[2].headers().emplace("content-type", "image/png");
+    omessages[2].body().assign(contents.begin(), contents.end());
+
+    int responses = 0;
+    std::function<void()> serve = [&]() {
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            if (ec)
+                return;
+
+            socket.async_write_response(200, string_ref("OK"),
+                                        omessages[responses],
+                                        [&](const system::error_code &ec) {
+                BOOST_REQUIRE(!ec);
+                ++responses;
+                serve();
+            });
+        });
+    };
+    serve();
+    ios.run();
+    BOOST_REQUIRE_EQUAL(responses, 3);
+
+    string output(socket.next_layer().next_layer().output_buffer.begin(),
+                  socket.next_layer().next_layer().output_buffer.end());
+    auto second = output.find("HTTP/1.1 200 OK\r\n", 1);
+    auto third = output.find("HTTP/1.1 200 OK\r\n", second + 1);
+    BOOST_REQUIRE(third != string::npos);
+
+    BOOST_CHECK(output.find("content-encoding: gzip\r\n") < second);
+    auto body = output.find("\r\n\r\n") + 4;
+    BOOST_CHECK(inflate(output.substr(body, second - body), 15 + 16)
+                == contents);
+
+    BOOST_CHECK(output.find("content-encoding", second) == string::npos);
+    BOOST_CHECK(output.find("content-length: 10\r\n", second) < third);
+    BOOST_CHECK(output.find("content-length: 2000\r\n", third)
+                != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(compressing_socket_head) {
+    asio::io_service ios;
+    char inbuffer[1024];
+    compressing_socket socket(ios, asio::buffer(inbuffer));
+    string request = "GET / HTTP/1.1\r\n"
+        "accept-encoding: br\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "accept-encoding: gzip\r\n"
+        "\r\n"
+        "HEAD / HTTP/1.1\r\n"
+        "accept-encoding: gzip\r\n"
+        "\r\n"
+        "HEAD / HTTP/1.1\r\n"
+        "accept-encoding: gzip\r\n"
+        "\r\n";
+    socket.next_layer().next_layer().input_buffer
+        .emplace_back(request.begin(), request.end());
+
+    string method;
+    string path;
+    http::message imessage;
+    http::message omessages[4];
+    string contents(2000, 'a');
+    for (auto &m: omessages) {
+        m.headers().emplace("content-type", "text/plain");
+        m.headers().emplace("etag", "\"v1\"");
+    }
+    for (int i = 0; i != 3; ++i)
+        omessages[i].body().assign(contents.begin(), contents.end());
+
+    // answer to a HEAD request without the body
+    omessages[3].headers().emplace("content-length", "2000");
+
+    int responses = 0;
+    std::function<void()> serve = [&]() {
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            if (ec)
+                return;
+
+            socket.async_write_response(200, string_ref("OK"),
+                                        omessages[responses],
+                                        [&](const system::error_code &ec) {
+                BOOST_REQUIRE(!ec);
+                ++responses;
+                serve();
+            });
+        });
+    };
+    serve();
+    ios.run();
+    BOOST_REQUIRE_EQUAL(responses, 4);
+
+    string output(socket.next_layer().next_layer().output_buffer.begin(),
+                  socket.next_layer().next_layer().output_buffer.end());
+    string response[4];
+    string::size_type begin = 0;
+    for (int i = 0; i != 4; ++i) {
+        auto end = output.find("HTTP/1.1 200 OK\r\n", begin + 1);
+        response[i] = output.substr(begin, end - begin);
+        begin = end;
+    }
+
+    // no coding accepted: the body is written as is
+    BOOST_CHECK(response[0].find("vary: accept-encoding\r\n") != string::npos);
+    BOOST_CHECK(response[0].find("content-encoding") == string::npos);
+    BOOST_CHECK(response[0].find("etag: \"v1\"\r\n") != string::npos);
+    BOOST_CHECK(response[0].find("content-length: 2000\r\n\r\n" + contents)
+                != string::npos);
+
+    // HEAD gets the same headers as GET, but no body
+    auto headers = response[1].substr(0, response[1].find("\r\n\r\n") + 4);
+    BOOST_CHECK(headers.find("content-encoding: gzip\r\n") != string::npos);
+    BOOST_CHECK(headers.find("vary: accept-encoding\r\n") != string::npos);
+    BOOST_CHECK(headers.find("etag: W/\"v1\"\r\n") != string::npos);
+    auto length = headers.find("content-length: ");
+    BOOST_REQUIRE(length != string::npos);
+    BOOST_CHECK_EQUAL(response[2].size(), headers.size());
+    BOOST_CHECK(response[2].find(headers.substr(length,
+                                                headers.find("\r\n", length)
+                                                - length))
+                != string::npos);
+
+    // without the body, the compressed length is unknown
+    BOOST_CHECK(response[3].find("vary: accept-encoding\r\n") != string::npos);
+    BOOST_CHECK(response[3].find("content-encoding") == string::npos);
+    BOOST_CHECK(response[3].find("etag: \"v1\"\r\n") != string::npos);
+    BOOST_CHECK(response[3].find("content-length: 2000\r\n") != string::npos);
+    BOOST_CHECK_EQUAL(response[3].find("\r\n\r\n") + 4, response[3].size());
+}
@@ -2,7 +2,9 @@
 #include <boost/test/unit_test.hpp>
 
 #include <boost/utility/string_ref.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/http/algorithm/header.hpp>
+#include <boost/http/date_cache.hpp>
 
 template<class Target, class String>
 Target from_decimal_string(const String &value)
@@ -348,6 +350,13 @@ BOOST_AUTO_TEST_CASE(rfc1123_rfc1036_asctime) {
     BOOST_CHECK(!rfc1123(string_ref("Sun Nov  6 08:49:37 1994"), datetime));
     BOOST_CHECK(!rfc1123(string_ref("All your base are belong to us"),
                          datetime));
+    BOOST_CHECK(!rfc1123(string_ref("Sun, 06 Nov 1994 08:49:37 GM"),
+                         datetime));
+    BOOST_CHECK(!rfc1123(string_ref("Sun, 06 Nox 1994 08:49:37 GMT"),
+                         datetime));
+    BOOST_CHECK(!rfc1123(string_ref("Sun, 0a Nov 1994 08:49:37 GMT"),
+                         datetime));
+    BOOST_CHECK(!rfc1123(string_ref(""), datetime));
 
     BOOST_CHECK(!rfc1036(string_ref(" Sunday, 06-Nov-94 08:49:37 GMT"),
                          datetime));
@@ -369,6 +378,11 @@ BOOST_AUTO_TEST_CASE(rfc1123_rfc1036_asctime) {
     BOOST_CHECK(!rfc1036(string_ref("Sun Nov  6 08:49:37 1994"), datetime));
     BOOST_CHECK(!rfc1036(string_ref("All your base are belong to us"),
                          datetime));
+    BOOST_CHECK(!rfc1036(string_ref("Sunda, 06-Nov-94 08:49:37 GMT"),
+                         datetime));
+    BOOST_CHECK(!rfc1036(string_ref("Sunday, 06-Nov-94 08:49:37"),
+                         datetime));
+    BOOST_CHECK(!rfc1036(string_ref(""), datetime));
 
     BOOST_CHECK(!asctime(string_ref(" Tue Dec  1 00:00:00 1903"),
                          datetime));
@@ -393,6 +407,10 @@ BOOST_AUTO_TEST_CASE(rfc1123_rfc1036_asctime) {
                          datetime));
     BOOST_CHECK(!asctime(string_ref("All your base are belong to us"),
                          datetime));
+    BOOST_CHECK(!asctime(string_ref("Sun Nov 6  08:49:37 1994"),
+                         datetime));
+    BOOST_CHECK(!asctime(string_ref("Sun Nov  6 08:49:37 199"), datetime));
+    BOOST_CHECK(!asctime(string_ref(""), datetime));
 }
 
 BOOST_AUTO_TEST_CASE(header_to_ptime_case) {
@@ -457,6 +475,10 @@ BOOST_AUTO_TEST_CASE(to_http_date_case) {
                 == "Sun, 06 Nov 1994 08:49:37 GMT");
     BOOST_CHECK(to_http_date<string>(make_datetime(1903, 12, 1, 0, 0, 0))
                 == "Tue, 01 Dec 1903 00:00:00 GMT");
+    BOOST_CHECK(to_http_date<string>(make_datetime(2000, 2, 29, 23, 59, 59))
+                == "Tue, 29 Feb 2000 23:59:59 GMT");
+    BOOST_CHECK(to_http_date<string>(make_datetime(2100, 3, 1, 12, 0, 5))
+                == "Mon, 01 Mar 2100 12:00:05 GMT");
 
     const boost::posix_time::ptime invalid_ptime;
     bool exception_throw = false;
@@ -469,3 +491,16 @@ BOOST_AUTO_TEST_CASE(to_http_date_case) {
 
     BOOST_CHECK(exception_throw);
 }
+
+BOOST_AUTO_TEST_CASE(date_cache_case) {
+    using std::string;
+    using boost::http::to_http_date;
+
+    boost::asio::io_service ios;
+    auto &cache = boost::asio::use_service<boost::http::date_cache>(ios);
+
+    char date[boost::http::date_cache::size];
+    auto now = cache.now(date);
+    BOOST_CHECK(string(date, sizeof(date))
+                == to_http_date<string>(boost::posix_time::from_time_t(now)));
+}
@@ -1,9 +1,26 @@
 #define BOOST_TEST_MAIN
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <utility>
+
+#include <boost/filesystem/fstream.hpp>
+
 #include <boost/http/file_server.hpp>
+#include <boost/http/socket.hpp>
 #include "mocksocket.hpp"
 
+#ifdef BOOST_HTTP_USE_IO_URING
+#include <chrono>
+#include <future>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // BOOST_HTTP_USE_IO_URING
+
 using namespace boost;
 using namespace std;
 
@@ -50,3 +67,944 @@ BOOST_AUTO_TEST_CASE(resolve_dots_or_throw_not_found) {
     BOOST_CHECK_EQUAL(resolve_dots_or_throw_not_found(path{} / "abc" / ".."),
                       path{});
 }
+
+BOOST_AUTO_TEST_CASE(is_valid_range_case) {
+    using http::detail::is_valid_range;
+    typedef std::vector<std::pair<std::uintmax_t, std::uintmax_t>> range_set;
+
+    auto parse = [](const std::string &value, std::uintmax_t file_size) {
+        range_set ranges;
+        if (!is_valid_range(value, file_size, ranges))
+            ranges.clear();
+        return ranges;
+    };
+
+    BOOST_CHECK(parse("bytes=0-499", 10000) == (range_set{{0, 499}}));
+    BOOST_CHECK(parse("bytes=9500-", 10000) == (range_set{{9500, 9999}}));
+    BOOST_CHECK(parse("bytes=-500", 10000) == (range_set{{9500, 9999}}));
+    BOOST_CHECK(parse("bytes=0-99999", 10000) == (range_set{{0, 9999}}));
+    BOOST_CHECK(parse("bytes=-99999", 10000) == (range_set{{0, 9999}}));
+    BOOST_CHECK(parse("bytes=0-99999999999999999999999", 10000)
+                == (range_set{{0, 9999}}));
+    BOOST_CHECK(parse("bytes=-99999999999999999999999", 10000)
+                == (range_set{{0, 9999}}));
+    BOOST_CHECK(parse("bytes= 0-0 , 5000-5001", 10000)
+                == (range_set{{0, 0}, {5000, 5001}}));
+
+    // unsatisfiable specs are ignored
+    BOOST_CHECK(parse("bytes=10000-", 10000).empty());
+    BOOST_CHECK(parse("bytes=-0", 10000).empty());
+    BOOST_CHECK(parse("bytes=500-400", 10000).empty());
+    BOOST_CHECK(parse("bytes=99999999999999999999999-,0-0", 10000)
+                == (range_set{{0, 0}}));
+
+    // invalid
+    BOOST_CHECK(parse("bytes=", 10000).empty());
+    BOOST_CHECK(parse("bytes=-", 10000).empty());
+    BOOST_CHECK(parse("bytes=0-1-2", 10000).empty());
+    BOOST_CHECK(parse("bytes=a-1", 10000).empty());
+    BOOST_CHECK(parse("bytes=1-a", 10000).empty());
+    BOOST_CHECK(parse("bytes=0-1,0", 10000).empty());
+    BOOST_CHECK(parse("items=0-1", 10000).empty());
+
+    // overlapping, adjacent and nearby ranges are coalesced
+    BOOST_CHECK(parse("bytes=0-499,200-999", 10000)
+                == (range_set{{0, 999}}));
+    BOOST_CHECK(parse("bytes=0-499,500-999", 10000)
+                == (range_set{{0, 999}}));
+    BOOST_CHECK(parse("bytes=0-499,510-999", 10000)
+                == (range_set{{0, 999}}));
+    BOOST_CHECK(parse("bytes=0-0,0-0,0-0,0-0", 10000)
+                == (range_set{{0, 0}}));
+    BOOST_CHECK(parse("bytes=0-499,5000-5999", 10000)
+                == (range_set{{0, 499}, {5000, 5999}}));
+
+    // the order of the request is kept
+    BOOST_CHECK(parse("bytes=5000-5999,0-499,100-200,5500-", 10000)
+                == (range_set{{5000, 9999}, {0, 499}}));
+    BOOST_CHECK(parse("bytes=9000-9099,5000-5099,0-99,5050-5199", 10000)
+                == (range_set{{9000, 9099}, {5000, 5199}, {0, 99}}));
+}
+
+BOOST_AUTO_TEST_CASE(stat_cache_case) {
+    using filesystem::path;
+
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root / "dir");
+    {
+        filesystem::ofstream out(root / "file");
+        out << "0123456789";
+    }
+
+    system::error_code ec;
+
+    {
+        http::stat_cache cache(root);
+        BOOST_CHECK(cache.root_dir() == root);
+
+        auto entry = cache.lookup(path("file"), ec);
+        BOOST_REQUIRE(entry);
+        BOOST_CHECK(!ec);
+        BOOST_CHECK(entry->path == filesystem::canonical(root) / "file");
+        BOOST_CHECK_EQUAL(entry->size, 10);
+        BOOST_CHECK_EQUAL(entry->last_write_time,
+                          filesystem::last_write_time(root / "file"));
+        BOOST_CHECK(entry->etag.size() > 2);
+        BOOST_CHECK_EQUAL(entry->etag.front(), '"');
+        BOOST_CHECK_EQUAL(entry->etag.back(), '"');
+
+        // hits share the entry
+        BOOST_CHECK(cache.lookup(path("file"), ec) == entry);
+        cache.clear();
+        auto other = cache.lookup(path("file"), ec);
+        BOOST_REQUIRE(other);
+        BOOST_CHECK(other != entry);
+        BOOST_CHECK_EQUAL(other->etag, entry->etag);
+
+#ifndef BOOST_WINDOWS_API
+        /* a file replaced with the same size and the same last write time (in
+           seconds) gets another etag */
+        {
+            filesystem::ofstream out(root / "file.new");
+            out << "abcdefghij";
+        }
+        filesystem::last_write_time(root / "file.new",
+                                    filesystem::last_write_time(root
+                                                                / "file"));
+        filesystem::rename(root / "file.new", root / "file");
+        cache.clear();
+        other = cache.lookup(path("file"), ec);
+        BOOST_REQUIRE(other);
+        BOOST_CHECK_EQUAL(other->last_write_time, entry->last_write_time);
+        BOOST_CHECK(other->etag != entry->etag);
+#endif // BOOST_WINDOWS_API
+
+        BOOST_CHECK(!cache.lookup(path("missing"), ec));
+        BOOST_CHECK(ec == system::error_code(http::file_server_errc
+                                             ::file_not_found));
+
+        BOOST_CHECK(!cache.lookup(path("dir"), ec));
+        BOOST_CHECK(ec == system::error_code(http::file_server_errc
+                                             ::file_type_not_supported));
+    }
+
+    {
+        // entries are resolved again once the TTL expires
+        http::stat_cache cache(root, 1024, http::stat_cache::clock_type
+                               ::duration::zero());
+        auto entry = cache.lookup(path("file"), ec);
+        BOOST_REQUIRE(entry);
+        BOOST_CHECK(cache.lookup(path("file"), ec) != entry);
+    }
+
+    {
+        // the least recently used entry is evicted
+        {
+            filesystem::ofstream out(root / "file2");
+        }
+        http::stat_cache cache(root, 1);
+        auto entry = cache.lookup(path("file"), ec);
+        BOOST_REQUIRE(entry);
+        BOOST_REQUIRE(cache.lookup(path("file2"), ec));
+        BOOST_CHECK(cache.lookup(path("file"), ec) != entry);
+    }
+
+    {
+        // entries only keep max_open_files descriptors open
+        http::stat_cache cache(root, 1024, std::chrono::hours(1), false, 1);
+        auto entry = cache.lookup(path("file"), ec);
+        BOOST_REQUIRE(entry);
+        BOOST_CHECK(entry->file);
+        auto entry2 = cache.lookup(path("file2"), ec);
+        BOOST_REQUIRE(entry2);
+        BOOST_CHECK(!entry2->file);
+
+        // the descriptor is given back once its entry is gone
+        cache.clear();
+        entry.reset();
+        entry2 = cache.lookup(path("file2"), ec);
+        BOOST_REQUIRE(entry2);
+        BOOST_CHECK(entry2->file);
+    }
+
+    {
+        // expired entries give their descriptors back
+        http::stat_cache cache(root, 1024, http::stat_cache::clock_type
+                               ::duration::zero(), false, 1);
+        BOOST_REQUIRE(cache.lookup(path("file"), ec));
+        auto entry = cache.lookup(path("file2"), ec);
+        BOOST_REQUIRE(entry);
+        BOOST_CHECK(entry->file);
+    }
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(precompressed_case) {
+    using http::detail::accept_encoding;
+
+    {
+        http::headers headers;
+        auto qvalues = accept_encoding(headers);
+        BOOST_CHECK_EQUAL(qvalues.br, -1);
+        BOOST_CHECK_EQUAL(qvalues.gzip, -1);
+        BOOST_CHECK_EQUAL(qvalues.any, -1);
+
+        headers.emplace("accept-encoding", "GZIP;q=0.5, br ; Q=1.0");
+        headers.emplace("accept-encoding", "identity, *;q=0.25");
+        qvalues = accept_encoding(headers);
+        BOOST_CHECK_EQUAL(qvalues.br, 1000);
+        BOOST_CHECK_EQUAL(qvalues.gzip, 500);
+        BOOST_CHECK_EQUAL(qvalues.any, 250);
+
+        // malformed elements are ignored
+        headers.clear();
+        headers.emplace("accept-encoding", "br;q=2, gzip;q=0.1234, x-gzip;q=0");
+        qvalues = accept_encoding(headers);
+        BOOST_CHECK_EQUAL(qvalues.br, -1);
+        BOOST_CHECK_EQUAL(qvalues.gzip, 0);
+    }
+
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    {
+        filesystem::ofstream out(root / "file");
+        out << "0123456789";
+    }
+    {
+        filesystem::ofstream out(root / "file.gz");
+        out << "01234";
+    }
+
+    system::error_code ec;
+
+    {
+        http::stat_cache cache(root);
+        BOOST_CHECK(!cache.precompressed());
+        auto entry = cache.lookup(filesystem::path("file"), ec);
+        BOOST_REQUIRE(entry);
+        BOOST_CHECK(!entry->gzip);
+    }
+
+    http::stat_cache cache(root, 1024, std::chrono::seconds(1), true);
+    BOOST_CHECK(cache.precompressed());
+    auto entry = cache.lookup(filesystem::path("file"), ec);
+    BOOST_REQUIRE(entry);
+    BOOST_CHECK(!entry->br);
+    BOOST_REQUIRE(entry->gzip);
+    BOOST_CHECK(entry->gzip->path == entry->path.native() + ".gz");
+    BOOST_CHECK_EQUAL(entry->gzip->size, 5);
+    BOOST_CHECK(entry->gzip->etag != entry->etag);
+
+    http::headers headers;
+    BOOST_CHECK(http::detail::select_precompressed(*entry, headers).first
+                == entry.get());
+    headers.emplace("accept-encoding", "br, gzip");
+    auto selected = http::detail::select_precompressed(*entry, headers);
+    BOOST_CHECK(selected.first == entry->gzip.get());
+    BOOST_CHECK_EQUAL(selected.second, "gzip");
+    headers.clear();
+    headers.emplace("accept-encoding", "*;q=0");
+    BOOST_CHECK(http::detail::select_precompressed(*entry, headers).first
+                == entry.get());
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(stat_cache_etag_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    {
+        filesystem::ofstream out(root / "file");
+        out << "0123456789";
+    }
+
+    http::stat_cache cache(root);
+    system::error_code ec;
+    auto entry = cache.lookup(filesystem::path("file"), ec);
+    BOOST_REQUIRE(entry);
+    const auto &etag = entry->etag;
+
+    asio::io_service ios;
+    char inbuffer[1024];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+    std::string request = "GET /file HTTP/1.1\r\n"
+        "if-none-match: \"other\", " + etag + "\r\n"
+        "\r\n"
+        "HEAD /file HTTP/1.1\r\n"
+        "if-none-match: \"other\"\r\n"
+        "\r\n"
+        "GET /file HTTP/1.1\r\n"
+        "if-match: \"other\"\r\n"
+        "\r\n";
+    socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                  request.end());
+
+    std::string method;
+    std::string path;
+    http::message imessage;
+    http::message omessage;
+    int responses = 0;
+
+    std::function<void()> serve = [&]() {
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            if (ec)
+                return;
+
+            omessage.headers().clear();
+            http::async_response_transmit_dir(socket, method, path, imessage,
+                                              omessage, cache,
+                                              [&](const system::error_code
+                                                  &ec) {
+                BOOST_CHECK(!ec);
+                ++responses;
+                serve();
+            });
+        });
+    };
+    serve();
+    ios.run();
+    BOOST_CHECK_EQUAL(responses, 3);
+
+    std::string output(socket.next_layer().output_buffer.begin(),
+                       socket.next_layer().output_buffer.end());
+    auto not_modified = output.find("HTTP/1.1 304 Not Modified\r\n");
+    auto ok = output.find("HTTP/1.1 200 OK\r\n");
+    auto failed = output.find("HTTP/1.1 412 Precondition Failed\r\n");
+    BOOST_CHECK_EQUAL(not_modified, 0);
+    BOOST_REQUIRE(ok != std::string::npos);
+    BOOST_REQUIRE(failed != std::string::npos);
+    BOOST_CHECK(ok < failed);
+    BOOST_CHECK(output.find("etag: " + etag + "\r\n") < ok);
+    BOOST_CHECK(output.find("etag: " + etag + "\r\n", ok) < failed);
+    BOOST_CHECK(output.find("content-length: 10\r\n", ok) < failed);
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(file_cache_transmit_dir_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    {
+        filesystem::ofstream out(root / "file");
+        out << "0123456789";
+    }
+
+    http::stat_cache cache(root);
+    http::file_cache contents_cache;
+    system::error_code ec;
+    auto entry = cache.lookup(filesystem::path("file"), ec);
+    BOOST_REQUIRE(entry);
+    const auto &etag = entry->etag;
+
+    asio::io_service ios;
+    char inbuffer[1024];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+    std::string request = "GET /file HTTP/1.1\r\n"
+        "if-none-match: " + etag + "\r\n"
+        "\r\n"
+        "HEAD /file HTTP/1.1\r\n"
+        "\r\n"
+        "GET /file HTTP/1.1\r\n"
+        "if-match: \"other\"\r\n"
+        "\r\n"
+        "GET /file HTTP/1.1\r\n"
+        "range: bytes=2-4\r\n"
+        "\r\n"
+        "GET /file HTTP/1.1\r\n"
+        "\r\n";
+    socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                  request.end());
+
+    std::string method;
+    std::string path;
+    http::message imessage;
+    http::message omessage;
+    int responses = 0;
+
+    std::function<void()> serve = [&]() {
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            if (ec)
+                return;
+
+            omessage.headers().clear();
+            http::async_response_transmit_dir(socket, method, path, imessage,
+                                              omessage, cache, contents_cache,
+                                              [&](const system::error_code
+                                                  &ec) {
+                BOOST_CHECK(!ec);
+                // no body was sent so far, so nothing was read into the cache
+                if (++responses == 3)
+                    BOOST_CHECK(!contents_cache.find(*entry));
+                serve();
+            });
+        });
+    };
+    serve();
+    ios.run();
+    BOOST_CHECK_EQUAL(responses, 5);
+
+    auto stats = contents_cache.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+    BOOST_CHECK(contents_cache.find(*entry));
+
+    std::string output(socket.next_layer().output_buffer.begin(),
+                       socket.next_layer().output_buffer.end());
+    auto not_modified = output.find("HTTP/1.1 304 Not Modified\r\n");
+    auto head = output.find("HTTP/1.1 200 OK\r\n");
+    auto failed = output.find("HTTP/1.1 412 Precondition Failed\r\n");
+    auto partial = output.find("HTTP/1.1 206 Partial Content\r\n");
+    auto ok = output.find("HTTP/1.1 200 OK\r\n", partial);
+    BOOST_CHECK_EQUAL(not_modified, 0);
+    BOOST_CHECK(not_modified < head);
+    BOOST_CHECK(head < failed);
+    BOOST_CHECK(failed < partial);
+    BOOST_REQUIRE(ok != std::string::npos);
+    BOOST_CHECK(output.find("\r\n\r\n234", partial) < ok);
+    BOOST_CHECK_EQUAL(output.substr(output.size() - 14), "\r\n\r\n0123456789");
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(transmit_chunks_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    std::string contents;
+    for (int i = 0 ; i != 200 * 1024 ; ++i)
+        contents.push_back('a' + i % 26);
+    {
+        filesystem::ofstream out(root / "file");
+        out << contents;
+    }
+
+    asio::io_service ios;
+    char inbuffer[1024];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+    std::string request = "GET /file HTTP/1.1\r\n\r\n";
+    socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                  request.end());
+
+    std::string method;
+    std::string path;
+    http::message imessage;
+    http::message omessage;
+    bool served = false;
+
+    socket.async_read_request(method, path, imessage,
+                              [&](const system::error_code &ec) {
+        BOOST_REQUIRE(!ec);
+        http::async_response_transmit_file(socket, imessage, omessage,
+                                           root / "file",
+                                           [&](const system::error_code &ec) {
+            BOOST_CHECK(!ec);
+            served = true;
+        });
+    });
+    ios.run();
+    BOOST_REQUIRE(served);
+
+    // the chunks come from the pool, not from the user's message
+    BOOST_CHECK_EQUAL(omessage.body().capacity(), 0);
+
+    std::string output(socket.next_layer().output_buffer.begin(),
+                       socket.next_layer().output_buffer.end());
+    auto i = output.find("\r\n\r\n");
+    BOOST_REQUIRE(i != std::string::npos);
+    i += 4;
+
+    std::string body;
+    std::vector<std::size_t> chunk_sizes;
+    for (;;) {
+        auto size = std::stoul(output.substr(i), nullptr, 16);
+        i = output.find("\r\n", i) + 2;
+        if (size == 0)
+            break;
+        chunk_sizes.push_back(size);
+        body.append(output, i, size);
+        i += size + 2;
+    }
+
+    BOOST_CHECK(body == contents);
+    BOOST_REQUIRE(chunk_sizes.size() > 1);
+    BOOST_CHECK_EQUAL(chunk_sizes[0], 64 * 1024);
+    BOOST_CHECK(chunk_sizes.size() < 4);
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(http_1_0_stream_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    std::string contents;
+    for (int i = 0 ; i != 200 * 1024 ; ++i)
+        contents.push_back('a' + i % 26);
+    {
+        filesystem::ofstream out(root / "file");
+        out << contents;
+    }
+
+    // the whole file and a single range
+    std::pair<std::string, std::string> cases[] = {
+        {"", contents},
+        {"range: bytes=1000-150999\r\n", contents.substr(1000, 150000)}
+    };
+    for (const auto &c: cases) {
+        asio::io_service ios;
+        char inbuffer[1024];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+        std::string request = "GET /file HTTP/1.0\r\n" + c.first + "\r\n";
+        socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                      request.end());
+
+        std::string method;
+        std::string path;
+        http::message imessage;
+        http::message omessage;
+        bool served = false;
+
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            BOOST_REQUIRE(!ec);
+            http::async_response_transmit_file(socket, imessage, omessage,
+                                               root / "file",
+                                               [&](const system::error_code
+                                                   &ec) {
+                BOOST_CHECK(!ec);
+                served = true;
+            });
+        });
+        ios.run();
+        BOOST_REQUIRE(served);
+
+        // the body is streamed in pooled chunks, never read whole
+        BOOST_CHECK_EQUAL(omessage.body().capacity(), 0);
+
+        std::string output(socket.next_layer().output_buffer.begin(),
+                           socket.next_layer().output_buffer.end());
+        BOOST_CHECK(output.compare(0, 9, "HTTP/1.0 ") == 0);
+        BOOST_CHECK(output.find("transfer-encoding") == std::string::npos);
+
+        auto i = output.find("\r\n\r\n");
+        BOOST_REQUIRE(i != std::string::npos);
+        BOOST_CHECK(output.find("content-length: "
+                                + std::to_string(c.second.size()) + "\r\n")
+                    < i);
+        BOOST_CHECK(output.substr(i + 4) == c.second);
+    }
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(if_range_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    {
+        filesystem::ofstream out(root / "file");
+        out << "0123456789";
+    }
+
+    http::stat_cache cache(root);
+    system::error_code ec;
+    auto entry = cache.lookup(filesystem::path("file"), ec);
+    BOOST_REQUIRE(entry);
+    const auto &etag = entry->etag;
+    BOOST_REQUIRE_EQUAL(etag.front(), '"');
+
+    // only the strong entity-tag keeps the range
+    std::pair<std::string, bool> cases[] = {{etag, true},
+                                            {"W/" + etag, false},
+                                            {"\"other\"", false},
+                                            {"garbage", false}};
+    for (const auto &c: cases) {
+        asio::io_service ios;
+        char inbuffer[1024];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+        std::string request = "GET /file HTTP/1.1\r\n"
+            "range: bytes=2-4\r\n"
+            "if-range: " + c.first + "\r\n"
+            "\r\n";
+        socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                      request.end());
+
+        std::string method;
+        std::string path;
+        http::message imessage;
+        http::message omessage;
+        bool served = false;
+
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            BOOST_REQUIRE(!ec);
+            http::async_response_transmit_dir(socket, method, path, imessage,
+                                              omessage, cache,
+                                              [&](const system::error_code
+                                                  &ec) {
+                BOOST_CHECK(!ec);
+                served = true;
+            });
+        });
+        ios.run();
+        BOOST_REQUIRE(served);
+
+        std::string output(socket.next_layer().output_buffer.begin(),
+                           socket.next_layer().output_buffer.end());
+        if (c.second) {
+            BOOST_CHECK(output.find("HTTP/1.1 206 Partial Content\r\n") == 0);
+            BOOST_CHECK(output.find("content-range: bytes 2-4/10\r\n")
+                        != std::string::npos);
+        } else {
+            BOOST_CHECK(output.find("HTTP/1.1 200 OK\r\n") == 0);
+            BOOST_CHECK(output.find("content-range") == std::string::npos);
+            BOOST_CHECK(output.find("\r\n0123456789\r\n")
+                        != std::string::npos);
+        }
+    }
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(multipart_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+    std::string contents;
+    for (int i = 0 ; i != 2000 ; ++i)
+        contents.push_back('a' + i % 26);
+    {
+        filesystem::ofstream out(root / "file");
+        out << contents;
+    }
+
+    /* a tiny reserved chunk splits the part heads, the pooled one doesn't and
+       HTTP/1.0 is streamed under the same content-length */
+    std::pair<std::size_t, std::string> cases[] = {{7, "1.1"}, {0, "1.1"},
+                                                   {0, "1.0"}};
+    for (const auto &c: cases) {
+        auto capacity = c.first;
+        asio::io_service ios;
+        char inbuffer[1024];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+        std::string request = "GET /file HTTP/" + c.second + "\r\n"
+            "range: bytes=0-9,1000-1009,-3\r\n"
+            "\r\n";
+        socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                      request.end());
+
+        std::string method;
+        std::string path;
+        http::message imessage;
+        http::message omessage;
+        omessage.headers().emplace("content-type", "text/plain");
+        omessage.body().reserve(capacity);
+        bool served = false;
+
+        socket.async_read_request(method, path, imessage,
+                                  [&](const system::error_code &ec) {
+            BOOST_REQUIRE(!ec);
+            http::async_response_transmit_file(socket, imessage, omessage,
+                                               root / "file",
+                                               [&](const system::error_code
+                                                   &ec) {
+                BOOST_CHECK(!ec);
+                served = true;
+            });
+        });
+        ios.run();
+        BOOST_REQUIRE(served);
+
+        std::string output(socket.next_layer().output_buffer.begin(),
+                           socket.next_layer().output_buffer.end());
+        BOOST_CHECK(output.find(" 206 Partial Content\r\n")
+                    != std::string::npos);
+        BOOST_CHECK(output.find("content-type: multipart/byteranges;"
+                                "boundary=-\r\n") != std::string::npos);
+        BOOST_CHECK(output.find("transfer-encoding") == std::string::npos);
+
+        auto i = output.find("\r\n\r\n");
+        BOOST_REQUIRE(i != std::string::npos);
+        std::string body = output.substr(i + 4);
+        BOOST_CHECK(output.find("content-length: "
+                                + std::to_string(body.size()) + "\r\n")
+                    < i);
+
+        std::string expected = "\r\n---\r\n"
+            "content-type: text/plain\r\n"
+            "content-range: bytes 0-9/2000\r\n\r\n" + contents.substr(0, 10)
+            + "\r\n---\r\n"
+            "content-type: text/plain\r\n"
+            "content-range: bytes 1000-1009/2000\r\n\r\n"
+            + contents.substr(1000, 10)
+            + "\r\n---\r\n"
+            "content-type: text/plain\r\n"
+            "content-range: bytes 1997-1999/2000\r\n\r\n"
+            + contents.substr(1997)
+            + "\r\n-----\r\n";
+        BOOST_CHECK(body == expected);
+    }
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(file_cache_case) {
+    http::stat_cache::entry file;
+    file.path = "/file";
+    file.size = 4;
+    file.last_write_time = 0;
+    file.etag = "\"0.0-4\"";
+
+    http::file_cache cache(8, 4);
+    BOOST_CHECK_EQUAL(cache.max_size(), 8);
+    BOOST_CHECK_EQUAL(cache.max_file_size(), 4);
+    BOOST_CHECK(!cache.find(file));
+
+    auto entry = cache.insert(file, std::vector<char>{'a', 'b', 'c', 'd'});
+    BOOST_REQUIRE(entry);
+    BOOST_CHECK_EQUAL(entry->last_modified, "Thu, 01 Jan 1970 00:00:00 GMT");
+    BOOST_CHECK(cache.find(file) == entry);
+
+    /* contents of another revision are dropped, even if it was written within
+       the same second */
+    auto modified = file;
+    modified.etag = "\"0.1-4\"";
+    BOOST_CHECK(!cache.find(modified));
+    BOOST_CHECK(!cache.find(file));
+
+    // too big to be kept
+    auto big = file;
+    big.path = "/big";
+    big.size = 5;
+    BOOST_CHECK(cache.insert(big, std::vector<char>(5)));
+    BOOST_CHECK(!cache.find(big));
+
+    // the least recently used entry is evicted
+    auto a = file, b = file, c = file;
+    a.path = "/a";
+    b.path = "/b";
+    c.path = "/c";
+    cache.insert(a, std::vector<char>(4));
+    cache.insert(b, std::vector<char>(4));
+    BOOST_CHECK(cache.find(a));
+    cache.insert(c, std::vector<char>(4));
+    BOOST_CHECK(cache.find(a));
+    BOOST_CHECK(!cache.find(b));
+
+    auto stats = cache.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 3);
+    BOOST_CHECK_EQUAL(stats.misses, 5);
+    BOOST_CHECK_EQUAL(stats.evictions, 1);
+
+    cache.clear();
+    BOOST_CHECK(!cache.find(a));
+}
+
+BOOST_AUTO_TEST_CASE(file_read_service_case) {
+    auto path = filesystem::temp_directory_path() / filesystem::unique_path();
+    {
+        filesystem::ofstream out(path);
+        out << "0123456789";
+    }
+    auto file = std::make_shared<const http::detail::native_file>(path);
+    BOOST_REQUIRE(file->is_open());
+
+    asio::io_service ios;
+    auto &service = asio::use_service<http::file_read_service>(ios);
+    auto thread_id = std::this_thread::get_id();
+
+    char buffer[6] = {};
+    int calls = 0;
+    service.async_read_at(file, 2, asio::buffer(buffer, 5),
+                          [&](const system::error_code &ec) {
+                              BOOST_CHECK(!ec);
+                              BOOST_CHECK_EQUAL(buffer, "23456");
+                              BOOST_CHECK(std::this_thread::get_id()
+                                          == thread_id);
+                              ++calls;
+                          });
+    char tail[4];
+    service.async_read_at(file, 8, asio::buffer(tail),
+                          [&](const system::error_code &ec) {
+                              BOOST_CHECK(ec == asio::error::eof);
+                              ++calls;
+                          });
+    ios.run();
+    BOOST_CHECK_EQUAL(calls, 2);
+
+    // pluggable engine
+    struct inline_engine: http::file_read_engine
+    {
+        void async_read_at(std::shared_ptr<const http::detail::native_file>,
+                           std::uintmax_t offset, asio::mutable_buffer buffer,
+                           handler_type handler) override
+        {
+            ++reads;
+            last_offset = offset;
+            handler(system::error_code{}, asio::buffer_size(buffer));
+        }
+
+        int reads = 0;
+        std::uintmax_t last_offset = 0;
+    };
+    auto engine = std::make_shared<inline_engine>();
+    service.engine(engine);
+    BOOST_CHECK(service.engine() == engine);
+
+    ios.reset();
+    service.async_read_at(file, 7, asio::buffer(buffer, 1),
+                          [&](const system::error_code &ec) {
+                              BOOST_CHECK(!ec);
+                              ++calls;
+                          });
+    BOOST_CHECK_EQUAL(calls, 2);
+    ios.run();
+    BOOST_CHECK_EQUAL(calls, 3);
+    BOOST_CHECK_EQUAL(engine->reads, 1);
+    BOOST_CHECK_EQUAL(engine->last_offset, 7);
+
+    /* replacing the engine while reads are in flight waits for them without
+       blocking their completion */
+    service.engine(std::make_shared<http::thread_pool_file_read_engine>(2));
+    ios.reset();
+    const std::size_t reads = 256;
+    std::vector<std::array<char, 4>> buffers(reads);
+    std::size_t done = 0;
+    for (std::size_t i = 0 ; i != reads ; ++i) {
+        service.async_read_at(file, i % 7, asio::buffer(buffers[i]),
+                              [&,i](const system::error_code &ec) {
+                                  BOOST_CHECK(!ec);
+                                  BOOST_CHECK(buffers[i][0]
+                                              == char('0' + i % 7));
+                                  ++done;
+                              });
+        if (i == reads / 2) {
+            service.engine(std::make_shared<http::thread_pool_file_read_engine>
+                           (1));
+        }
+    }
+    ios.run();
+    BOOST_CHECK_EQUAL(done, reads);
+
+    filesystem::remove(path);
+}
+
+#ifdef BOOST_HTTP_USE_IO_URING
+BOOST_AUTO_TEST_CASE(io_uring_file_read_engine_case) {
+    auto engine = http::detail::make_io_uring_file_read_engine();
+    if (!engine) {
+        BOOST_TEST_MESSAGE("io_uring is not available, skipping");
+        return;
+    }
+
+    auto path = filesystem::temp_directory_path() / filesystem::unique_path();
+    std::string contents;
+    for (int i = 0 ; i != 65536 ; ++i)
+        contents.push_back('a' + i % 26);
+    {
+        filesystem::ofstream out(path);
+        out << contents;
+    }
+    auto file = std::make_shared<const http::detail::native_file>(path);
+    BOOST_REQUIRE(file->is_open());
+
+    asio::io_service ios;
+    auto &service = asio::use_service<http::file_read_service>(ios);
+    service.engine(engine);
+    engine.reset();
+
+    /* more reads than the rings hold, so some of them wait for room and are
+       submitted together */
+    const std::size_t reads = 2000;
+    std::vector<std::array<char, 64>> buffers(reads);
+    std::size_t calls = 0;
+    for (std::size_t i = 0 ; i != reads ; ++i) {
+        auto offset = (i * 97) % (contents.size() - 64);
+        service.async_read_at(file, offset, asio::buffer(buffers[i]),
+                              [&,i,offset](const system::error_code &ec) {
+                                  BOOST_CHECK(!ec);
+                                  BOOST_CHECK(std::equal(buffers[i].begin(),
+                                                         buffers[i].end(),
+                                                         contents.begin()
+                                                         + offset));
+                                  ++calls;
+                              });
+    }
+    char tail[4];
+    service.async_read_at(file, contents.size() - 2, asio::buffer(tail),
+                          [&](const system::error_code &ec) {
+                              BOOST_CHECK(ec == asio::error::eof);
+                              ++calls;
+                          });
+    ios.run();
+    BOOST_CHECK_EQUAL(calls, reads + 1);
+
+    // the reaper is idle now, so the next read is submitted right away
+    ios.reset();
+    service.async_read_at(file, 26, asio::buffer(tail),
+                          [&](const system::error_code &ec) {
+                              BOOST_CHECK(!ec);
+                              BOOST_CHECK(std::equal(tail, tail + 4,
+                                                     contents.begin()));
+                              ++calls;
+                          });
+    ios.run();
+    BOOST_CHECK_EQUAL(calls, reads + 2);
+
+    filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(io_uring_file_read_engine_latency_case) {
+    auto engine = http::detail::make_io_uring_file_read_engine();
+    if (!engine) {
+        BOOST_TEST_MESSAGE("io_uring is not available, skipping");
+        return;
+    }
+
+    auto path = filesystem::temp_directory_path() / filesystem::unique_path();
+    {
+        filesystem::ofstream out(path);
+        out << "0123456789";
+    }
+
+    // a read from an empty FIFO stays in the kernel until something is written
+    auto fifo_path = filesystem::temp_directory_path()
+        / filesystem::unique_path();
+    BOOST_REQUIRE(::mkfifo(fifo_path.c_str(), 0600) == 0);
+    int writer = ::open(fifo_path.c_str(), O_RDWR);
+    BOOST_REQUIRE(writer != -1);
+
+    auto fifo = std::make_shared<const http::detail::native_file>(fifo_path);
+    auto file = std::make_shared<const http::detail::native_file>(path);
+    BOOST_REQUIRE(fifo->is_open() && file->is_open());
+
+    std::promise<void> fifo_read;
+    std::promise<void> file_read;
+    char fifo_buffer[4];
+    char file_buffer[4];
+    engine->async_read_at(fifo, 0, asio::buffer(fifo_buffer),
+                          [&](const system::error_code &ec, std::size_t) {
+                              BOOST_CHECK(!ec);
+                              fifo_read.set_value();
+                          });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // the blocked read doesn't hold back the next one
+    engine->async_read_at(file, 0, asio::buffer(file_buffer),
+                          [&](const system::error_code &ec, std::size_t) {
+                              BOOST_CHECK(!ec);
+                              file_read.set_value();
+                          });
+    auto fifo_done = fifo_read.get_future();
+    BOOST_CHECK(file_read.get_future().wait_for(std::chrono::seconds(5))
+                == std::future_status::ready);
+    BOOST_CHECK(fifo_done.wait_for(std::chrono::seconds(0))
+                == std::future_status::timeout);
+
+    BOOST_REQUIRE(::write(writer, "abcd", 4) == 4);
+    fifo_done.wait();
+    engine.reset();
+
+    ::close(writer);
+    filesystem::remove(fifo_path);
+    filesystem::remove(path);
+}
+#endif // BOOST_HTTP_USE_IO_URING
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/buffer.hpp>
@@ -14,7 +15,11 @@ public:
         return true;
     }
 
-    void close() {}
+    // Only recorded, so the tests can reopen the socket
+    void close()
+    {
+        closed = true;
+    }
 
     template<class MutableBufferSequence, class CompletionToken>
     typename boost::asio::async_result<
@@ -78,6 +83,28 @@ public:
         Handler handler(std::forward<CompletionToken>(token));
         asio::async_result<Handler> result(handler);
 
+        if (write_error) {
+            auto ec = write_error;
+            io_service.post([ec,handler]() mutable {
+                    handler(ec, 0);
+                });
+            return result.get();
+        }
+
+        if (write_chunk) {
+            // The buffers are only read once the write completes
+            io_service.post([this,buffers,handler]() mutable {
+                    auto n = std::min(write_chunk, asio::buffer_size(buffers));
+                    auto offset = output_buffer.size();
+                    output_buffer.resize(offset + n);
+                    asio::buffer_copy(asio::buffer(output_buffer.data()
+                                                   + offset, n),
+                                      buffers);
+                    handler(system::error_code(), n);
+                });
+            return result.get();
+        }
+
         auto more = asio::buffer_size(buffers);
         auto offset = output_buffer.size();
         output_buffer.resize(offset + more);
@@ -94,6 +121,15 @@ public:
     std::vector<std::vector<char>> input_buffer;
     std::vector<char> output_buffer;
 
+    // Makes the next writes fail
+    boost::system::error_code write_error;
+
+    bool closed = false;
+
+    /* If not zero, each write takes at most write_chunk bytes, which are only
+       copied once the write completes */
+    std::size_t write_chunk = 0;
+
 private:
     boost::asio::io_service &io_service;
 };
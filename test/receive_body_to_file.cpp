@@ -0,0 +1,157 @@
+#define BOOST_TEST_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <boost/http/receive_body_to_file.hpp>
+#include <boost/http/socket.hpp>
+#include "mocksocket.hpp"
+
+using namespace boost;
+using namespace std;
+
+string slurp(const filesystem::path &file)
+{
+    filesystem::ifstream in(file, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+BOOST_AUTO_TEST_CASE(receive_body_to_file_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+
+    string contents;
+    for (int i = 0 ; i != 3000 ; ++i)
+        contents.push_back('a' + i % 26);
+
+    asio::io_service ios;
+    char inbuffer[512];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(inbuffer));
+    string request = "POST /a HTTP/1.1\r\n"
+        "content-length: 3000\r\n"
+        "\r\n" + contents
+        + "POST /b HTTP/1.1\r\n"
+        "transfer-encoding: chunked\r\n"
+        "\r\n"
+        "5\r\nhello\r\n6\r\n world\r\n0\r\n"
+        "\r\n";
+    // pieces smaller than the input buffer, so the body spans several reads
+    for (size_t i = 0 ; i < request.size() ; i += 100) {
+        socket.next_layer().input_buffer
+            .emplace_back(request.begin() + i,
+                          request.begin() + min(request.size(), i + 100));
+    }
+
+    string method;
+    string path;
+    http::message message;
+    vector<string> bodies;
+
+    std::function<void()> serve = [&]() {
+        socket.async_read_request(method, path, message,
+                                  [&](const system::error_code &ec) {
+            if (ec)
+                return;
+
+            auto file = root / path.substr(1);
+            http::async_receive_body_to_file(socket, message, file,
+                                             [&,file](const system::error_code
+                                                      &ec, uintmax_t size) {
+                BOOST_REQUIRE(!ec);
+                BOOST_CHECK(socket.read_state() == http::read_state::empty);
+                BOOST_CHECK(message.body().empty());
+                bodies.push_back(slurp(file));
+                BOOST_CHECK_EQUAL(size, bodies.back().size());
+                socket.async_write_response(200, string_ref("OK"), message,
+                                            [&](const system::error_code &ec) {
+                    BOOST_REQUIRE(!ec);
+                    serve();
+                });
+            });
+        });
+    };
+    serve();
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(bodies.size(), 2);
+    BOOST_CHECK(bodies[0] == contents);
+    BOOST_CHECK(bodies[1] == "hello world");
+
+    filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(receive_body_to_file_tcp_case) {
+    auto root = filesystem::temp_directory_path() / filesystem::unique_path();
+    filesystem::create_directories(root);
+
+    // big enough for most of the body to be moved straight from the socket
+    string contents;
+    for (int i = 0 ; i != 300000 ; ++i)
+        contents.push_back('a' + i % 26);
+
+    asio::io_service ios;
+    asio::ip::tcp::acceptor acceptor(ios, asio::ip::tcp::endpoint
+                                     (asio::ip::address_v4::loopback(), 0));
+    asio::ip::tcp::socket client(ios);
+    char inbuffer[512];
+    http::basic_socket<asio::ip::tcp::socket> socket(ios,
+                                                     asio::buffer(inbuffer));
+    string request = "POST /a HTTP/1.1\r\n"
+        "content-length: 300000\r\n"
+        "\r\n" + contents
+        + "GET /b HTTP/1.1\r\n"
+        "\r\n";
+
+    string method;
+    string path;
+    http::message message;
+    bool received = false;
+    bool next_request = false;
+
+    acceptor.async_accept(socket.next_layer(),
+                          [&](const system::error_code &ec) {
+        BOOST_REQUIRE(!ec);
+        socket.async_read_request(method, path, message,
+                                  [&](const system::error_code &ec) {
+            BOOST_REQUIRE(!ec);
+            http::async_receive_body_to_file(socket, message, root / "a",
+                                             [&](const system::error_code
+                                                 &ec, uintmax_t size) {
+                BOOST_REQUIRE(!ec);
+                BOOST_CHECK_EQUAL(size, contents.size());
+                BOOST_CHECK(socket.read_state() == http::read_state::empty);
+                received = true;
+
+                // the framing still holds for the next request
+                socket.async_write_response(200, string_ref("OK"), message,
+                                            [&](const system::error_code &ec) {
+                    BOOST_REQUIRE(!ec);
+                    socket.async_read_request(method, path, message,
+                                              [&](const system::error_code
+                                                  &ec) {
+                        BOOST_REQUIRE(!ec);
+                        BOOST_CHECK_EQUAL(method, "GET");
+                        BOOST_CHECK_EQUAL(path, "/b");
+                        next_request = true;
+                    });
+                });
+            });
+        });
+    });
+    client.async_connect(acceptor.local_endpoint(),
+                         [&](const system::error_code &ec) {
+        BOOST_REQUIRE(!ec);
+        asio::async_write(client, asio::buffer(request),
+                          [](const system::error_code &ec, size_t) {
+                              BOOST_REQUIRE(!ec);
+                          });
+    });
+    ios.run();
+
+    BOOST_CHECK(received);
+    BOOST_CHECK(next_request);
+    BOOST_CHECK(slurp(root / "a") == contents);
+
+    filesystem::remove_all(root);
+}
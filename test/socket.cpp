@@ -1,6 +1,7 @@
 #define BOOST_TEST_MAIN
 #include <boost/test/unit_test.hpp>
 
+#include <functional>
 #include <iostream>
 
 #include <boost/asio/spawn.hpp>
@@ -1294,3 +1295,1039 @@ BOOST_AUTO_TEST_CASE(socket_upgrade) {
     spawn(ios, work2);
     ios.run();
 }
+
+BOOST_AUTO_TEST_CASE(socket_views) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        // the whole header section must fit in the buffer
+        char buffer[128];
+        for (size_t i = 96;i != sizeof(buffer);++i) {
+            auto inbuffer = asio::buffer(buffer, i);
+            http::basic_socket<mock_socket> socket(ios, inbuffer);
+            socket.next_layer().input_buffer.emplace_back();
+            fill_vector(socket.next_layer().input_buffer.front(),
+                        "GET /view HTTP/1.1\r\n"
+                        "hOsT: \t localhosT:8080  \t\r\n"
+                        "X-folded: a\r\n"
+                        " b\r\n"
+                        "\r\n");
+
+            string_ref method;
+            string_ref path;
+            http::message_view message;
+
+            socket.async_read_request(method, path, message, yield);
+
+            BOOST_REQUIRE(socket.read_state() == http::read_state::empty);
+            BOOST_CHECK(method == "GET");
+            BOOST_CHECK(path == "/view");
+            {
+                http::headers_view expected_headers{
+                    {"host", "localhosT:8080"},
+                    {"x-folded", "a   b"}
+                };
+                BOOST_CHECK(message.headers() == expected_headers);
+            }
+
+            // fields reference the input buffer
+            {
+                auto begin = asio::buffer_cast<const char*>(inbuffer);
+                auto end = begin + asio::buffer_size(inbuffer);
+                for (const auto &field: message.headers()) {
+                    BOOST_CHECK(field.first.data() >= begin
+                                && field.first.data() < end);
+                    BOOST_CHECK(field.second.data() >= begin
+                                && field.second.data() < end);
+                }
+            }
+        }
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_input_buffer) {
+    char storage[8];
+    http::detail::input_buffer buffer(asio::buffer(storage));
+
+    BOOST_REQUIRE(buffer.size() == 0);
+    BOOST_REQUIRE(buffer.capacity() == 8);
+    BOOST_REQUIRE(asio::buffer_size(buffer.prepare()) == 8);
+
+    copy_n("abcdef", 6, asio::buffer_cast<char*>(buffer.prepare()));
+    buffer.commit(6);
+    BOOST_REQUIRE(buffer.size() == 6);
+
+    // consuming bytes doesn't move the remaining ones
+    buffer.consume(4);
+    BOOST_REQUIRE(buffer.size() == 2);
+    BOOST_CHECK(buffer.data() == reinterpret_cast<uint8_t*>(storage) + 4);
+    BOOST_CHECK(asio::buffer_size(buffer.prepare()) == 2);
+    BOOST_CHECK(buffer.data() == reinterpret_cast<uint8_t*>(storage) + 4);
+
+    copy_n("gh", 2, asio::buffer_cast<char*>(buffer.prepare()));
+    buffer.commit(2);
+    BOOST_REQUIRE(!buffer.full());
+
+    // tail is exhausted, then the unparsed bytes are moved to the front
+    BOOST_CHECK(asio::buffer_size(buffer.prepare()) == 4);
+    BOOST_CHECK(buffer.data() == reinterpret_cast<uint8_t*>(storage));
+    BOOST_CHECK(string(reinterpret_cast<char*>(buffer.data()), buffer.size())
+                == "efgh");
+
+    // consuming everything rewinds the cursors
+    buffer.consume(4);
+    BOOST_CHECK(buffer.size() == 0);
+    BOOST_CHECK(asio::buffer_size(buffer.prepare()) == 8);
+
+    copy_n("12345678", 8, asio::buffer_cast<char*>(buffer.prepare()));
+    buffer.commit(8);
+    BOOST_CHECK(buffer.full());
+}
+
+BOOST_AUTO_TEST_CASE(socket_growable_buffer) {
+    {
+        http::detail::input_buffer buffer(http::input_buffer_policy{64, 256});
+
+        // storage is only acquired when needed
+        BOOST_REQUIRE(buffer.capacity() == 0);
+        BOOST_REQUIRE(!buffer.full());
+        BOOST_REQUIRE(asio::buffer_size(buffer.prepare()) == 64);
+        buffer.commit(64);
+
+        BOOST_REQUIRE(!buffer.full());
+        BOOST_REQUIRE(asio::buffer_size(buffer.prepare()) == 64);
+        BOOST_REQUIRE(buffer.capacity() == 128);
+        buffer.commit(64);
+
+        BOOST_REQUIRE(asio::buffer_size(buffer.prepare()) == 128);
+        buffer.commit(128);
+        BOOST_REQUIRE(buffer.full());
+
+        // a grown storage is only released when empty
+        buffer.shrink();
+        BOOST_REQUIRE(buffer.capacity() == 256);
+        buffer.consume(256);
+        buffer.shrink();
+        BOOST_REQUIRE(buffer.capacity() == 0);
+        BOOST_REQUIRE(asio::buffer_size(buffer.prepare()) == 64);
+
+        // the initial storage is kept by shrink, but not by release_idle
+        buffer.shrink();
+        BOOST_REQUIRE(buffer.capacity() == 64);
+        buffer.release_idle();
+        BOOST_REQUIRE(buffer.capacity() == 0);
+    }
+
+    BOOST_CHECK(http::detail::slab_size(65) == 128);
+    BOOST_CHECK(http::detail::slab_size(std::size_t(-1))
+                == ~(std::size_t(-1) >> 1));
+
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        http::basic_socket<mock_socket> socket(ios,
+                                               http::input_buffer_policy{
+                                                   64, 4096
+                                               });
+        string cookie(2000, 'c');
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.front(),
+                    "GET / HTTP/1.1\r\n"
+                    "cookie: ");
+        socket.next_layer().input_buffer.front().insert(
+            socket.next_layer().input_buffer.front().end(),
+            cookie.begin(), cookie.end());
+        fill_vector(socket.next_layer().input_buffer.front(),
+                    "\r\n"
+                    "\r\n");
+
+        string_ref method;
+        string_ref path;
+        http::message_view message;
+
+        socket.async_read_request(method, path, message, yield);
+
+        BOOST_REQUIRE(socket.read_state() == http::read_state::empty);
+        BOOST_CHECK(method == "GET");
+        BOOST_CHECK(path == "/");
+        BOOST_REQUIRE(message.headers().size() == 1);
+        BOOST_CHECK(message.headers().find("cookie")->second == cookie);
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_pipelined_batch) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET /a HTTP/1.1\r\n"
+                    "\r\n"
+                    "POST /b HTTP/1.1\r\n"
+                    "content-length: 4\r\n"
+                    "\r\n"
+                    "ping"
+                    "GET /c HTTP/1.0\r\n"
+                    "connection: keep-alive\r\n"
+                    "\r\n"
+                    "GET /d HTTP/1.1\r\n"
+                    "ho");
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "st: example.com\r\n"
+                    "\r\n");
+
+        vector<http::pipelined_request> requests;
+        auto count = socket.async_read_requests(requests, yield);
+
+        // the incomplete request is left for the next call
+        BOOST_REQUIRE(count == 3);
+        BOOST_REQUIRE(requests.size() == 3);
+        BOOST_REQUIRE(socket.read_state() == http::read_state::empty);
+        BOOST_CHECK(requests[0].method == "GET");
+        BOOST_CHECK(requests[0].path == "/a");
+        BOOST_CHECK(requests[1].method == "POST");
+        BOOST_CHECK(requests[1].path == "/b");
+        BOOST_CHECK((requests[1].message.body()
+                     == vector<uint8_t>{'p', 'i', 'n', 'g'}));
+        BOOST_CHECK(requests[2].path == "/c");
+
+        // one response per request, in order
+        http::message reply;
+        for (int i = 0;i != 3;++i) {
+            BOOST_REQUIRE(socket.write_state() == http::write_state::empty);
+            socket.async_write_response(200, string_ref("OK"), reply, yield);
+        }
+        BOOST_CHECK(socket.write_state() == http::write_state::finished);
+        {
+            vector<char> v;
+            fill_vector(v,
+                        "HTTP/1.1 200 OK\r\n"
+                        "content-length: 0\r\n"
+                        "\r\n"
+                        "HTTP/1.1 200 OK\r\n"
+                        "content-length: 0\r\n"
+                        "\r\n"
+                        "HTTP/1.0 200 OK\r\n"
+                        "content-length: 0\r\n"
+                        "\r\n");
+            BOOST_CHECK(socket.next_layer().output_buffer == v);
+        }
+
+        requests.clear();
+        count = socket.async_read_requests(requests, yield);
+        BOOST_REQUIRE(count == 1);
+        BOOST_CHECK(requests[0].path == "/d");
+        BOOST_CHECK(requests[0].message.headers()
+                    == (http::headers{{"host", "example.com"}}));
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_pipelined_unanswered_batch) {
+    asio::io_service ios;
+    char buffer[512];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+    socket.next_layer().input_buffer.emplace_back();
+    fill_vector(socket.next_layer().input_buffer.back(),
+                "GET /a HTTP/1.1\r\n"
+                "\r\n"
+                "GET /b HTTP/1.1\r\n"
+                "\r\n");
+
+    vector<http::pipelined_request> requests;
+    http::message reply;
+    std::vector<system::error_code> errors;
+    auto on_read = [&](const system::error_code &ec, std::size_t) {
+        errors.push_back(ec);
+    };
+
+    socket.async_read_requests(requests, [&](const system::error_code &ec,
+                                             std::size_t count) {
+        BOOST_REQUIRE(!ec);
+        BOOST_REQUIRE(count == 2);
+
+        // none of the two responses was written
+        socket.async_read_requests(requests, on_read);
+        socket.async_write_response(200, string_ref("OK"), reply,
+                                    [&](const system::error_code &ec) {
+            BOOST_REQUIRE(!ec);
+
+            // the last response is still missing
+            socket.async_read_requests(requests, on_read);
+            socket.async_write_response(200, string_ref("OK"), reply,
+                                        [&](const system::error_code &ec) {
+                BOOST_REQUIRE(!ec);
+                BOOST_CHECK(socket.write_state()
+                            == http::write_state::finished);
+            });
+        });
+    });
+    ios.run();
+
+    BOOST_REQUIRE(errors.size() == 2);
+    BOOST_CHECK(errors[0]
+                == system::error_code{http::http_errc::out_of_order});
+    BOOST_CHECK(errors[1]
+                == system::error_code{http::http_errc::out_of_order});
+    BOOST_CHECK(count(socket.next_layer().output_buffer.begin(),
+                      socket.next_layer().output_buffer.end(), 'H') == 2);
+}
+
+BOOST_AUTO_TEST_CASE(socket_pipelined_response_queue) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET /a HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET /b HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET /c HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET /d HTTP/1.1\r\n"
+                    "\r\n");
+
+        vector<char> response;
+        fill_vector(response,
+                    "HTTP/1.1 200 OK\r\n"
+                    "content-length: 0\r\n"
+                    "\r\n");
+
+        vector<http::pipelined_request> requests;
+        BOOST_REQUIRE(socket.async_read_requests(requests, yield) == 4);
+
+        /* Responses written in one go are held until the last one of the
+           batch and their handlers only run once they are written */
+        http::message reply;
+        int written = 0;
+        for (int i = 0;i != 3;++i) {
+            BOOST_REQUIRE(socket.write_state() == http::write_state::empty);
+            socket.async_write_response(200, string_ref("OK"), reply,
+                                        [&](const system::error_code &ec) {
+                BOOST_CHECK(!ec);
+                ++written;
+            });
+            BOOST_CHECK(socket.next_layer().output_buffer.empty());
+        }
+        socket.async_write_response(200, string_ref("OK"), reply, yield);
+        BOOST_CHECK(written == 3);
+        BOOST_CHECK(socket.next_layer().output_buffer.size()
+                    == 4 * response.size());
+
+        // A response awaited alone is flushed once the io_service runs
+        socket.next_layer().output_buffer.clear();
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET /a HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET /b HTTP/1.1\r\n"
+                    "\r\n");
+        requests.clear();
+        BOOST_REQUIRE(socket.async_read_requests(requests, yield) == 2);
+        socket.async_write_response(200, string_ref("OK"), reply, yield);
+        BOOST_CHECK(socket.next_layer().output_buffer == response);
+        socket.async_write_response(200, string_ref("OK"), reply, yield);
+        BOOST_CHECK(socket.next_layer().output_buffer.size()
+                    == 2 * response.size());
+
+        // A threshold of zero disables the queue
+        socket.next_layer().output_buffer.clear();
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET /e HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET /f HTTP/1.1\r\n"
+                    "\r\n");
+        socket.set_pipelined_flush_threshold(0);
+        requests.clear();
+        BOOST_REQUIRE(socket.async_read_requests(requests, yield) == 2);
+        socket.async_write_response(200, string_ref("OK"), reply, yield);
+        BOOST_CHECK(socket.next_layer().output_buffer == response);
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_pipelined_response_queue_error) {
+    asio::io_service ios;
+    char buffer[512];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+    socket.next_layer().input_buffer.emplace_back();
+    fill_vector(socket.next_layer().input_buffer.back(),
+                "GET /a HTTP/1.1\r\n"
+                "\r\n"
+                "GET /b HTTP/1.1\r\n"
+                "\r\n"
+                "GET /c HTTP/1.1\r\n"
+                "\r\n");
+
+    vector<http::pipelined_request> requests;
+    http::message reply;
+    std::vector<system::error_code> errors;
+    auto on_write = [&](const system::error_code &ec) {
+        errors.push_back(ec);
+    };
+
+    socket.async_read_requests(requests, [&](const system::error_code &ec,
+                                             std::size_t count) {
+        BOOST_REQUIRE(!ec);
+        BOOST_REQUIRE(count == 3);
+
+        socket.next_layer().write_error = asio::error::broken_pipe;
+        for (int i = 0;i != 3;++i)
+            socket.async_write_response(200, string_ref("OK"), reply, on_write);
+    });
+    ios.run();
+
+    // Every queued response learns about the failed write
+    BOOST_REQUIRE(errors.size() == 3);
+    for (const auto &ec: errors)
+        BOOST_CHECK(ec == system::error_code{asio::error::broken_pipe});
+    BOOST_CHECK(socket.next_layer().output_buffer.empty());
+}
+
+BOOST_AUTO_TEST_CASE(socket_pipelined_partial_writes) {
+    asio::io_service ios;
+    char buffer[512];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+    socket.next_layer().write_chunk = 7;
+    socket.next_layer().input_buffer.emplace_back();
+    fill_vector(socket.next_layer().input_buffer.back(),
+                "GET /a HTTP/1.1\r\n"
+                "\r\n"
+                "GET /b HTTP/1.1\r\n"
+                "\r\n"
+                "GET /c HTTP/1.1\r\n"
+                "\r\n");
+
+    vector<http::pipelined_request> requests;
+    http::message replies[3];
+    replies[0].body() = {'a'};
+    replies[1].body() = vector<uint8_t>(12, 'b');
+    replies[2].body() = vector<uint8_t>(345, 'c');
+    int written = 0;
+
+    /* Every response is serialized while the previous writes are still
+       reading their buffers */
+    socket.async_read_requests(requests, [&](const system::error_code &ec,
+                                             std::size_t count) {
+        BOOST_REQUIRE(!ec);
+        BOOST_REQUIRE(count == 3);
+
+        socket.set_pipelined_flush_threshold(0);
+        socket.async_write_response(200, string_ref("OK"), replies[0],
+                                    [&](const system::error_code &ec) {
+            BOOST_CHECK(!ec);
+            ++written;
+        });
+        socket.async_write_response(404, string_ref("Not Found"), replies[1],
+                                    [&](const system::error_code &ec) {
+            BOOST_CHECK(!ec);
+            ++written;
+        });
+        socket.async_write_response(500, string_ref("Oops"), replies[2],
+                                    [&](const system::error_code &ec) {
+            BOOST_CHECK(!ec);
+            ++written;
+        });
+    });
+    ios.run();
+
+    BOOST_CHECK(written == 3);
+    string expected = "HTTP/1.1 200 OK\r\n"
+        "content-length: 1\r\n"
+        "\r\n"
+        "a"
+        "HTTP/1.1 404 Not Found\r\n"
+        "content-length: 12\r\n"
+        "\r\n"
+        + string(12, 'b')
+        + "HTTP/1.1 500 Oops\r\n"
+        "content-length: 345\r\n"
+        "\r\n"
+        + string(345, 'c');
+    BOOST_CHECK(string(socket.next_layer().output_buffer.begin(),
+                       socket.next_layer().output_buffer.end()) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(socket_prepared_response) {
+    http::message m;
+    m.headers().emplace("content-type", "text/plain");
+    m.body() = {'o', 'k'};
+    http::prepared_response ok(200, string_ref("OK"), m);
+    m.body().clear();
+    http::prepared_response no_content(204, string_ref("No Content"), m);
+
+    {
+        auto data = ok.data();
+        BOOST_CHECK(string(asio::buffer_cast<const char*>(data),
+                           asio::buffer_size(data))
+                    == "HTTP/1.1 200 OK\r\n"
+                    "content-type: text/plain\r\n"
+                    "content-length: 2\r\n"
+                    "\r\n"
+                    "ok");
+    }
+
+    asio::io_service ios;
+    auto work = [&](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET /a HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET /b HTTP/1.0\r\n"
+                    "\r\n");
+
+        std::string method;
+        std::string path;
+        http::message message;
+
+        socket.async_read_request(method, path, message, yield);
+        socket.async_write_response(no_content, yield);
+        socket.async_read_request(method, path, message, yield);
+        socket.async_write_response(ok, yield);
+        BOOST_CHECK(!socket.is_open());
+
+        vector<char> v;
+        fill_vector(v,
+                    "HTTP/1.1 204 No Content\r\n"
+                    "content-type: text/plain\r\n"
+                    "\r\n"
+                    "HTTP/1.0 200 OK\r\n"
+                    "connection: close\r\n"
+                    "content-type: text/plain\r\n"
+                    "content-length: 2\r\n"
+                    "\r\n"
+                    "ok");
+        BOOST_CHECK(socket.next_layer().output_buffer == v);
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_date_header) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET / HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET / HTTP/1.1\r\n"
+                    "\r\n");
+
+        BOOST_REQUIRE(!socket.date_header());
+        socket.set_date_header(true);
+        BOOST_REQUIRE(socket.date_header());
+
+        std::string method;
+        std::string path;
+        http::message message;
+        http::message reply;
+
+        socket.async_read_request(method, path, message, yield);
+        socket.async_write_response(200, string_ref("OK"), reply, yield);
+        {
+            const auto &output = socket.next_layer().output_buffer;
+            string response(output.begin(), output.end());
+            BOOST_REQUIRE(response.size()
+                          == 17 + 6 + http::date_cache::size + 2 + 21);
+            BOOST_CHECK(response.compare(0, 23, "HTTP/1.1 200 OK\r\ndate: ")
+                        == 0);
+            BOOST_CHECK(response.compare(48, 27, " GMT\r\n"
+                                         "content-length: 0\r\n"
+                                         "\r\n") == 0);
+        }
+
+        // an user-provided date is kept
+        socket.next_layer().output_buffer.clear();
+        reply.headers().emplace("date", "Sun, 06 Nov 1994 08:49:37 GMT");
+        socket.async_read_request(method, path, message, yield);
+        socket.async_write_response(200, string_ref("OK"), reply, yield);
+        {
+            vector<char> v;
+            fill_vector(v,
+                        "HTTP/1.1 200 OK\r\n"
+                        "date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                        "content-length: 0\r\n"
+                        "\r\n");
+            BOOST_CHECK(socket.next_layer().output_buffer == v);
+        }
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_content_length_metadata) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "GET / HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET / HTTP/1.1\r\n"
+                    "\r\n");
+
+        std::string method;
+        std::string path;
+        http::message message;
+        http::message reply;
+        reply.headers().emplace("content-length", "5");
+        auto set_body = [&reply](const string &body) {
+            reply.body().assign(body.begin(), body.end());
+        };
+
+        socket.async_read_request(method, path, message, yield);
+        socket.async_write_response_metadata(200, string_ref("OK"), reply,
+                                             yield);
+        set_body("hel");
+        socket.async_write(reply, yield);
+        set_body("lo");
+        socket.async_write(reply, yield);
+        socket.async_write_end_of_message(yield);
+        {
+            vector<char> v;
+            fill_vector(v,
+                        "HTTP/1.1 200 OK\r\n"
+                        "content-length: 5\r\n"
+                        "\r\n"
+                        "hello");
+            BOOST_CHECK(socket.next_layer().output_buffer == v);
+        }
+
+        // trailers cannot be sent without chunked encoding
+        socket.next_layer().output_buffer.clear();
+        reply.trailers().emplace("content-md5", "x");
+        socket.async_read_request(method, path, message, yield);
+        socket.async_write_response_metadata(200, string_ref("OK"), reply,
+                                             yield);
+        set_body("hello");
+        socket.async_write(reply, yield);
+        {
+            system::error_code ec;
+            socket.async_write_trailers(reply, yield[ec]);
+            BOOST_CHECK(ec == system::error_code{
+                            http::http_errc::content_length_mismatch});
+            BOOST_CHECK(socket.write_state()
+                        == http::write_state::metadata_issued);
+        }
+        socket.async_write_end_of_message(yield);
+        {
+            vector<char> v;
+            fill_vector(v,
+                        "HTTP/1.1 200 OK\r\n"
+                        "content-length: 5\r\n"
+                        "\r\n"
+                        "hello");
+            BOOST_CHECK(socket.next_layer().output_buffer == v);
+        }
+        BOOST_CHECK(socket.write_state() == http::write_state::finished);
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_content_length_mismatch) {
+    asio::io_service ios;
+    char buffer[512];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+    socket.next_layer().input_buffer.emplace_back();
+    fill_vector(socket.next_layer().input_buffer.back(),
+                "GET / HTTP/1.1\r\n"
+                "\r\n"
+                "GET / HTTP/1.1\r\n"
+                "\r\n");
+
+    std::string method;
+    std::string path;
+    http::message message;
+    http::message reply;
+    reply.headers().emplace("content-length", "5");
+    reply.trailers().emplace("content-md5", "x");
+    auto set_body = [&reply](const string &body) {
+        reply.body().assign(body.begin(), body.end());
+    };
+    std::vector<system::error_code> errors;
+    auto on_error = [&errors](const system::error_code &ec) {
+        errors.push_back(ec);
+    };
+
+    socket.async_read_request(method, path, message,
+                              [&](const system::error_code &ec) {
+        BOOST_REQUIRE(!ec);
+        socket.async_write_response_metadata(200, string_ref("OK"), reply,
+                                             [&](const system::error_code
+                                                 &ec) {
+            BOOST_REQUIRE(!ec);
+
+            // longer than announced
+            set_body("hello!");
+            socket.async_write(reply, on_error);
+
+            set_body("hel");
+            socket.async_write(reply, [&](const system::error_code &ec) {
+                BOOST_REQUIRE(!ec);
+
+                // shorter than announced and nowhere to put the trailers
+                socket.async_write_end_of_message(on_error);
+                socket.async_write_trailers(reply, on_error);
+                BOOST_CHECK(socket.write_state()
+                            == http::write_state::metadata_issued);
+
+                set_body("lo");
+                socket.async_write(reply, [&](const system::error_code &ec) {
+                    BOOST_REQUIRE(!ec);
+                    socket.async_write_end_of_message([&](const system
+                                                          ::error_code &ec) {
+                        BOOST_REQUIRE(!ec);
+
+                        // not a plain decimal number
+                        reply.headers().find("content-length")->second = "5x";
+                        socket.async_read_request(method, path, message,
+                                                  [&](const system::error_code
+                                                      &ec) {
+                            BOOST_REQUIRE(!ec);
+                            socket.async_write_response_metadata
+                                (200, string_ref("OK"), reply, on_error);
+                            BOOST_CHECK(socket.write_state()
+                                        == http::write_state::empty);
+                        });
+                    });
+                });
+            });
+        });
+    });
+    ios.run();
+
+    BOOST_REQUIRE(errors.size() == 4);
+    for (const auto &ec: errors) {
+        BOOST_CHECK(ec == system::error_code{
+                        http::http_errc::content_length_mismatch});
+    }
+
+    vector<char> v;
+    fill_vector(v,
+                "HTTP/1.1 200 OK\r\n"
+                "content-length: 5\r\n"
+                "\r\n"
+                "hello");
+    BOOST_CHECK(socket.next_layer().output_buffer == v);
+}
+
+BOOST_AUTO_TEST_CASE(socket_content_length_no_body) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.next_layer().input_buffer.emplace_back();
+        fill_vector(socket.next_layer().input_buffer.back(),
+                    "HEAD / HTTP/1.1\r\n"
+                    "\r\n"
+                    "GET / HTTP/1.1\r\n"
+                    "\r\n");
+
+        std::string method;
+        std::string path;
+        http::message message;
+        http::message reply;
+        reply.headers().emplace("content-length", "5");
+
+        // The body of a response to HEAD is never sent
+        socket.async_read_request(method, path, message, yield);
+        BOOST_REQUIRE(method == "HEAD");
+        socket.async_write_response_metadata(200, string_ref("OK"), reply,
+                                             yield);
+        socket.async_write_end_of_message(yield);
+        BOOST_CHECK(socket.write_state() == http::write_state::finished);
+
+        // Neither is the body of a 304 response
+        socket.async_read_request(method, path, message, yield);
+        BOOST_REQUIRE(method == "GET");
+        socket.async_write_response_metadata(304, string_ref("Not Modified"),
+                                             reply, yield);
+        socket.async_write_end_of_message(yield);
+        BOOST_CHECK(socket.write_state() == http::write_state::finished);
+
+        vector<char> v;
+        fill_vector(v,
+                    "HTTP/1.1 200 OK\r\n"
+                    "content-length: 5\r\n"
+                    "\r\n"
+                    "HTTP/1.1 304 Not Modified\r\n"
+                    "content-length: 5\r\n"
+                    "\r\n");
+        BOOST_CHECK(socket.next_layer().output_buffer == v);
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_read_into_buffers) {
+    asio::io_service ios;
+    auto work = [&ios](asio::yield_context yield) {
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        auto &input = socket.next_layer().input_buffer;
+        input.emplace_back();
+        fill_vector(input.back(),
+                    "POST / HTTP/1.1\r\n"
+                    "content-length: 10\r\n"
+                    "\r\n");
+        // nothing is buffered, so these land straight in the caller storage
+        input.emplace_back();
+        fill_vector(input.back(), "0123");
+        input.emplace_back();
+        fill_vector(input.back(),
+                    "456789"
+                    "POST /chunked HTTP/1.1\r\n"
+                    "transfer-encoding: chunked\r\n"
+                    "\r\n");
+        input.emplace_back();
+        fill_vector(input.back(),
+                    "5\r\nhello\r\n6\r\n world\r\n0\r\n"
+                    "content-md5: x\r\n"
+                    "\r\n");
+
+        std::string method;
+        std::string path;
+        http::message message;
+        char a[3];
+        char b[5];
+        std::array<asio::mutable_buffer, 2> buffers{{asio::buffer(a),
+                                                     asio::buffer(b)}};
+        auto read_body = [&]() {
+            std::string body;
+            while (socket.read_state() == http::read_state::message_ready) {
+                auto n = socket.async_read_some(buffers, message, yield);
+                BOOST_REQUIRE(n <= sizeof(a) + sizeof(b));
+                body.append(a, std::min(n, sizeof(a)));
+                if (n > sizeof(a))
+                    body.append(b, n - sizeof(a));
+            }
+            return body;
+        };
+
+        socket.async_read_request(method, path, message, yield);
+        BOOST_REQUIRE(socket.read_state() == http::read_state::message_ready);
+        BOOST_CHECK(read_body() == "0123456789");
+        BOOST_CHECK(message.body().empty());
+        BOOST_REQUIRE(socket.read_state() == http::read_state::empty);
+
+        // the read stopped at the end of the body
+        socket.async_write_response(200, string_ref("OK"), message, yield);
+        socket.async_read_request(method, path, message, yield);
+        BOOST_CHECK(path == "/chunked");
+        BOOST_CHECK(read_body() == "hello world");
+        BOOST_CHECK(message.body().empty());
+        if (socket.read_state() == http::read_state::body_ready)
+            socket.async_read_trailers(message, yield);
+        BOOST_REQUIRE(socket.read_state() == http::read_state::empty);
+        BOOST_CHECK(message.trailers().size() == 1);
+    };
+    spawn(ios, work);
+    ios.run();
+}
+
+BOOST_AUTO_TEST_CASE(socket_limits) {
+    http::request_limits limits;
+    limits.url_size = 8;
+    limits.headers = 2;
+    limits.headers_size = 32;
+    limits.body_size = 4;
+
+    auto read = [&limits](const string &request, system::error_code expected,
+                          const string &status_line) {
+        asio::io_service ios;
+        char buffer[512];
+        http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+        socket.set_limits(limits);
+        BOOST_REQUIRE(socket.limits().url_size == 8);
+        socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                      request.end());
+
+        // arrives later, so it's still in the stream after the error
+        string next = "GET / HTTP/1.1\r\n"
+            "\r\n";
+        socket.next_layer().input_buffer.emplace_back(next.begin(),
+                                                      next.end());
+
+        std::string method;
+        std::string path;
+        http::message message;
+        system::error_code error;
+        std::function<void(const system::error_code&)> on_read
+            = [&](const system::error_code &ec) {
+            error = ec;
+            if (!ec && socket.read_state() == http::read_state::message_ready)
+                socket.async_read_some(message, on_read);
+        };
+        socket.async_read_request(method, path, message, on_read);
+        ios.run();
+        BOOST_CHECK(error == expected);
+
+        const auto &output = socket.next_layer().output_buffer;
+        BOOST_CHECK(string(output.begin(), output.end())
+                    .compare(0, status_line.size(), status_line) == 0);
+
+        if (!expected)
+            return;
+
+        // the connection is closed before anything after the request is read
+        BOOST_CHECK(!socket.is_open());
+        BOOST_CHECK(socket.next_layer().closed);
+        BOOST_REQUIRE(socket.next_layer().input_buffer.size() == 1);
+        BOOST_CHECK(socket.next_layer().input_buffer.front().size()
+                    == next.size());
+    };
+
+    read("POST /1234567 HTTP/1.1\r\n"
+         "a: 1\r\n"
+         "content-length: 4\r\n"
+         "\r\n"
+         "abcd",
+         system::error_code{}, "");
+    read("GET /123456789 HTTP/1.1\r\n"
+         "\r\n",
+         http::http_errc::url_too_long,
+         "HTTP/1.1 414 URI Too Long\r\n"
+         "Content-Length: 31\r\n"
+         "Connection: close\r\n"
+         "\r\n"
+         "The request target is too long\n");
+    read("GET / HTTP/1.1\r\n"
+         "a: 1\r\n"
+         "b: 2\r\n"
+         "c: 3\r\n"
+         "\r\n",
+         http::http_errc::headers_too_large,
+         "HTTP/1.1 431 Request Header Fields Too Large\r\n");
+    read("GET / HTTP/1.1\r\n"
+         "user-agent: 0123456789012345678901234567890\r\n"
+         "\r\n",
+         http::http_errc::headers_too_large,
+         "HTTP/1.1 431 Request Header Fields Too Large\r\n");
+
+    // rejected before any byte of the body is read
+    read("POST / HTTP/1.1\r\n"
+         "content-length: 5\r\n"
+         "\r\n",
+         http::http_errc::body_too_large,
+         "HTTP/1.1 413 Payload Too Large\r\n");
+    read("POST / HTTP/1.1\r\n"
+         "transfer-encoding: chunked\r\n"
+         "\r\n"
+         "3\r\nabc\r\n3\r\ndef\r\n0\r\n"
+         "\r\n",
+         http::http_errc::body_too_large,
+         "HTTP/1.1 413 Payload Too Large\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(socket_limits_response_started) {
+    asio::io_service ios;
+    char buffer[512];
+    http::basic_socket<mock_socket> socket(ios, asio::buffer(buffer));
+    http::request_limits limits;
+    limits.body_size = 4;
+    socket.set_limits(limits);
+    string request = "POST / HTTP/1.1\r\n"
+        "transfer-encoding: chunked\r\n"
+        "\r\n";
+    string body = "3\r\nabc\r\n3\r\ndef\r\n0\r\n"
+        "\r\n"
+        "GET / HTTP/1.1\r\n"
+        "\r\n";
+    socket.next_layer().input_buffer.emplace_back(request.begin(),
+                                                  request.end());
+    socket.next_layer().input_buffer.emplace_back(body.begin(), body.end());
+
+    std::string method;
+    std::string path;
+    http::message message;
+    http::message reply;
+    system::error_code error;
+    bool ended = false;
+
+    /* The body breaks the limit once the response is started, so the error is
+       only reported, but the connection is closed once the response ends */
+    socket.async_read_request(method, path, message,
+                              [&](const system::error_code &ec) {
+        BOOST_REQUIRE(!ec);
+        socket.async_write_response_metadata(200, string_ref("OK"), reply,
+                                             [&](const system::error_code
+                                                 &ec) {
+            BOOST_REQUIRE(!ec);
+            socket.async_read_some(message, [&](const system::error_code &ec) {
+                error = ec;
+                socket.async_write_end_of_message([&](const system::error_code
+                                                      &ec) {
+                    BOOST_CHECK(!ec);
+                    ended = true;
+                });
+            });
+        });
+    });
+    ios.run();
+
+    BOOST_CHECK(error
+                == system::error_code{http::http_errc::body_too_large});
+    BOOST_CHECK(ended);
+    BOOST_CHECK(!socket.is_open());
+    BOOST_CHECK(socket.next_layer().closed);
+
+    string output(socket.next_layer().output_buffer.begin(),
+                  socket.next_layer().output_buffer.end());
+    BOOST_CHECK(output == "HTTP/1.1 200 OK\r\n"
+                "transfer-encoding: chunked\r\n"
+                "\r\n"
+                "0\r\n"
+                "\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(socket_output_buffers) {
+    auto to_string = [](const http::detail::output_buffers &output) {
+        string ret(asio::buffer_size(output.sequence()), '\0');
+        asio::buffer_copy(asio::buffer(&ret[0], ret.size()),
+                          output.sequence());
+        return ret;
+    };
+
+    http::detail::output_buffers output;
+    http::detail::push_status_line_prefix(output, true, 404);
+    http::detail::push_status_line_prefix(output, false, 200);
+    http::detail::push_status_line_prefix(output, true, 299);
+    output.push_decimal(0);
+    output.push_back(asio::buffer(" ", 1));
+    output.push_hex(300);
+    BOOST_CHECK(to_string(output)
+                == "HTTP/1.1 404 HTTP/1.0 200 HTTP/1.1 299 0 12c");
+
+    // pieces beyond the inline capacity spill to the heap
+    output.clear();
+    const auto n = http::detail::output_buffers::inline_capacity + 10;
+    const char digits[] = "0123456789";
+    for (size_t i = 0;i != n;++i)
+        output.push_back(asio::buffer(digits + i % 10, 1));
+    BOOST_REQUIRE(output.size() == n);
+    string expected;
+    for (size_t i = 0;i != n;++i)
+        expected.push_back('0' + i % 10);
+    BOOST_CHECK(to_string(output) == expected);
+
+    // the spilled storage is reused
+    output.clear();
+    output.push_back(asio::buffer("hello ", 6));
+    output.push_back(asio::buffer("world", 5));
+    BOOST_CHECK(to_string(output) == "hello world");
+}